@@ -0,0 +1,621 @@
+#include "pch.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "Journal.h"
+#include "LatencyHistogram.h"
+#include "MatchingEngine.h"
+
+// Throughput and latency benchmark for the matching engine. Workloads are
+// generated up front from a seed, or loaded from a recorded journal, so that
+// only the engine itself is measured. Each workload is run twice on a fresh
+// engine: once flat out for throughput, once timing every operation.
+
+namespace
+{
+    enum class Workload
+    {
+        Place,      // Passive placements building up a deep book
+        Cancel,     // Cancelling every order of a deep book
+        Sweep,      // Aggressive orders taking out several levels at a time
+        Mixed,      // Placements, cancels and aggressive orders interleaved
+        Replay      // Inputs recorded in a journal
+    };
+
+    enum class PriceDistribution
+    {
+        Uniform,    // Evenly across the book depth
+        Normal      // Clustered around the touch
+    };
+
+    struct BenchmarkConfig
+    {
+        Workload workload{Workload::Mixed};
+        PriceDistribution distribution{PriceDistribution::Normal};
+        PriceLevelLayout layout{PriceLevelLayout::Map};
+
+        uint64_t operations{1000000};
+        uint32_t depth{1000};           // Price levels either side of the mid
+        uint32_t markets{1};
+        uint32_t sweepLevels{5};
+        double cancelRatio{0.4};
+        double aggressiveRatio{0.1};
+        uint64_t seed{1};
+        size_t arenaBytes{0};           // Reserved up front for each market's levels
+
+        std::string replayPath;
+        std::string recordPath;
+    };
+
+    // Latencies are reported for each kind of operation separately
+    enum class OperationKind
+    {
+        Passive,
+        Aggressive,
+        Cancel,
+        Count
+    };
+
+    const char* const OperationKindNames[] = {"passive", "aggressive", "cancel"};
+
+    struct Operation
+    {
+        OrderRequest request;
+        OperationKind kind{OperationKind::Passive};
+    };
+
+    struct Workflow
+    {
+        // Run untimed to bring the book to its starting state
+        std::vector<Operation> setup;
+        std::vector<Operation> measured;
+    };
+
+    struct FillCounter : public NullEventSink
+    {
+        void OnOrderMatched(const MatchedOrder&)
+        {
+            ++fills;
+        }
+
+        uint64_t fills{0};
+    };
+
+    using BenchmarkEngine = BasicMatchingEngine<FillCounter>;
+
+    constexpr Price MidPrice{1000000};
+
+    // Builds the orders and cancels of a workload, predicting the order IDs
+    // the engine will hand out so that cancels can refer to them
+    class WorkflowBuilder
+    {
+    public:
+        explicit WorkflowBuilder(const BenchmarkConfig& config)
+            : m_config(config)
+            , m_random(config.seed)
+        {
+        }
+
+        Workflow Build()
+        {
+            Workflow workflow;
+
+            switch(m_config.workload)
+            {
+            case Workload::Place:
+                for(uint64_t i = 0; i < m_config.operations; ++i)
+                {
+                    workflow.measured.push_back(Passive());
+                }
+                break;
+
+            case Workload::Cancel:
+                for(uint64_t i = 0; i < m_config.operations; ++i)
+                {
+                    workflow.setup.push_back(Passive());
+                }
+
+                std::shuffle(m_live.begin(), m_live.end(), m_random);
+
+                for(const OrderID oid : m_live)
+                {
+                    workflow.measured.push_back(Cancel(oid));
+                }
+                break;
+
+            case Workload::Sweep:
+                BuildSweep(workflow);
+                break;
+
+            case Workload::Mixed:
+                for(uint64_t i = 0; i < m_config.depth * 2 * m_config.markets; ++i)
+                {
+                    workflow.setup.push_back(Passive());
+                }
+
+                for(uint64_t i = 0; i < m_config.operations; ++i)
+                {
+                    const double choice = m_unit(m_random);
+
+                    if(choice < m_config.cancelRatio && !m_live.empty())
+                    {
+                        workflow.measured.push_back(Cancel(TakeRandomLive()));
+                    }
+                    else if(choice < m_config.cancelRatio + m_config.aggressiveRatio)
+                    {
+                        workflow.measured.push_back(Aggressive());
+                    }
+                    else
+                    {
+                        workflow.measured.push_back(Passive());
+                    }
+                }
+                break;
+
+            case Workload::Replay:
+                break;
+            }
+
+            return workflow;
+        }
+
+    private:
+        MarketID RandomMarket()
+        {
+            return static_cast<MarketID>(m_random() % m_config.markets);
+        }
+
+        OrderType RandomSide()
+        {
+            return m_random() % 2 == 0 ? OrderType::Bid : OrderType::Ask;
+        }
+
+        // Ticks away from the touch, within the configured depth
+        Price RandomOffset()
+        {
+            const uint32_t depth = std::max<uint32_t>(m_config.depth, 1);
+
+            if(m_config.distribution == PriceDistribution::Uniform)
+            {
+                return static_cast<Price>(m_random() % depth);
+            }
+
+            const double offset = std::abs(m_normal(m_random)) * depth / 3.0;
+            return static_cast<Price>(std::min<double>(offset, depth - 1));
+        }
+
+        Operation Place(MarketID market, OrderType side, Price price, Quantity volume, OperationKind kind)
+        {
+            Operation operation;
+            operation.kind = kind;
+            operation.request.type = OrderRequestType::Place;
+            operation.request.market = market;
+            operation.request.order.price = price;
+            operation.request.order.volume = volume;
+            operation.request.order.type = side;
+
+            m_lastOrderID = m_nextOrderID++;
+
+            return operation;
+        }
+
+        Operation Passive()
+        {
+            const OrderType side = RandomSide();
+            const Price offset = RandomOffset();
+            const Price price = side == OrderType::Bid ? MidPrice - 1 - offset : MidPrice + 1 + offset;
+
+            const MarketID market = RandomMarket();
+            const Quantity volume = static_cast<Quantity>(1 + m_random() % 10);
+
+            Operation operation = Place(market, side, price, volume, OperationKind::Passive);
+            m_live.push_back(m_lastOrderID);
+
+            return operation;
+        }
+
+        Operation Aggressive()
+        {
+            // Crosses in to the opposite side by a few levels
+            const OrderType side = RandomSide();
+            const Price reach = 1 + m_random() % 4;
+            const Price price = side == OrderType::Bid ? MidPrice + reach : MidPrice - reach;
+
+            const MarketID market = RandomMarket();
+            const Quantity volume = static_cast<Quantity>(1 + m_random() % 20);
+
+            return Place(market, side, price, volume, OperationKind::Aggressive);
+        }
+
+        Operation Cancel(OrderID oid)
+        {
+            Operation operation;
+            operation.kind = OperationKind::Cancel;
+            operation.request.type = OrderRequestType::Cancel;
+            operation.request.oid = oid;
+
+            return operation;
+        }
+
+        OrderID TakeRandomLive()
+        {
+            const size_t index = m_random() % m_live.size();
+            const OrderID oid = m_live[index];
+
+            m_live[index] = m_live.back();
+            m_live.pop_back();
+
+            return oid;
+        }
+
+        // One order of unit volume on every level either side of the mid,
+        // each aggressive order takes out the nearest levels of one side and
+        // they are immediately put back so the book keeps its shape
+        void BuildSweep(Workflow& workflow)
+        {
+            const Price levels = std::max<uint32_t>(m_config.sweepLevels, 1);
+            const Price depth = std::max<uint32_t>(m_config.depth, levels);
+
+            for(MarketID market = 0; market < m_config.markets; ++market)
+            {
+                for(Price level = 1; level <= depth; ++level)
+                {
+                    workflow.setup.push_back(Place(market, OrderType::Bid, MidPrice - level, 1, OperationKind::Passive));
+                    workflow.setup.push_back(Place(market, OrderType::Ask, MidPrice + level, 1, OperationKind::Passive));
+                }
+            }
+
+            for(uint64_t i = 0; i < m_config.operations; ++i)
+            {
+                const MarketID market = RandomMarket();
+                const OrderType side = RandomSide();
+                const OrderType opposite = side == OrderType::Bid ? OrderType::Ask : OrderType::Bid;
+                const Price price = side == OrderType::Bid ? MidPrice + levels : MidPrice - levels;
+
+                workflow.measured.push_back(Place(market, side, price, levels, OperationKind::Aggressive));
+
+                for(Price level = 1; level <= levels; ++level)
+                {
+                    const Price refill = opposite == OrderType::Bid ? MidPrice - level : MidPrice + level;
+                    workflow.measured.push_back(Place(market, opposite, refill, 1, OperationKind::Passive));
+                }
+            }
+        }
+
+        const BenchmarkConfig& m_config;
+
+        std::mt19937_64 m_random;
+        std::uniform_real_distribution<double> m_unit{0.0, 1.0};
+        std::normal_distribution<double> m_normal{0.0, 1.0};
+
+        OrderID m_nextOrderID{0};
+        OrderID m_lastOrderID{0};
+        std::vector<OrderID> m_live;
+    };
+
+    bool LoadReplay(const std::string& path, Workflow& workflow, uint32_t& markets)
+    {
+        JournalReader reader;
+
+        if(!reader.Open(path))
+        {
+            return false;
+        }
+
+        JournalRecord record;
+        markets = 1;
+
+        while(reader.Next(record))
+        {
+            Operation operation;
+
+            if(record.type == JournalRecordType::Cancel)
+            {
+                operation.kind = OperationKind::Cancel;
+                operation.request.type = OrderRequestType::Cancel;
+                operation.request.oid = record.oid;
+            }
+            else
+            {
+                // Replayed placements can't be told apart up front,
+                // they are reported together as passive
+                operation.request.type = OrderRequestType::Place;
+                operation.request.market = record.market;
+                operation.request.order.price = record.price;
+                operation.request.order.volume = record.volume;
+                operation.request.order.type = record.side;
+
+                markets = std::max<uint32_t>(markets, record.market + 1);
+            }
+
+            workflow.measured.push_back(operation);
+        }
+
+        return true;
+    }
+
+    void InitialiseEngine(BenchmarkEngine& engine, const BenchmarkConfig& config)
+    {
+        std::vector<MarketConfig> markets;
+
+        for(uint32_t market = 0; market < config.markets; ++market)
+        {
+            MarketConfig& marketConfig = markets.emplace_back(MarketConfig{"MARKET-" + std::to_string(market), config.layout});
+            marketConfig.arenaBytes = config.arenaBytes;
+        }
+
+        engine.InitialiseMarkets(markets);
+    }
+
+    template<bool TimeEachOperation>
+    void Run(BenchmarkEngine& engine, const std::vector<Operation>& operations, LatencyHistogram* pHistograms)
+    {
+        for(const Operation& operation : operations)
+        {
+            std::chrono::steady_clock::time_point start;
+
+            if constexpr(TimeEachOperation)
+            {
+                start = std::chrono::steady_clock::now();
+            }
+
+            if(operation.request.type == OrderRequestType::Place)
+            {
+                engine.OnOrderPlace(operation.request.market, Order{operation.request.order});
+            }
+            else
+            {
+                engine.OnOrderCancel(operation.request.oid);
+            }
+
+            if constexpr(TimeEachOperation)
+            {
+                const auto elapsed = std::chrono::steady_clock::now() - start;
+                pHistograms[static_cast<size_t>(operation.kind)].Record(
+                    static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+            }
+        }
+    }
+
+    void PrintUsage()
+    {
+        std::cout
+            << "Usage: Benchmark [options]\n"
+            << "  --workload place|cancel|sweep|mixed   generated workload (default mixed)\n"
+            << "  --replay <journal>                    replay inputs recorded in a journal\n"
+            << "  --record <journal>                    journal the inputs of the throughput run\n"
+            << "  --operations <n>                      measured operations (default 1000000)\n"
+            << "  --depth <levels>                      price levels either side of the mid (default 1000)\n"
+            << "  --distribution uniform|normal         placement prices (default normal)\n"
+            << "  --cancel-ratio <0..1>                 share of mixed flow that cancels (default 0.4)\n"
+            << "  --aggressive-ratio <0..1>             share of mixed flow that crosses (default 0.1)\n"
+            << "  --sweep-levels <n>                    levels each sweep takes out (default 5)\n"
+            << "  --markets <n>                         markets the flow is spread over (default 1)\n"
+            << "  --layout map|ladder                   price level layout (default map)\n"
+            << "  --arena-bytes <n>                     bytes reserved for each market's levels (default 0)\n"
+            << "  --seed <n>                            workload seed (default 1)\n";
+    }
+
+    bool ParseArguments(int argc, char** argv, BenchmarkConfig& config)
+    {
+        for(int i = 1; i < argc; ++i)
+        {
+            const std::string option{argv[i]};
+
+            if(option == "--help")
+            {
+                return false;
+            }
+
+            if(i + 1 >= argc)
+            {
+                std::cerr << "Missing value for " << option << std::endl;
+                return false;
+            }
+
+            const std::string value{argv[++i]};
+
+            if(option == "--workload")
+            {
+                if(value == "place")       config.workload = Workload::Place;
+                else if(value == "cancel") config.workload = Workload::Cancel;
+                else if(value == "sweep")  config.workload = Workload::Sweep;
+                else if(value == "mixed")  config.workload = Workload::Mixed;
+                else return false;
+            }
+            else if(option == "--replay")
+            {
+                config.workload = Workload::Replay;
+                config.replayPath = value;
+            }
+            else if(option == "--record")           config.recordPath = value;
+            else if(option == "--operations")       config.operations = std::strtoull(value.c_str(), nullptr, 10);
+            else if(option == "--depth")            config.depth = static_cast<uint32_t>(std::strtoul(value.c_str(), nullptr, 10));
+            else if(option == "--cancel-ratio")     config.cancelRatio = std::strtod(value.c_str(), nullptr);
+            else if(option == "--aggressive-ratio") config.aggressiveRatio = std::strtod(value.c_str(), nullptr);
+            else if(option == "--sweep-levels")     config.sweepLevels = static_cast<uint32_t>(std::strtoul(value.c_str(), nullptr, 10));
+            else if(option == "--markets")          config.markets = std::max<uint32_t>(1, static_cast<uint32_t>(std::strtoul(value.c_str(), nullptr, 10)));
+            else if(option == "--seed")             config.seed = std::strtoull(value.c_str(), nullptr, 10);
+            else if(option == "--arena-bytes")      config.arenaBytes = static_cast<size_t>(std::strtoull(value.c_str(), nullptr, 10));
+            else if(option == "--distribution")
+            {
+                if(value == "uniform")     config.distribution = PriceDistribution::Uniform;
+                else if(value == "normal") config.distribution = PriceDistribution::Normal;
+                else return false;
+            }
+            else if(option == "--layout")
+            {
+                if(value == "map")         config.layout = PriceLevelLayout::Map;
+                else if(value == "ladder") config.layout = PriceLevelLayout::Ladder;
+                else return false;
+            }
+            else
+            {
+                std::cerr << "Unknown option " << option << std::endl;
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    void PrintHistogram(const char* name, const LatencyHistogram& histogram)
+    {
+        std::cout << std::left << std::setw(12) << name << std::right
+                  << std::setw(10) << histogram.GetCount()
+                  << std::setw(9) << static_cast<uint64_t>(histogram.GetMean())
+                  << std::setw(9) << histogram.GetPercentile(50.0)
+                  << std::setw(9) << histogram.GetPercentile(90.0)
+                  << std::setw(9) << histogram.GetPercentile(99.0)
+                  << std::setw(9) << histogram.GetPercentile(99.9)
+                  << std::setw(9) << histogram.GetPercentile(99.99)
+                  << std::setw(10) << histogram.GetMax()
+                  << std::endl;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    BenchmarkConfig config;
+
+    if(!ParseArguments(argc, argv, config))
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    Workflow workflow;
+
+    if(config.workload == Workload::Replay)
+    {
+        if(!LoadReplay(config.replayPath, workflow, config.markets))
+        {
+            std::cerr << "Unable to read journal " << config.replayPath << std::endl;
+            return 1;
+        }
+    }
+    else
+    {
+        workflow = WorkflowBuilder(config).Build();
+    }
+
+    // Throughput, with nothing but the engine in the loop
+    double seconds{0.0};
+    uint64_t fills{0};
+
+    {
+        BenchmarkEngine engine;
+        InitialiseEngine(engine, config);
+
+        JournalWriter journal;
+
+        if(!config.recordPath.empty())
+        {
+            JournalConfig journalConfig;
+            journalConfig.path = config.recordPath;
+            journalConfig.sync = JournalSyncPolicy::None;
+
+            if(!journal.Open(journalConfig))
+            {
+                std::cerr << "Unable to open journal " << config.recordPath << std::endl;
+                return 1;
+            }
+
+            engine.AttachJournal(&journal);
+        }
+
+        Run<false>(engine, workflow.setup, nullptr);
+
+        const auto start = std::chrono::steady_clock::now();
+        Run<false>(engine, workflow.measured, nullptr);
+        seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        fills = engine.GetSink<FillCounter>().fills;
+    }
+
+    // Latency, timing each operation on a fresh engine
+    LatencyHistogram histograms[static_cast<size_t>(OperationKind::Count)];
+
+#ifdef MATCHING_ENGINE_INSTRUMENTATION
+    EngineInstrumentation instrumentation;
+#endif
+
+    {
+        BenchmarkEngine engine;
+        InitialiseEngine(engine, config);
+
+        Run<false>(engine, workflow.setup, nullptr);
+
+#ifdef MATCHING_ENGINE_INSTRUMENTATION
+        engine.ResetInstrumentation();
+#endif
+
+        Run<true>(engine, workflow.measured, histograms);
+
+#ifdef MATCHING_ENGINE_INSTRUMENTATION
+        instrumentation = engine.GetInstrumentation();
+#endif
+    }
+
+    const uint64_t operations = workflow.measured.size();
+
+    std::cout << "operations  " << operations << "\n"
+              << "fills       " << fills << "\n"
+              << "seconds     " << std::fixed << std::setprecision(3) << seconds << "\n"
+              << "ops/sec     " << std::setprecision(0) << (seconds > 0.0 ? operations / seconds : 0.0) << "\n\n";
+
+    std::cout << std::left << std::setw(12) << "latency ns" << std::right
+              << std::setw(10) << "count"
+              << std::setw(9) << "mean"
+              << std::setw(9) << "p50"
+              << std::setw(9) << "p90"
+              << std::setw(9) << "p99"
+              << std::setw(9) << "p99.9"
+              << std::setw(9) << "p99.99"
+              << std::setw(10) << "max"
+              << std::endl;
+
+    LatencyHistogram all;
+
+    for(size_t kind = 0; kind < static_cast<size_t>(OperationKind::Count); ++kind)
+    {
+        if(histograms[kind].GetCount() > 0)
+        {
+            PrintHistogram(OperationKindNames[kind], histograms[kind]);
+            all.Merge(histograms[kind]);
+        }
+    }
+
+    PrintHistogram("all", all);
+
+#ifdef MATCHING_ENGINE_INSTRUMENTATION
+    const char* const stageNames[] = {"lookup", "journal", "match", "rest", "notify", "cancel", "modify", "risk"};
+
+    std::cout << "\nstage ticks (" << std::setprecision(2) << TimestampsPerSecond() / 1e9 << " per ns)\n";
+
+    for(size_t stage = 0; stage < static_cast<size_t>(EngineStage::Count); ++stage)
+    {
+        const LatencyHistogram& histogram = instrumentation.GetStage(static_cast<EngineStage>(stage));
+
+        if(histogram.GetCount() > 0)
+        {
+            PrintHistogram(stageNames[stage], histogram);
+        }
+    }
+
+    std::cout << "\nfills/aggressor " << instrumentation.GetFillsPerAggressor()
+              << "\nlevels walked   " << instrumentation.counters.levelsWalked
+              << "\ncancel hits     " << instrumentation.GetCancelHitRatio()
+              << std::endl;
+#endif
+
+    return 0;
+}
@@ -6,7 +6,17 @@ class IEngineEvents
 {
 public:
     virtual OrderPlaceEventResult OnOrderPlace(Order&& o) = 0;
+    virtual OrderPlaceEventResult OnOrderPlace(MarketID market, Order&& o) = 0;
     virtual OrderCancelEventResult OnOrderCancel(OrderID oid) = 0;
+
+    // Amends a resting order in place of a cancel and a new order. A smaller
+    // quantity at the same price keeps the order's place in the queue, any
+    // other change moves it to the back of the queue at its new price.
+    virtual OrderModifyEventResult OnOrderModify(OrderID oid, Price price, Quantity volume) = 0;
+
+    // Cancels every resting order of an owner, or only those it has in one
+    // market, in a single pass. Given NoOwner it clears the whole market.
+    virtual OrderCancelEventResult OnMassCancel(OwnerID owner, MarketID market = InvalidMarketID) = 0;
 };
 
 class IExchangeEvents
@@ -15,4 +25,27 @@ public:
     virtual void OnNewOrder(OrderID oid, const Order& o) = 0;
     virtual void OnCancelledOrder(OrderID oid) = 0;
     virtual void OnOrderMatched(const MatchedOrder& mo) = 0;
+
+    // Reported once an amended order has come to rest, after any fills the
+    // amendment causes, with the volume it rests with. Also reported when
+    // self-trade prevention takes volume from a resting order, or from an
+    // incoming one that goes on to rest, without a trade.
+    virtual void OnModifiedOrder(const ModifiedOrder& /*mo*/) {}
+
+    // A stop order reached its stop price and is about to be matched as the
+    // market or limit order given, under the ID it was placed with
+    virtual void OnStopTriggered(OrderID /*oid*/, const Order& /*o*/) {}
+
+    // Every order taken out by one mass cancel, delivered together
+    virtual void OnOrdersCancelled(const OrderID* oids, size_t count)
+    {
+        for(size_t i = 0; i < count; ++i)
+        {
+            OnCancelledOrder(oids[i]);
+        }
+    }
+
+    // Every level changed by one input, delivered together once the input
+    // has been handled. Each level appears once with its final state.
+    virtual void OnDepthUpdate(const DepthUpdate* /*updates*/, size_t /*count*/) {}
 };
@@ -0,0 +1,446 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+
+#include "Types.h"
+
+enum class EventRecordType : uint8_t
+{
+    NewOrder,
+    Cancel,
+    Fill,
+    Modify,
+    Depth,
+    StopTriggered
+};
+
+// Fixed size, self contained encoding of an engine event. Fields which don't
+// apply to a record type are left zeroed, a new order's ID is carried in
+// bidSideOrderID or askSideOrderID depending on its side. A depth record
+// holds the aggregate volume and order count of one level.
+struct EventRecord
+{
+    uint64_t sequence{0};
+    OrderID bidSideOrderID{0};
+    OrderID askSideOrderID{0};
+    Quantity volume{0};
+    Price price{0};
+    MarketID market{InvalidMarketID};
+    uint32_t orderCount{0};
+    EventRecordType type{EventRecordType::NewOrder};
+    OrderType side{OrderType::Bid};
+};
+
+static_assert(std::is_trivially_copyable<EventRecord>::value, "EventRecord is copied word by word");
+
+class EventRingReader;
+
+// Broadcast ring written by the matching thread and read by any number of
+// consumers on their own threads, each at its own pace. The producer never
+// waits: a consumer which falls more than a ring behind finds its unread
+// records overwritten, detects the overrun and skips to the oldest record
+// still available. The producer counts every record it writes over one that
+// a subscribed reader hasn't consumed yet, so backpressure is visible even
+// though it is never applied.
+//
+// Slots are guarded by a sequence number the producer makes odd while writing,
+// readers retry or declare an overrun if it changes under them.
+class EventRing
+{
+public:
+    static constexpr size_t MaxReaders{8};
+
+    explicit EventRing(size_t capacity)
+        : m_mask(RoundUpToPowerOfTwo(capacity) - 1)
+        , m_slots(new Slot[m_mask + 1])
+    {
+        for(auto& cursor : m_readerCursors)
+        {
+            cursor.position.store(Unsubscribed, std::memory_order_relaxed);
+        }
+    }
+
+    EventRing(const EventRing&) = delete;
+    EventRing& operator =(const EventRing&) = delete;
+
+    // Only ever called from the producing thread
+    void Publish(EventRecord record)
+    {
+        const uint64_t position = m_head.load(std::memory_order_relaxed);
+
+        if(position - m_slowestReader > m_mask)
+        {
+            m_slowestReader = FindSlowestReader(position);
+
+            if(position - m_slowestReader > m_mask)
+            {
+                m_overwritten.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+
+        record.sequence = position;
+
+        Words words;
+        std::memcpy(words.data(), &record, sizeof(record));
+
+        Slot& slot = m_slots[position & m_mask];
+        slot.sequence.store(2 * position + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        for(size_t i = 0; i < words.size(); ++i)
+        {
+            slot.words[i].store(words[i], std::memory_order_relaxed);
+        }
+
+        slot.sequence.store(2 * position + 2, std::memory_order_release);
+        m_head.store(position + 1, std::memory_order_release);
+    }
+
+    // Readers start from the next record published, returns an unattached
+    // reader while MaxReaders are subscribed. A reader's slot is given to
+    // the next to subscribe once it has been destroyed.
+    EventRingReader Subscribe();
+
+    size_t GetCapacity() const
+    {
+        return m_mask + 1;
+    }
+
+    uint64_t GetPublished() const
+    {
+        return m_head.load(std::memory_order_acquire);
+    }
+
+    // Records written over one a subscribed reader had yet to consume
+    uint64_t GetOverwritten() const
+    {
+        return m_overwritten.load(std::memory_order_relaxed);
+    }
+
+private:
+    friend class EventRingReader;
+
+    static constexpr uint64_t Unsubscribed{UINT64_MAX};
+    static constexpr size_t WordCount{(sizeof(EventRecord) + sizeof(uint64_t) - 1) / sizeof(uint64_t)};
+
+    using Words = std::array<uint64_t, WordCount>;
+
+    // Record contents are held as relaxed atomics so that a reader racing the
+    // producer reads stale words rather than invoking undefined behaviour, the
+    // slot sequence tells it to throw them away
+    struct Slot
+    {
+        std::atomic<uint64_t> sequence{0};
+        std::array<std::atomic<uint64_t>, WordCount> words{};
+    };
+
+    struct alignas(64) ReaderCursor
+    {
+        std::atomic<uint64_t> position;
+    };
+
+    uint64_t FindSlowestReader(uint64_t position) const
+    {
+        uint64_t slowest = position;
+
+        for(const auto& cursor : m_readerCursors)
+        {
+            const uint64_t readerPosition = cursor.position.load(std::memory_order_acquire);
+
+            if(readerPosition < slowest)
+            {
+                slowest = readerPosition;
+            }
+        }
+
+        return slowest;
+    }
+
+    static size_t RoundUpToPowerOfTwo(size_t value)
+    {
+        size_t result{2};
+
+        while(result < value)
+        {
+            result <<= 1;
+        }
+
+        return result;
+    }
+
+    const size_t m_mask;
+    const std::unique_ptr<Slot[]> m_slots;
+
+    std::array<ReaderCursor, MaxReaders> m_readerCursors;
+
+    // Producer state, on its own cache line away from the reader cursors
+    alignas(64) std::atomic<uint64_t> m_head{0};
+    uint64_t m_slowestReader{0};
+    std::atomic<uint64_t> m_overwritten{0};
+};
+
+// A single consumer's view of an EventRing, to be used from one thread only
+class EventRingReader
+{
+public:
+    EventRingReader() = default;
+
+    EventRingReader(const EventRingReader&) = delete;
+    EventRingReader& operator =(const EventRingReader&) = delete;
+
+    EventRingReader(EventRingReader&& other) noexcept
+        : m_pRing(other.m_pRing)
+        , m_pCursor(other.m_pCursor)
+        , m_position(other.m_position)
+        , m_overruns(other.m_overruns)
+    {
+        other.m_pRing = nullptr;
+        other.m_pCursor = nullptr;
+    }
+
+    ~EventRingReader()
+    {
+        if(m_pCursor)
+        {
+            // Stops the producer counting this reader towards backpressure
+            // and frees the slot for another to subscribe
+            m_pCursor->position.store(EventRing::Unsubscribed, std::memory_order_release);
+        }
+    }
+
+    bool IsAttached() const
+    {
+        return m_pRing != nullptr;
+    }
+
+    // Fetches the next record, returns false when there is nothing new.
+    // Records lost to an overrun are skipped and added to GetOverruns.
+    bool TryRead(EventRecord& record)
+    {
+        if(!m_pRing)
+        {
+            return false;
+        }
+
+        for(;;)
+        {
+            const EventRing::Slot& slot = m_pRing->m_slots[m_position & m_pRing->m_mask];
+            const uint64_t expected = 2 * m_position + 2;
+            const uint64_t before = slot.sequence.load(std::memory_order_acquire);
+
+            if(before < expected)
+            {
+                // Not yet published, or still being written
+                return false;
+            }
+
+            EventRing::Words words;
+
+            if(before == expected)
+            {
+                for(size_t i = 0; i < words.size(); ++i)
+                {
+                    words[i] = slot.words[i].load(std::memory_order_relaxed);
+                }
+
+                std::atomic_thread_fence(std::memory_order_acquire);
+
+                if(slot.sequence.load(std::memory_order_relaxed) == before)
+                {
+                    // Trivially copyable as asserted with its definition, only
+                    // its member initialisers make it look otherwise
+                    std::memcpy(static_cast<void*>(&record), words.data(), sizeof(record));
+                    Advance(m_position + 1);
+                    return true;
+                }
+            }
+
+            SkipOverrun();
+        }
+    }
+
+    // Records published but not yet read
+    uint64_t GetLag() const
+    {
+        return m_pRing ? m_pRing->GetPublished() - m_position : 0;
+    }
+
+    // Records overwritten before this reader got to them
+    uint64_t GetOverruns() const
+    {
+        return m_overruns;
+    }
+
+private:
+    friend class EventRing;
+
+    EventRingReader(EventRing* pRing, EventRing::ReaderCursor* pCursor, uint64_t position)
+        : m_pRing(pRing)
+        , m_pCursor(pCursor)
+        , m_position(position)
+    {
+    }
+
+    void Advance(uint64_t position)
+    {
+        m_position = position;
+        m_pCursor->position.store(position, std::memory_order_release);
+    }
+
+    void SkipOverrun()
+    {
+        // Resume from the oldest record the producer can't be about to
+        // overwrite, leaving a slot of slack for the one it is writing now
+        const uint64_t head = m_pRing->m_head.load(std::memory_order_acquire);
+        const uint64_t oldest = head > m_pRing->m_mask ? head - m_pRing->m_mask : 0;
+        const uint64_t resume = oldest > m_position ? oldest : m_position + 1;
+
+        m_overruns += resume - m_position;
+        Advance(resume);
+    }
+
+    EventRing* m_pRing{nullptr};
+    EventRing::ReaderCursor* m_pCursor{nullptr};
+    uint64_t m_position{0};
+    uint64_t m_overruns{0};
+};
+
+inline EventRingReader EventRing::Subscribe()
+{
+    const uint64_t position = m_head.load(std::memory_order_acquire);
+
+    for(ReaderCursor& cursor : m_readerCursors)
+    {
+        uint64_t free{Unsubscribed};
+
+        if(cursor.position.compare_exchange_strong(free, position, std::memory_order_acq_rel))
+        {
+            return EventRingReader(this, &cursor, position);
+        }
+    }
+
+    return EventRingReader();
+}
+
+// Compile time sink encoding every event into an EventRing, leaving
+// downstream consumers to process them on their own threads
+class EventRingSink
+{
+public:
+    void Attach(EventRing* pRing)
+    {
+        m_pRing = pRing;
+    }
+
+    void OnNewOrder(OrderID oid, const Order& o)
+    {
+        Publish(EventRecordType::NewOrder, oid, o);
+    }
+
+    // Published like a new order, as the market or limit order the stop became
+    void OnStopTriggered(OrderID oid, const Order& o)
+    {
+        Publish(EventRecordType::StopTriggered, oid, o);
+    }
+
+    void OnCancelledOrder(OrderID oid)
+    {
+        if(m_pRing)
+        {
+            EventRecord record;
+            record.type = EventRecordType::Cancel;
+            record.bidSideOrderID = oid;
+            record.askSideOrderID = oid;
+
+            m_pRing->Publish(record);
+        }
+    }
+
+    // A mass cancel is published as a cancel record for each order
+    void OnOrdersCancelled(const OrderID* oids, size_t count)
+    {
+        for(size_t i = 0; i < count; ++i)
+        {
+            OnCancelledOrder(oids[i]);
+        }
+    }
+
+    void OnOrderMatched(const MatchedOrder& mo)
+    {
+        if(m_pRing)
+        {
+            EventRecord record;
+            record.type = EventRecordType::Fill;
+            record.side = mo.type;
+            record.market = mo.market;
+            record.price = mo.price;
+            record.volume = mo.volume;
+            record.bidSideOrderID = mo.bidSideOrderID;
+            record.askSideOrderID = mo.askSideOrderID;
+
+            m_pRing->Publish(record);
+        }
+    }
+
+    void OnModifiedOrder(const ModifiedOrder& mo)
+    {
+        if(m_pRing)
+        {
+            EventRecord record;
+            record.type = EventRecordType::Modify;
+            record.side = mo.type;
+            record.market = mo.market;
+            record.price = mo.price;
+            record.volume = mo.volume;
+            (mo.type == OrderType::Bid ? record.bidSideOrderID : record.askSideOrderID) = mo.oid;
+
+            m_pRing->Publish(record);
+        }
+    }
+
+    // Each level of a batch is published as a record of its own
+    void OnDepthUpdate(const DepthUpdate* updates, size_t count)
+    {
+        if(m_pRing)
+        {
+            for(size_t i = 0; i < count; ++i)
+            {
+                EventRecord record;
+                record.type = EventRecordType::Depth;
+                record.side = updates[i].side;
+                record.market = updates[i].market;
+                record.price = updates[i].price;
+                record.volume = updates[i].volume;
+                record.orderCount = updates[i].orderCount;
+
+                m_pRing->Publish(record);
+            }
+        }
+    }
+
+private:
+    // Orders are published with their ID on their own side
+    void Publish(EventRecordType type, OrderID oid, const Order& o)
+    {
+        if(m_pRing)
+        {
+            EventRecord record;
+            record.type = type;
+            record.side = o.type;
+            record.market = o.marketID;
+            record.price = o.price;
+            record.volume = o.volume;
+            (o.type == OrderType::Bid ? record.bidSideOrderID : record.askSideOrderID) = oid;
+
+            m_pRing->Publish(record);
+        }
+    }
+
+    EventRing* m_pRing{nullptr};
+};
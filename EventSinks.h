@@ -0,0 +1,89 @@
+#pragma once
+
+#include <vector>
+
+#include "EngineInterfaces.h"
+
+// Event sinks are bound to a BasicMatchingEngine at compile time, so every
+// notification is a direct call the compiler can inline. A sink only needs
+// to provide the events it cares about, deriving from NullEventSink fills in
+// the rest with calls that compile away to nothing.
+struct NullEventSink
+{
+    void OnNewOrder(OrderID, const Order&) {}
+    void OnCancelledOrder(OrderID) {}
+    void OnOrdersCancelled(const OrderID*, size_t) {}
+    void OnOrderMatched(const MatchedOrder&) {}
+    void OnModifiedOrder(const ModifiedOrder&) {}
+    void OnStopTriggered(OrderID, const Order&) {}
+    void OnDepthUpdate(const DepthUpdate*, size_t) {}
+};
+
+// Forwards every event to observers registered at runtime
+class ExchangeEventObservers
+{
+public:
+    void Register(IExchangeEvents* pObserver)
+    {
+        m_eventObservers.push_back(pObserver);
+    }
+
+    void OnNewOrder(OrderID oid, const Order& o)
+    {
+        for(const auto& observer : m_eventObservers)
+        {
+            observer->OnNewOrder(oid, o);
+        }
+    }
+
+    void OnCancelledOrder(OrderID oid)
+    {
+        for(const auto& observer : m_eventObservers)
+        {
+            observer->OnCancelledOrder(oid);
+        }
+    }
+
+    void OnOrdersCancelled(const OrderID* oids, size_t count)
+    {
+        for(const auto& observer : m_eventObservers)
+        {
+            observer->OnOrdersCancelled(oids, count);
+        }
+    }
+
+    void OnOrderMatched(const MatchedOrder& mo)
+    {
+        for(const auto& observer : m_eventObservers)
+        {
+            observer->OnOrderMatched(mo);
+        }
+    }
+
+    void OnModifiedOrder(const ModifiedOrder& mo)
+    {
+        for(const auto& observer : m_eventObservers)
+        {
+            observer->OnModifiedOrder(mo);
+        }
+    }
+
+    void OnStopTriggered(OrderID oid, const Order& o)
+    {
+        for(const auto& observer : m_eventObservers)
+        {
+            observer->OnStopTriggered(oid, o);
+        }
+    }
+
+    void OnDepthUpdate(const DepthUpdate* updates, size_t count)
+    {
+        for(const auto& observer : m_eventObservers)
+        {
+            observer->OnDepthUpdate(updates, count);
+        }
+    }
+
+private:
+    std::vector<IExchangeEvents*> m_eventObservers;
+};
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "LatencyHistogram.h"
+
+// Hot path instrumentation for the matching engine, compiled in only when
+// MATCHING_ENGINE_INSTRUMENTATION is defined (make instrument=1). Otherwise
+// the macros below expand to nothing and the engine carries no trace of it.
+//
+// Each engine owns its instrumentation and is only ever driven from one
+// thread, so recording needs neither locks nor atomics. Stages nest, an
+// aggressor's match time includes notifying each of its fills.
+
+enum class EngineStage
+{
+    MarketLookup,   // Resolving a market by name
+    Journal,        // Appending an input to the journal
+    Match,          // Walking the opposite side of the book
+    Rest,           // Inserting what remains of an order at its level
+    Notify,         // Delivering one event to every sink
+    Cancel,         // Finding and unlinking a cancelled order
+    Modify,         // Amending an order, including any fills it causes
+    Risk,           // Checking an order against its account's limits
+    Count
+};
+
+struct EngineCounters
+{
+    uint64_t ordersPlaced{0};
+    uint64_t aggressors{0};         // Placements which matched at least once
+    uint64_t fills{0};
+    uint64_t levelsWalked{0};       // Levels of the opposite side visited while matching
+    uint64_t selfTrades{0};         // Resting orders met by an aggressor of the same owner
+    uint64_t cancelsRequested{0};
+    uint64_t cancelsFound{0};
+};
+
+// Raw timestamp in the cheapest clock available, TSC ticks on x86
+inline uint64_t ReadTimestamp()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+}
+
+// Rate at which ReadTimestamp advances, measured once on first use
+inline double TimestampsPerSecond()
+{
+    static const double rate = []()
+    {
+        const auto start = std::chrono::steady_clock::now();
+        const uint64_t startTimestamp = ReadTimestamp();
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+        const uint64_t elapsedTimestamps = ReadTimestamp() - startTimestamp;
+        const double elapsedSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        return elapsedSeconds > 0.0 ? static_cast<double>(elapsedTimestamps) / elapsedSeconds : 1e9;
+    }();
+
+    return rate;
+}
+
+class EngineInstrumentation
+{
+public:
+    void Record(EngineStage stage, uint64_t timestamps)
+    {
+        m_stages[static_cast<size_t>(stage)].Record(timestamps);
+    }
+
+    // Durations are in ReadTimestamp units, see TimestampsPerSecond
+    const LatencyHistogram& GetStage(EngineStage stage) const
+    {
+        return m_stages[static_cast<size_t>(stage)];
+    }
+
+    double GetOrdersPerSecond() const
+    {
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count();
+        return seconds > 0.0 ? static_cast<double>(counters.ordersPlaced) / seconds : 0.0;
+    }
+
+    double GetFillsPerAggressor() const
+    {
+        return counters.aggressors == 0 ? 0.0 : static_cast<double>(counters.fills) / static_cast<double>(counters.aggressors);
+    }
+
+    double GetCancelHitRatio() const
+    {
+        return counters.cancelsRequested == 0 ? 0.0 : static_cast<double>(counters.cancelsFound) / static_cast<double>(counters.cancelsRequested);
+    }
+
+    void Reset()
+    {
+        for(auto& stage : m_stages)
+        {
+            stage.Reset();
+        }
+
+        counters = EngineCounters{};
+        m_start = std::chrono::steady_clock::now();
+    }
+
+    EngineCounters counters;
+
+private:
+    LatencyHistogram m_stages[static_cast<size_t>(EngineStage::Count)];
+    std::chrono::steady_clock::time_point m_start{std::chrono::steady_clock::now()};
+};
+
+#ifdef MATCHING_ENGINE_INSTRUMENTATION
+
+#define INSTRUMENT_BEGIN( timer )                                               \
+    const uint64_t timer{ReadTimestamp()}
+
+#define INSTRUMENT_END( timer, stage )                                          \
+    m_instrumentation.Record(stage, ReadTimestamp() - timer)
+
+#define INSTRUMENT_COUNT( counter, n )                                          \
+    m_instrumentation.counters.counter += (n)
+
+#else
+
+#define INSTRUMENT_BEGIN( timer )
+#define INSTRUMENT_END( timer, stage )
+#define INSTRUMENT_COUNT( counter, n )
+
+#endif
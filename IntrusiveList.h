@@ -0,0 +1,124 @@
+#pragma once
+
+#include <cassert>
+
+template<typename Node>
+struct IntrusiveListHook
+{
+    Node* prev{nullptr};
+    Node* next{nullptr};
+};
+
+// Doubly linked list threaded through a hook embedded in each node. The list
+// neither owns nor allocates its nodes so appending and unlinking are O(1),
+// and a node can sit in several lists at once through separate hooks.
+template<typename Node, IntrusiveListHook<Node> Node::*Hook>
+class IntrusiveList
+{
+public:
+    IntrusiveList() = default;
+
+    IntrusiveList(const IntrusiveList&) = delete;
+    IntrusiveList& operator =(const IntrusiveList&) = delete;
+
+    IntrusiveList(IntrusiveList&& other) noexcept
+        : m_head(other.m_head)
+        , m_tail(other.m_tail)
+    {
+        other.m_head = nullptr;
+        other.m_tail = nullptr;
+    }
+
+    IntrusiveList& operator =(IntrusiveList&& other) noexcept
+    {
+        // Nodes are never owned, so assigning over a populated list would orphan them
+        assert(this == &other || Empty());
+
+        if(this != &other)
+        {
+            m_head = other.m_head;
+            m_tail = other.m_tail;
+            other.m_head = nullptr;
+            other.m_tail = nullptr;
+        }
+
+        return *this;
+    }
+
+    bool Empty() const
+    {
+        return m_head == nullptr;
+    }
+
+    Node* Front() const
+    {
+        return m_head;
+    }
+
+    Node* Back() const
+    {
+        return m_tail;
+    }
+
+    static Node* Next(const Node* node)
+    {
+        return (node->*Hook).next;
+    }
+
+    void PushBack(Node* node)
+    {
+        IntrusiveListHook<Node>& hook = node->*Hook;
+        hook.prev = m_tail;
+        hook.next = nullptr;
+
+        if(m_tail != nullptr)
+        {
+            (m_tail->*Hook).next = node;
+        }
+        else
+        {
+            m_head = node;
+        }
+
+        m_tail = node;
+    }
+
+    void Erase(Node* node)
+    {
+        IntrusiveListHook<Node>& hook = node->*Hook;
+
+        if(hook.prev != nullptr)
+        {
+            (hook.prev->*Hook).next = hook.next;
+        }
+        else
+        {
+            assert(m_head == node);
+            m_head = hook.next;
+        }
+
+        if(hook.next != nullptr)
+        {
+            (hook.next->*Hook).prev = hook.prev;
+        }
+        else
+        {
+            assert(m_tail == node);
+            m_tail = hook.prev;
+        }
+
+        hook.prev = nullptr;
+        hook.next = nullptr;
+    }
+
+    Node* PopFront()
+    {
+        Node* node = m_head;
+        Erase(node);
+        return node;
+    }
+
+private:
+    Node* m_head{nullptr};
+    Node* m_tail{nullptr};
+};
@@ -0,0 +1,250 @@
+#include "pch.h"
+
+#ifdef Linux
+#include <unistd.h>
+#endif
+
+#include "Journal.h"
+
+namespace
+{
+    // Written once at the start of every journal
+    struct JournalHeader
+    {
+        uint32_t magic{0x4C4E524A};    // "JRNL"
+        uint32_t version{5};
+        uint32_t recordSize{sizeof(JournalRecord)};
+        uint32_t reserved{0};
+    };
+
+    bool ReadHeader(std::FILE* pFile)
+    {
+        JournalHeader header;
+        const JournalHeader expected;
+
+        return std::fread(&header, sizeof(header), 1, pFile) == 1
+            && header.magic == expected.magic
+            && header.version == expected.version
+            && header.recordSize == expected.recordSize;
+    }
+}
+
+JournalWriter::~JournalWriter()
+{
+    Close();
+}
+
+bool JournalWriter::Open(const JournalConfig& config)
+{
+    Close();
+
+    std::FILE* pFile = std::fopen(config.path.c_str(), "a+b");
+
+    if(pFile == nullptr)
+    {
+        return false;
+    }
+
+    std::fseek(pFile, 0, SEEK_END);
+
+    if(std::ftell(pFile) == 0)
+    {
+        const JournalHeader header;
+
+        if(std::fwrite(&header, sizeof(header), 1, pFile) != 1 || std::fflush(pFile) != 0)
+        {
+            std::fclose(pFile);
+            return false;
+        }
+    }
+    else
+    {
+        // Only ever extend a journal in the same format
+        const long size = std::ftell(pFile);
+        std::fseek(pFile, 0, SEEK_SET);
+
+        if(!ReadHeader(pFile))
+        {
+            std::fclose(pFile);
+            return false;
+        }
+
+#ifdef Linux
+        // Drop a record left half written by a writer that stopped mid commit,
+        // otherwise every record appended after it would be misaligned
+        const long partial = (size - static_cast<long>(sizeof(JournalHeader))) % static_cast<long>(sizeof(JournalRecord));
+
+        if(partial != 0 && ftruncate(fileno(pFile), size - partial) != 0)
+        {
+            std::fclose(pFile);
+            return false;
+        }
+#else
+        (void)size;
+#endif
+
+        std::fseek(pFile, 0, SEEK_END);
+    }
+
+    m_config = config;
+    m_pFile = pFile;
+    m_buffer.reserve(config.groupCommitRecords);
+    m_flushing.reserve(config.groupCommitRecords);
+    m_recordsAppended = 0;
+    m_recordsCommitted.store(0, std::memory_order_relaxed);
+    m_pending = false;
+    m_stopping = false;
+    m_failed.store(false, std::memory_order_relaxed);
+
+    m_flusher = std::thread{&JournalWriter::Flush, this};
+
+    return true;
+}
+
+void JournalWriter::Close()
+{
+    if(m_pFile == nullptr)
+    {
+        return;
+    }
+
+    Commit();
+
+    {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        m_stopping = true;
+    }
+
+    m_submitted.notify_one();
+    m_flusher.join();
+
+    std::fclose(m_pFile);
+    m_pFile = nullptr;
+}
+
+bool JournalWriter::Commit()
+{
+    if(m_pFile == nullptr)
+    {
+        m_buffer.clear();
+        return false;
+    }
+
+    if(!m_buffer.empty())
+    {
+        Submit();
+    }
+
+    std::unique_lock<std::mutex> lock{m_mutex};
+    m_flushed.wait(lock, [this]() { return !m_pending; });
+
+    return !m_failed.load(std::memory_order_relaxed);
+}
+
+void JournalWriter::Submit()
+{
+    if(m_pFile == nullptr)
+    {
+        m_buffer.clear();
+        return;
+    }
+
+    {
+        std::unique_lock<std::mutex> lock{m_mutex};
+        m_flushed.wait(lock, [this]() { return !m_pending; });
+
+        // The flusher left its buffer empty, with its capacity intact
+        m_flushing.swap(m_buffer);
+        m_pending = true;
+    }
+
+    m_submitted.notify_one();
+}
+
+void JournalWriter::Flush()
+{
+    std::unique_lock<std::mutex> lock{m_mutex};
+
+    for(;;)
+    {
+        m_submitted.wait(lock, [this]() { return m_pending || m_stopping; });
+
+        if(!m_pending)
+        {
+            return;
+        }
+
+        // Nothing else touches the buffer until it is handed back
+        lock.unlock();
+
+        // Groups after one that failed are dropped rather than written,
+        // a journal with a gap in it would replay in to a different book
+        if(!m_failed.load(std::memory_order_relaxed))
+        {
+            const size_t written = std::fwrite(m_flushing.data(), sizeof(JournalRecord), m_flushing.size(), m_pFile);
+            bool committed = written == m_flushing.size() && std::fflush(m_pFile) == 0;
+
+#ifdef Linux
+            if(committed && m_config.sync == JournalSyncPolicy::OnCommit)
+            {
+                committed = fdatasync(fileno(m_pFile)) == 0;
+            }
+#endif
+
+            if(committed)
+            {
+                m_recordsCommitted.fetch_add(written, std::memory_order_release);
+            }
+            else
+            {
+                m_failed.store(true, std::memory_order_release);
+            }
+        }
+
+        m_flushing.clear();
+
+        lock.lock();
+        m_pending = false;
+        m_flushed.notify_all();
+    }
+}
+
+JournalReader::~JournalReader()
+{
+    Close();
+}
+
+bool JournalReader::Open(const std::string& path)
+{
+    Close();
+
+    std::FILE* pFile = std::fopen(path.c_str(), "rb");
+
+    if(pFile == nullptr)
+    {
+        return false;
+    }
+
+    if(!ReadHeader(pFile))
+    {
+        std::fclose(pFile);
+        return false;
+    }
+
+    m_pFile = pFile;
+    return true;
+}
+
+void JournalReader::Close()
+{
+    if(m_pFile != nullptr)
+    {
+        std::fclose(m_pFile);
+        m_pFile = nullptr;
+    }
+}
+
+bool JournalReader::Next(JournalRecord& record)
+{
+    return m_pFile != nullptr && std::fread(&record, sizeof(record), 1, m_pFile) == 1;
+}
@@ -0,0 +1,162 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "Types.h"
+
+enum class JournalRecordType : uint8_t
+{
+    Place,
+    Cancel,
+    Modify,
+    MassCancel
+};
+
+// One accepted engine input. A placement carries the ID the engine assigned
+// it so replay can reproduce IDs exactly, a cancel only needs the order ID
+// and a modify the order ID with its new price and volume. A mass cancel
+// records its owner and market. Stops triggering are not recorded, replay
+// sets them off again from the trades that did.
+// Markets are recorded by ID, so a journal must be replayed in to an engine
+// whose markets were initialised in the same order.
+struct JournalRecord
+{
+    OrderID oid{0};
+    MarketID market{InvalidMarketID};
+    OwnerID owner{NoOwner};
+    Price price{0};
+    Price stopPrice{0};
+    Quantity volume{0};
+    JournalRecordType type{JournalRecordType::Place};
+    OrderType side{OrderType::Bid};
+    TimeInForce timeInForce{TimeInForce::GoodTillCancel};
+    OrderKind kind{OrderKind::Limit};
+};
+
+static_assert(std::is_trivially_copyable<JournalRecord>::value, "JournalRecord is written out as raw bytes");
+
+// Append-only binary journal of engine inputs. Records are buffered in memory
+// and handed to a flusher thread once groupCommitRecords have accumulated,
+// which writes and syncs them while the next group fills, so the matching
+// thread only pays for a copy per input. It only waits on the disk if a group
+// fills before the one before it has been synced.
+//
+// Events are published as soon as an input is matched, before its record is
+// durable. Anything that mustn't be acknowledged until it would survive a
+// restart has to wait for GetRecordsCommitted to reach the count
+// GetRecordsAppended gave just after the input was applied.
+class JournalWriter
+{
+public:
+    JournalWriter() = default;
+    ~JournalWriter();
+
+    JournalWriter(const JournalWriter&) = delete;
+    JournalWriter& operator =(const JournalWriter&) = delete;
+
+    // Appends to any journal already at the path, returns false if it
+    // can't be opened or isn't a journal
+    bool Open(const JournalConfig& config);
+
+    // Commits anything buffered and stops the flusher before closing
+    void Close();
+
+    bool IsOpen() const
+    {
+        return m_pFile != nullptr;
+    }
+
+    // Fails once any group has failed to commit, as every record after the
+    // gap would be lost on replay anyway, until the journal is reopened
+    bool Append(const JournalRecord& record)
+    {
+        if(m_failed.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+
+        m_buffer.push_back(record);
+        ++m_recordsAppended;
+
+        if(m_buffer.size() >= m_config.groupCommitRecords)
+        {
+            Submit();
+        }
+
+        return true;
+    }
+
+    // Hands every buffered record to the flusher and waits until they have
+    // been written and synced according to the policy. Returns false if any
+    // record since the journal was opened couldn't be written.
+    bool Commit();
+
+    uint64_t GetRecordsAppended() const
+    {
+        return m_recordsAppended;
+    }
+
+    // Records written and synced, safe to read from any thread. Stops
+    // counting at the first group that fails to commit.
+    uint64_t GetRecordsCommitted() const
+    {
+        return m_recordsCommitted.load(std::memory_order_acquire);
+    }
+
+private:
+    // Swaps the buffer with the flusher's, waiting for it to finish
+    // with the last group first if it hasn't yet
+    void Submit();
+
+    void Flush();
+
+    JournalConfig m_config;
+    std::FILE* m_pFile{nullptr};
+
+    // Filled by the matching thread while the flusher writes out the other
+    std::vector<JournalRecord> m_buffer;
+    std::vector<JournalRecord> m_flushing;
+    uint64_t m_recordsAppended{0};
+
+    std::thread m_flusher;
+    std::mutex m_mutex;
+    std::condition_variable m_submitted;
+    std::condition_variable m_flushed;
+
+    // Guarded by m_mutex, m_flushing belongs to the flusher while pending
+    bool m_pending{false};
+    bool m_stopping{false};
+
+    // Set by the flusher when a group fails, only cleared by reopening
+    std::atomic<bool> m_failed{false};
+    std::atomic<uint64_t> m_recordsCommitted{0};
+};
+
+// Reads back a journal written by JournalWriter, in the order it was written
+class JournalReader
+{
+public:
+    JournalReader() = default;
+    ~JournalReader();
+
+    JournalReader(const JournalReader&) = delete;
+    JournalReader& operator =(const JournalReader&) = delete;
+
+    bool Open(const std::string& path);
+    void Close();
+
+    // Returns false at the end of the journal, a record only partly
+    // written when the writer stopped is treated as the end
+    bool Next(JournalRecord& record);
+
+private:
+    std::FILE* m_pFile{nullptr};
+};
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Records latencies with bounded relative error across their full range, in
+// the manner of an HDR histogram. Values below 2^SubBucketBits are counted
+// exactly; above that each power of two is split in to 2^SubBucketBits
+// buckets, so any value is reported to within 1% of what was recorded while
+// recording stays a shift and an increment.
+class LatencyHistogram
+{
+public:
+    LatencyHistogram()
+        : m_counts((64 - SubBucketBits + 1) * SubBucketCount, 0)
+    {
+    }
+
+    void Record(uint64_t value)
+    {
+        ++m_counts[IndexOf(value)];
+        ++m_total;
+        m_sum += value;
+        m_min = std::min(m_min, value);
+        m_max = std::max(m_max, value);
+    }
+
+    // Adds everything recorded by another histogram
+    void Merge(const LatencyHistogram& other)
+    {
+        for(size_t i = 0; i < m_counts.size(); ++i)
+        {
+            m_counts[i] += other.m_counts[i];
+        }
+
+        m_total += other.m_total;
+        m_sum += other.m_sum;
+        m_min = std::min(m_min, other.m_min);
+        m_max = std::max(m_max, other.m_max);
+    }
+
+    void Reset()
+    {
+        std::fill(m_counts.begin(), m_counts.end(), 0);
+        m_total = 0;
+        m_sum = 0;
+        m_min = UINT64_MAX;
+        m_max = 0;
+    }
+
+    uint64_t GetCount() const
+    {
+        return m_total;
+    }
+
+    uint64_t GetMin() const
+    {
+        return m_total == 0 ? 0 : m_min;
+    }
+
+    uint64_t GetMax() const
+    {
+        return m_max;
+    }
+
+    double GetMean() const
+    {
+        return m_total == 0 ? 0.0 : static_cast<double>(m_sum) / static_cast<double>(m_total);
+    }
+
+    // Smallest value at or below which the given percentage of values
+    // fall, reported as the highest value its bucket could hold
+    uint64_t GetPercentile(double percentile) const
+    {
+        if(m_total == 0)
+        {
+            return 0;
+        }
+
+        const double clamped = std::min(std::max(percentile, 0.0), 100.0);
+        const uint64_t target = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(clamped / 100.0 * static_cast<double>(m_total))));
+
+        uint64_t seen{0};
+
+        for(size_t i = 0; i < m_counts.size(); ++i)
+        {
+            seen += m_counts[i];
+
+            if(seen >= target)
+            {
+                return std::min(HighestValueOf(i), m_max);
+            }
+        }
+
+        return m_max;
+    }
+
+private:
+    static constexpr unsigned SubBucketBits{7};
+    static constexpr uint64_t SubBucketCount{uint64_t{1} << SubBucketBits};
+
+    static size_t IndexOf(uint64_t value)
+    {
+        if(value < SubBucketCount)
+        {
+            return static_cast<size_t>(value);
+        }
+
+        // Values within a power of two share a group, the top bits
+        // below the leading one pick the bucket within it
+        const unsigned magnitude = 63 - static_cast<unsigned>(__builtin_clzll(value));
+        const unsigned group = magnitude - SubBucketBits + 1;
+        const uint64_t offset = (value >> (magnitude - SubBucketBits)) - SubBucketCount;
+
+        return static_cast<size_t>(group * SubBucketCount + offset);
+    }
+
+    static uint64_t HighestValueOf(size_t index)
+    {
+        const uint64_t group = index / SubBucketCount;
+        const uint64_t offset = index % SubBucketCount;
+
+        if(group == 0)
+        {
+            return offset;
+        }
+
+        const unsigned shift = static_cast<unsigned>(group - 1);
+        return ((offset + SubBucketCount) << shift) + ((uint64_t{1} << shift) - 1);
+    }
+
+    std::vector<uint64_t> m_counts;
+
+    uint64_t m_total{0};
+    uint64_t m_sum{0};
+    uint64_t m_min{UINT64_MAX};
+    uint64_t m_max{0};
+};
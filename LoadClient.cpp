@@ -0,0 +1,438 @@
+#include "pch.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef Linux
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "LatencyHistogram.h"
+#include "MatchingEngine.h"
+#include "OrderGateway.h"
+
+// Stand-in for a strategy process entering orders through the shared memory
+// gateway. By default the gateway is hosted by a forked child around a plain
+// engine, so a single command measures the full round trip: encode, publish,
+// match, respond and decode. Either half can also be run on its own.
+
+namespace
+{
+    enum class Mode
+    {
+        Both,       // Fork a host and drive it
+        Serve,      // Only host the gateway, until a client asks it to stop
+        Client      // Only drive a gateway hosted elsewhere
+    };
+
+    struct LoadConfig
+    {
+        Mode mode{Mode::Both};
+        std::string name{"matching-engine-gateway"};
+
+        uint64_t operations{1000000};
+        uint32_t markets{1};
+        uint32_t window{64};            // Requests in flight at once
+        uint32_t depth{50};             // Price levels either side of the mid
+        double cancelRatio{0.3};
+        double modifyRatio{0.1};
+        uint64_t seed{1};
+        bool stop{true};                // Ask the host to stop once done
+    };
+
+    const char* const RequestTypeNames[] = {"place", "cancel", "modify", "mass cancel"};
+
+    constexpr size_t RequestTypeCount{4};
+    constexpr Price MidPrice{100000};
+
+    // Idle polls spent spinning before giving up the core, so a host and
+    // client sharing one core still make progress
+    constexpr uint32_t SpinsBeforeYield{1000};
+
+    void PrintUsage()
+    {
+        std::cout
+            << "Usage: LoadClient [options]\n"
+            << "  --mode both|serve|client    host a gateway, drive one, or both (default both)\n"
+            << "  --name <segment>            shared memory segment name (default matching-engine-gateway)\n"
+            << "  --operations <n>            requests to send (default 1000000)\n"
+            << "  --markets <n>               markets the flow is spread over (default 1)\n"
+            << "  --window <n>                requests in flight at once (default 64)\n"
+            << "  --depth <levels>            price levels either side of the mid (default 50)\n"
+            << "  --cancel-ratio <0..1>       share of requests that cancel (default 0.3)\n"
+            << "  --modify-ratio <0..1>       share of requests that modify (default 0.1)\n"
+            << "  --stop yes|no               stop the host once done (default yes)\n"
+            << "  --seed <n>                  flow seed (default 1)\n";
+    }
+
+    bool ParseArguments(int argc, char** argv, LoadConfig& config)
+    {
+        for(int i = 1; i < argc; ++i)
+        {
+            const std::string option{argv[i]};
+
+            if(option == "--help")
+            {
+                return false;
+            }
+
+            if(i + 1 >= argc)
+            {
+                std::cerr << "Missing value for " << option << std::endl;
+                return false;
+            }
+
+            const std::string value{argv[++i]};
+
+            if(option == "--mode")
+            {
+                if(value == "both")        config.mode = Mode::Both;
+                else if(value == "serve")  config.mode = Mode::Serve;
+                else if(value == "client") config.mode = Mode::Client;
+                else return false;
+            }
+            else if(option == "--stop")
+            {
+                if(value == "yes")         config.stop = true;
+                else if(value == "no")     config.stop = false;
+                else return false;
+            }
+            else if(option == "--name")         config.name = value;
+            else if(option == "--operations")   config.operations = std::strtoull(value.c_str(), nullptr, 10);
+            else if(option == "--markets")      config.markets = std::max<uint32_t>(1, static_cast<uint32_t>(std::strtoul(value.c_str(), nullptr, 10)));
+            else if(option == "--window")       config.window = std::max<uint32_t>(1, static_cast<uint32_t>(std::strtoul(value.c_str(), nullptr, 10)));
+            else if(option == "--depth")        config.depth = std::max<uint32_t>(1, static_cast<uint32_t>(std::strtoul(value.c_str(), nullptr, 10)));
+            else if(option == "--cancel-ratio") config.cancelRatio = std::strtod(value.c_str(), nullptr);
+            else if(option == "--modify-ratio") config.modifyRatio = std::strtod(value.c_str(), nullptr);
+            else if(option == "--seed")         config.seed = std::strtoull(value.c_str(), nullptr, 10);
+            else
+            {
+                std::cerr << "Unknown option " << option << std::endl;
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    // Runs an engine behind the gateway until a client sets the stop flag
+    int Serve(const LoadConfig& config)
+    {
+        std::vector<std::string> markets;
+
+        for(uint32_t market = 0; market < config.markets; ++market)
+        {
+            markets.push_back("MARKET-" + std::to_string(market));
+        }
+
+        MatchingEngine engine;
+        engine.InitialiseMarkets(markets);
+
+        GatewayConfig gatewayConfig;
+        gatewayConfig.name = config.name;
+        gatewayConfig.ringCapacity = std::max<uint32_t>(gatewayConfig.ringCapacity, config.window);
+
+        OrderGateway gateway;
+
+        if(!gateway.Open(gatewayConfig))
+        {
+            std::cerr << "Unable to create gateway " << config.name << std::endl;
+            return 1;
+        }
+
+        uint32_t idle{0};
+
+        while(!gateway.IsStopRequested())
+        {
+            if(gateway.Poll(engine) != 0)
+            {
+                idle = 0;
+            }
+            else if(++idle >= SpinsBeforeYield)
+            {
+                idle = 0;
+                std::this_thread::yield();
+            }
+        }
+
+        gateway.Close();
+        return 0;
+    }
+
+    bool AttachWithRetry(GatewayClient& client, const std::string& name)
+    {
+        // The host may still be creating the segment
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+
+        while(!client.Attach(name))
+        {
+            if(std::chrono::steady_clock::now() > deadline)
+            {
+                return false;
+            }
+
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+        return true;
+    }
+
+    void PrintHistogram(const char* name, const LatencyHistogram& histogram)
+    {
+        std::cout << std::left << std::setw(12) << name << std::right
+                  << std::setw(10) << histogram.GetCount()
+                  << std::setw(9) << static_cast<uint64_t>(histogram.GetMean())
+                  << std::setw(9) << histogram.GetPercentile(50.0)
+                  << std::setw(9) << histogram.GetPercentile(90.0)
+                  << std::setw(9) << histogram.GetPercentile(99.0)
+                  << std::setw(9) << histogram.GetPercentile(99.9)
+                  << std::setw(9) << histogram.GetPercentile(99.99)
+                  << std::setw(10) << histogram.GetMax()
+                  << std::endl;
+    }
+
+    // Sends the flow with at most window requests outstanding, timing each
+    // from just before it is published until its response is read back
+    int Drive(const LoadConfig& config)
+    {
+        GatewayClient client;
+
+        if(!AttachWithRetry(client, config.name))
+        {
+            std::cerr << "Unable to attach to gateway " << config.name << std::endl;
+            return 1;
+        }
+
+        std::mt19937_64 rng(config.seed);
+        std::uniform_real_distribution<double> choice(0.0, 1.0);
+        std::uniform_int_distribution<uint32_t> offset(0, config.depth * 2);
+        std::uniform_int_distribution<uint32_t> market(0, config.markets - 1);
+        std::uniform_int_distribution<Quantity> volume(1, 10);
+
+        // Orders known to rest, so cancels and modifies mostly find something
+        std::vector<OrderID> live;
+
+        using Clock = std::chrono::steady_clock;
+
+        std::vector<Clock::time_point> sentAt(config.operations);
+        LatencyHistogram histograms[RequestTypeCount];
+        uint64_t unsuccessful{0};
+
+        const auto NextRequest = [&](uint64_t correlationID)
+        {
+            GatewayRequest request;
+            request.correlationID = correlationID;
+
+            const double roll = choice(rng);
+
+            if(!live.empty() && roll < config.cancelRatio + config.modifyRatio)
+            {
+                const size_t index = rng() % live.size();
+                request.oid = live[index];
+
+                if(roll < config.cancelRatio)
+                {
+                    request.type = GatewayRequestType::Cancel;
+                    live[index] = live.back();
+                    live.pop_back();
+                }
+                else
+                {
+                    request.type = GatewayRequestType::Modify;
+                    request.price = MidPrice - config.depth + offset(rng);
+                    request.volume = volume(rng);
+                }
+
+                return request;
+            }
+
+            // Prices straddle the mid from both sides, so some cross
+            request.type = GatewayRequestType::Place;
+            request.market = market(rng);
+            request.side = rng() % 2 == 0 ? OrderType::Bid : OrderType::Ask;
+            request.price = MidPrice - config.depth + offset(rng);
+            request.volume = volume(rng);
+
+            return request;
+        };
+
+        uint64_t sent{0};
+        uint64_t received{0};
+
+        GatewayRequest pending;
+        bool hasPending{false};
+
+        uint32_t idle{0};
+
+        const auto start = Clock::now();
+
+        while(received < config.operations)
+        {
+            const uint64_t progress = sent + received;
+
+            while(sent < config.operations && sent - received < config.window)
+            {
+                if(!hasPending)
+                {
+                    pending = NextRequest(sent);
+                    hasPending = true;
+                }
+
+                sentAt[sent] = Clock::now();
+
+                if(!client.TrySend(pending))
+                {
+                    break;
+                }
+
+                hasPending = false;
+                ++sent;
+            }
+
+            GatewayResponse response;
+
+            while(client.TryReceive(response))
+            {
+                // Only ever answers to requests this run sent
+                if(response.correlationID >= sent)
+                {
+                    continue;
+                }
+
+                const auto elapsed = Clock::now() - sentAt[response.correlationID];
+                histograms[static_cast<size_t>(response.type)].Record(
+                    static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+
+                ++received;
+
+                if(response.type == GatewayRequestType::Place)
+                {
+                    if(response.result.placed == OrderPlaceEventResult::OrderPlaced)
+                    {
+                        live.push_back(response.oid);
+                    }
+                }
+                else if(response.type == GatewayRequestType::Cancel)
+                {
+                    unsuccessful += response.result.cancelled != OrderCancelEventResult::OrderCancelled ? 1 : 0;
+                }
+                else
+                {
+                    unsuccessful += response.result.modified == OrderModifyEventResult::OrderNotFound ? 1 : 0;
+                }
+            }
+
+            if(sent + received != progress)
+            {
+                idle = 0;
+            }
+            else if(++idle >= SpinsBeforeYield)
+            {
+                idle = 0;
+                std::this_thread::yield();
+            }
+        }
+
+        const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+        if(config.stop)
+        {
+            client.RequestStop();
+        }
+
+        client.Detach();
+
+        std::cout << "operations  " << received << "\n"
+                  << "not found   " << unsuccessful << "\n"
+                  << "seconds     " << std::fixed << std::setprecision(3) << seconds << "\n"
+                  << "ops/sec     " << std::setprecision(0) << (seconds > 0.0 ? received / seconds : 0.0) << "\n\n";
+
+        std::cout << std::left << std::setw(12) << "round trip" << std::right
+                  << std::setw(10) << "count"
+                  << std::setw(9) << "mean"
+                  << std::setw(9) << "p50"
+                  << std::setw(9) << "p90"
+                  << std::setw(9) << "p99"
+                  << std::setw(9) << "p99.9"
+                  << std::setw(9) << "p99.99"
+                  << std::setw(10) << "max"
+                  << std::endl;
+
+        LatencyHistogram all;
+
+        for(size_t type = 0; type < RequestTypeCount; ++type)
+        {
+            if(histograms[type].GetCount() > 0)
+            {
+                PrintHistogram(RequestTypeNames[type], histograms[type]);
+                all.Merge(histograms[type]);
+            }
+        }
+
+        PrintHistogram("all", all);
+
+        return 0;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    LoadConfig config;
+
+    if(!ParseArguments(argc, argv, config))
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    if(config.mode == Mode::Serve)
+    {
+        return Serve(config);
+    }
+
+    if(config.mode == Mode::Client)
+    {
+        return Drive(config);
+    }
+
+#ifdef Linux
+    const pid_t host = fork();
+
+    if(host < 0)
+    {
+        std::cerr << "Unable to start the gateway host" << std::endl;
+        return 1;
+    }
+
+    if(host == 0)
+    {
+        _exit(Serve(config));
+    }
+
+    // The host only stops when asked, so make sure it is
+    config.stop = true;
+    const int result = Drive(config);
+
+    if(result != 0)
+    {
+        kill(host, SIGTERM);
+    }
+
+    int status{0};
+    waitpid(host, &status, 0);
+
+    return result;
+#else
+    std::cerr << "Hosting the gateway needs Linux, run with --mode serve or client" << std::endl;
+    return 1;
+#endif
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+// Bounded lock-free queue for any number of producers and a single consumer.
+// Each cell carries a sequence number that tells producers and the consumer
+// whose turn it is to use it, so neither side ever takes a lock.
+template<typename T>
+class MPSCQueue
+{
+public:
+    explicit MPSCQueue(size_t capacity)
+        : m_mask(RoundUpToPowerOfTwo(capacity) - 1)
+        , m_cells(new Cell[m_mask + 1])
+    {
+        for(size_t i = 0; i <= m_mask; ++i)
+        {
+            m_cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    MPSCQueue(const MPSCQueue&) = delete;
+    MPSCQueue& operator =(const MPSCQueue&) = delete;
+
+    // Safe to call from any thread, fails when the queue is full
+    bool TryPush(T&& value)
+    {
+        size_t position = m_enqueuePosition.load(std::memory_order_relaxed);
+        Cell* cell;
+
+        for(;;)
+        {
+            cell = &m_cells[position & m_mask];
+            const size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            const intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+
+            if(difference == 0)
+            {
+                if(m_enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                {
+                    break;
+                }
+            }
+            else if(difference < 0)
+            {
+                return false;
+            }
+            else
+            {
+                position = m_enqueuePosition.load(std::memory_order_relaxed);
+            }
+        }
+
+        cell->value = std::move(value);
+        cell->sequence.store(position + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    // Only ever called from the consuming thread
+    bool TryPop(T& value)
+    {
+        Cell& cell = m_cells[m_dequeuePosition & m_mask];
+        const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+
+        if(sequence != m_dequeuePosition + 1)
+        {
+            return false;
+        }
+
+        value = std::move(cell.value);
+        cell.sequence.store(m_dequeuePosition + m_mask + 1, std::memory_order_release);
+        ++m_dequeuePosition;
+
+        return true;
+    }
+
+private:
+    struct Cell
+    {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    static size_t RoundUpToPowerOfTwo(size_t value)
+    {
+        size_t result{2};
+
+        while(result < value)
+        {
+            result <<= 1;
+        }
+
+        return result;
+    }
+
+    const size_t m_mask;
+    const std::unique_ptr<Cell[]> m_cells;
+
+    // Kept on separate cache lines so producers and the consumer don't contend
+    alignas(64) std::atomic<size_t> m_enqueuePosition{0};
+    alignas(64) size_t m_dequeuePosition{0};
+};
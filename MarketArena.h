@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <memory_resource>
+
+// Memory for the price levels of one market. An optional block reserved up
+// front from the engine's resource backs a pool which recycles freed level
+// nodes by size, so once a market has seen its working set of levels adding
+// and removing levels is served entirely from the pool. Anything beyond the
+// reserved block is drawn from the engine's resource as the pool grows.
+//
+// A market is only ever touched from the thread matching it, so the pool
+// takes no locks.
+class MarketArena
+{
+public:
+    MarketArena(size_t reservedBytes, std::pmr::memory_resource* pUpstream)
+        : m_pUpstream(pUpstream)
+        , m_reservedBytes(reservedBytes)
+        , m_pReserved(reservedBytes == 0 ? nullptr : pUpstream->allocate(reservedBytes))
+        , m_reserved(m_pReserved, m_reservedBytes, pUpstream)
+        , m_pool(&m_reserved)
+    {
+    }
+
+    ~MarketArena()
+    {
+        m_pool.release();
+        m_reserved.release();
+
+        if(m_pReserved != nullptr)
+        {
+            m_pUpstream->deallocate(m_pReserved, m_reservedBytes);
+        }
+    }
+
+    MarketArena(const MarketArena&) = delete;
+    MarketArena& operator =(const MarketArena&) = delete;
+
+    std::pmr::memory_resource* GetResource()
+    {
+        return &m_pool;
+    }
+
+private:
+    std::pmr::memory_resource* const m_pUpstream;
+    const size_t m_reservedBytes;
+    void* const m_pReserved;
+
+    std::pmr::monotonic_buffer_resource m_reserved;
+    std::pmr::unsynchronized_pool_resource m_pool;
+};
@@ -1,56 +1,321 @@
 #pragma once
 
+#include <initializer_list>
+#include <memory_resource>
+#include <tuple>
+#include <unordered_map>
 #include <vector>
 
 #include "EngineInterfaces.h"
+#include "EventSinks.h"
+#include "Instrumentation.h"
+#include "Journal.h"
+#include "ObjectPool.h"
+#include "OrderIndex.h"
+#include "OrderBook.h"
+#include "Snapshot.h"
 
-class MatchingEngine : public IEngineEvents
+// The engine reports everything that happens to each of its event sinks in
+// turn. Sinks are fixed at compile time so notifications made from inside
+// the matching loop are direct calls rather than virtual dispatch.
+template<typename... Sinks>
+class BasicMatchingEngine : public IEngineEvents
 {
 public:
-    MatchingEngine() = default;
-    virtual ~MatchingEngine() = default;
+    BasicMatchingEngine();
+    explicit BasicMatchingEngine(const EngineConfig& config);
+    virtual ~BasicMatchingEngine() = default;
 
-    MatchingEngine(const MatchingEngine&) = delete;
-    MatchingEngine(MatchingEngine&&) = delete;
-    MatchingEngine& operator =(const MatchingEngine&) = delete;
+    BasicMatchingEngine(const BasicMatchingEngine&) = delete;
+    BasicMatchingEngine(BasicMatchingEngine&&) = delete;
+    BasicMatchingEngine& operator =(const BasicMatchingEngine&) = delete;
 
-    void InitialiseMarkets(const std::vector<std::string>& markets);
+    // Returns the handle of each market, in the order given
+    std::vector<MarketID> InitialiseMarkets(std::initializer_list<std::string> markets);
+    std::vector<MarketID> InitialiseMarkets(const std::vector<std::string>& markets);
+    std::vector<MarketID> InitialiseMarkets(const std::vector<MarketConfig>& markets);
 
-    void RegisterEventObserver(IExchangeEvents* pObserver);
+    MarketID GetMarketID(const std::string& market) const;
+    const std::string& GetMarketName(MarketID market) const;
+
+    TopOfBook GetTopOfBook(MarketID market) const;
+
+    // ID the next accepted order will be given
+    OrderID GetNextOrderID() const
+    {
+        return m_nextOrderID;
+    }
+
+    // Sets the limits the owner's placements and amendments are checked
+    // against before they reach the book. The exposure returned stays valid
+    // for the life of the engine and may be read from any thread.
+    const RiskExposure& SetRiskLimits(OwnerID owner, const RiskLimits& limits);
+
+    // Null for an owner that has never had an order or any limits
+    const RiskExposure* GetRiskExposure(OwnerID owner) const;
+
+    // Fills levels with up to maxLevels aggregated levels of one side of a
+    // market, best first, returning how many were written
+    size_t GetDepth(MarketID market, OrderType side, DepthLevel* levels, size_t maxLevels) const;
+
+    // Every accepted placement and cancel is appended to the journal before it
+    // is applied. The journal is not owned and is only written out in the
+    // background as it fills, callers commit it themselves or wait for its
+    // records to be committed according to their own durability needs.
+    void AttachJournal(JournalWriter* pJournal);
+
+    // Rebuilds the books and order IDs from a journal with every sink muted,
+    // applying the inputs exactly as they were first matched. Returns the
+    // number of records replayed.
+    uint64_t Replay(JournalReader& journal);
+
+    // Applies a single journal record the way Replay does, but with every
+    // sink notified, for backtests that want the events replay produces
+    void Apply(const JournalRecord& record);
+
+    // Writes every resting order and the next order ID to a snapshot file.
+    // Run through a SnapshotProcess to take it without pausing matching.
+    bool WriteSnapshot(const std::string& path) const;
+
+    // Restores a snapshot in to an engine holding no orders, with its markets
+    // initialised as they were when the snapshot was taken. Orders are placed
+    // directly at their levels without matching or notifying any sink.
+    bool LoadSnapshot(const std::string& path);
+
+#ifdef MATCHING_ENGINE_INSTRUMENTATION
+    // Per stage timings and counters, only read from the engine's own thread
+    const EngineInstrumentation& GetInstrumentation() const
+    {
+        return m_instrumentation;
+    }
+
+    void ResetInstrumentation()
+    {
+        m_instrumentation.Reset();
+    }
+#endif
+
+    template<typename Sink>
+    Sink& GetSink()
+    {
+        return std::get<Sink>(m_sinks);
+    }
 
     //
     // IEngineEvents implementation
     //
 
     virtual OrderPlaceEventResult OnOrderPlace(Order&& o) override final;
+    virtual OrderPlaceEventResult OnOrderPlace(MarketID market, Order&& o) override final;
     virtual OrderCancelEventResult OnOrderCancel(OrderID oid) override final;
+    virtual OrderModifyEventResult OnOrderModify(OrderID oid, Price price, Quantity volume) override final;
+    virtual OrderCancelEventResult OnMassCancel(OwnerID owner, MarketID market = InvalidMarketID) override final;
+
+    // Handles a burst of placements and cancels in sequence, writing the
+    // outcome of each request to the matching entry of results. Runs of
+    // placements on the same market share a single market lookup.
+    void OnOrderBatch(OrderRequest* requests, size_t count, OrderRequestResult* results);
 
 private:
 
-    using OrderBookOrdersAtPosition = std::map<OrderID, NumericType>;
-    using OrderBookPosition = std::map<NumericType, OrderBookOrdersAtPosition>;
+    // Markets are held densely, indexed by their ID
+    using Markets = std::pmr::vector<Market>;
+    using MarketLookup = std::unordered_map<std::string, MarketID>;
+
+    using OrderLookup = OrderIndex<OrderNode>;
+    using AccountLookup = std::pmr::unordered_map<OwnerID, Account>;
+
+    // A stop order waiting in its market's trigger index
+    struct PendingStop
+    {
+        Order order;
+        StopIndex::Orders::iterator position;
+    };
 
-    // Each market consists of positions of bids and asks stored individually 
-    using Market = std::pair<OrderBookPosition, OrderBookPosition>;
-    using Markets = std::unordered_map<std::string, Market>;
+    using StopLookup = std::pmr::unordered_map<OrderID, PendingStop>;
 
-    using OrderLookup = std::map<OrderID, OrderBookOrdersAtPosition*>;
+    OrderPlaceEventResult HandleOrderBookUpdate(Market& market, Order&& o);
 
-    OrderPlaceEventResult HandleOrderBookUpdate(Order&& o);
+    template<typename Book>
+    OrderPlaceEventResult PlaceOrder(Market& market, Book& book, const Order& o);
+
+    // Matches an order that has been given its ID, resting whatever remains
+    // of it if it is allowed to
+    template<typename Book>
+    OrderPlaceEventResult MatchOrder(Market& market, Book& book, OrderID oid, const Order& o, Tick tick);
+
+    void JournalPlacement(OrderID oid, const Order& o);
+
+    // Holds a stop in its market's trigger index, away from the book
+    OrderPlaceEventResult PlaceStop(Market& market, const Order& o);
+
+    // Sets off every stop the market's last trade has reached, a batch at a
+    // time, until the trades of the stops themselves reach no more
+    void TriggerStops(Market& market);
+
+    bool CancelStop(OrderID oid);
+
+    // Takes the stops of an owner, or of everyone, out of one or every market
+    void CancelStops(OwnerID owner, MarketID market);
+
+    // Pre-trade checks against the limits of the order's owner
+    bool PassesRisk(const Market& market, const Order& o);
+
+    // Whether the order fits within the account's limits, once it has taken
+    // the place of the open order being amended if there is one
+    bool WithinRiskLimits(const Market& market, const Account& account, const Order& o, const OrderNode* pAmended) const;
+
+    uint64_t NotionalOf(const OrderNode* pNode) const;
+
+    void ApplyRecord(const JournalRecord& record);
 
     bool HandleOrderBookCancel(OrderID o);
-    bool TickOrderBook(const std::string& marketName, Market& market);
+    uint64_t HandleMassCancel(OwnerID owner, MarketID market);
+    OrderModifyEventResult HandleOrderBookModify(OrderID oid, Price price, Quantity volume);
+
+    // Takes an order out of its level and puts it at the back of the queue at
+    // its new tick, matching it first if the move takes it through the touch
+    template<typename Side, typename Opposite>
+    OrderModifyEventResult MoveOrder(Market& market, Side& side, Opposite& opposite, OrderNode* pNode, Tick tick, Quantity volume);
+
+    template<typename Side>
+    void RestOrder(Side& side, OrderID oid, const Order& o, Tick tick, Quantity volume);
+
+    // Adds a resting order to its owner's account
+    void LinkOwner(OrderNode* pNode, OwnerID owner);
+
+    // Takes a resting order out of its level, removing the level once empty
+    void RemoveOrder(Market& market, OrderNode* pNode);
+
+    // Forgets an order that has left the book and returns it to the pool
+    void ReleaseOrder(OrderNode* pNode);
+
+    // Empties one side of a market level by level, for a market wide mass cancel
+    template<typename Side>
+    void CancelSide(const Market& market, MarketID marketID, Side& side, OrderType type);
+
+    // Whether the levels of the opposite side the order crosses hold
+    // enough volume between them to fill it completely
+    template<typename Side>
+    bool CanFill(const Side& opposite, const Order& o, Tick tick) const;
+
+    // What is left of an aggressor once it has walked the opposite side
+    struct MatchOutcome
+    {
+        Quantity remaining{0};
+        Quantity filled{0};
+        bool cancelled{false};      // Taken out by self-trade prevention
+    };
+
+    // Chooses the market's matching policy once per aggressor, so each
+    // policy walks the opposite side through an instantiation of its own
+    template<typename Side>
+    MatchOutcome MatchAggressor(Market& market, Side& opposite, OrderID oid, const Order& o, Tick tick);
+
+    template<MatchingPolicy Policy, typename Side>
+    MatchOutcome MatchWithPolicy(Market& market, Side& opposite, OrderID oid, const Order& o, Tick tick);
+
+    // Fills the orders at a level in time priority until the aggressor has
+    // no more than floor left, or the level is used up
+    void MatchInTimeOrder(Market& market, PriceLevel& position, Price price, OrderID oid, const Order& o, MatchOutcome& outcome, Quantity floor);
+
+    // Shares what is left of the aggressor between the orders of a level
+    // holding more than it, in proportion to their volume
+    void MatchProRata(Market& market, PriceLevel& position, Price price, OrderID oid, const Order& o, MatchOutcome& outcome);
+
+    // Grows the pro-rata allocations as orders join a level, so that
+    // matching never has to
+    void ReserveAllocations(const Market& market, const PriceLevel& level);
+
+    // Trades volume of the aggressor against one resting order, taking
+    // the resting order out of its level if that uses it up
+    void FillResting(Market& market, PriceLevel& position, OrderNode* pResting, Price price, OrderID oid, const Order& o, MatchOutcome& outcome, Quantity volume);
+
+    // Applies the market's self-trade prevention to an aggressor meeting a
+    // resting order of its own owner, returning whether the aggressor is
+    // taken out. Otherwise remaining is left holding what is left of it.
+    bool PreventSelfTrade(const Market& market, PriceLevel& position, OrderNode* pResting, Quantity& remaining);
+
+    // Takes the resting order at the front of a level out of the book,
+    // leaving the level itself for the matching loop to deal with
+    void CancelResting(PriceLevel& position, OrderNode* pResting);
+
+    // Collects the final state of each level an input changes, published
+    // together once the input has been handled
+    void RecordDepthChange(MarketID market, OrderType side, Price price, const PriceLevel& level);
+    void PublishDepthUpdates();
 
     void NotifyOrderBookEventObservers(OrderID oid, const Order& mo);
     void NotifyMatchingEventObservers(const MatchedOrder& mo);
     void NotifyCancelEventObservers(OrderID o);
+    void NotifyMassCancelEventObservers();
+    void NotifyModifyEventObservers(const ModifiedOrder& mo);
+    void NotifyStopTriggeredEventObservers(OrderID oid, const Order& o);
 
     OrderID m_nextOrderID{ 0 };
 
-    std::vector<IExchangeEvents*> m_eventObservers;
+    std::tuple<Sinks...> m_sinks;
+
+    // Set while replaying so that sinks don't see the same events twice
+    bool m_muted{false};
+
+    // Set while applying journal records, which were checked against
+    // risk limits when they were first accepted
+    bool m_replaying{false};
+
+    JournalWriter* m_pJournal{nullptr};
+
+    // Everything the engine allocates comes from here, markets layer
+    // an arena of their own over it for their price levels
+    std::pmr::memory_resource* const m_pMemory;
+
+    std::pmr::vector<DepthUpdate> m_depthUpdates;
     
+    // Storage for every resting order
+    ObjectPool<OrderNode> m_orderPool;
+
     // Non-owning collection for fast order ID lookups
     OrderLookup m_orderLookup;
 
+    // Resting orders and risk state of each owner, held in place
+    // so orders and readers of exposure can point straight at them
+    AccountLookup m_accounts;
+
+    // Orders taken out by the mass cancel being handled
+    std::pmr::vector<OrderID> m_cancelledOrders;
+
+    // Volume of each order at the level being allocated pro-rata, in lots.
+    // Always holds at least as many entries as the largest level of any
+    // market that doesn't match in time priority alone.
+    std::pmr::vector<Quantity> m_allocations;
+
+    // Stop orders of every market waiting for their trigger
+    StopLookup m_stopOrders;
+
+    // Stops set off by the pass of TriggerStops being handled
+    std::pmr::vector<OrderID> m_triggeredStops;
+
     Markets m_markets;
-};
\ No newline at end of file
+    MarketLookup m_marketLookup;
+
+#ifdef MATCHING_ENGINE_INSTRUMENTATION
+    EngineInstrumentation m_instrumentation;
+#endif
+};
+
+#include "MatchingEngine.inl"
+
+// Instantiated once in MatchingEngine.cpp
+extern template class BasicMatchingEngine<ExchangeEventObservers>;
+
+// Engine reporting to IExchangeEvents observers registered at runtime
+class MatchingEngine final : public BasicMatchingEngine<ExchangeEventObservers>
+{
+public:
+    using BasicMatchingEngine::BasicMatchingEngine;
+
+    void RegisterEventObserver(IExchangeEvents* pObserver)
+    {
+        GetSink<ExchangeEventObservers>().Register(pObserver);
+    }
+};
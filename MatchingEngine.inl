@@ -0,0 +1,1988 @@
+#pragma once
+
+#include <algorithm>
+
+// Definitions for BasicMatchingEngine, included from MatchingEngine.h
+
+template<typename... Sinks>
+BasicMatchingEngine<Sinks...>::BasicMatchingEngine()
+    : BasicMatchingEngine(EngineConfig{})
+{
+}
+
+template<typename... Sinks>
+BasicMatchingEngine<Sinks...>::BasicMatchingEngine(const EngineConfig& config)
+    : m_nextOrderID{OrderID{config.shard} << OrderIDShardShift}
+    , m_pMemory{config.memoryResource ? config.memoryResource : std::pmr::new_delete_resource()}
+    , m_depthUpdates{m_pMemory}
+    , m_orderPool{4096, m_pMemory}
+    , m_orderLookup{config.reservedOrders, m_nextOrderID, m_pMemory}
+    , m_accounts{m_pMemory}
+    , m_cancelledOrders{m_pMemory}
+    , m_allocations{m_pMemory}
+    , m_stopOrders{m_pMemory}
+    , m_triggeredStops{m_pMemory}
+    , m_markets{m_pMemory}
+{
+    m_orderPool.Reserve(config.reservedOrders);
+
+    // An input rarely touches more than a handful of levels
+    m_depthUpdates.reserve(64);
+    m_cancelledOrders.reserve(64);
+    m_triggeredStops.reserve(64);
+    m_allocations.resize(64);
+}
+
+template<typename... Sinks>
+std::vector<MarketID> BasicMatchingEngine<Sinks...>::InitialiseMarkets(std::initializer_list<std::string> markets)
+{
+    return InitialiseMarkets(std::vector<std::string>{markets});
+}
+
+template<typename... Sinks>
+std::vector<MarketID> BasicMatchingEngine<Sinks...>::InitialiseMarkets(const std::vector<std::string>& markets)
+{
+    std::vector<MarketConfig> configs;
+    configs.reserve(markets.size());
+
+    for(const auto& market : markets)
+    {
+        configs.push_back(MarketConfig{market});
+    }
+
+    return InitialiseMarkets(configs);
+}
+
+template<typename... Sinks>
+std::vector<MarketID> BasicMatchingEngine<Sinks...>::InitialiseMarkets(const std::vector<MarketConfig>& markets)
+{
+    std::vector<MarketID> marketIDs;
+    marketIDs.reserve(markets.size());
+    m_markets.reserve(m_markets.size() + markets.size());
+
+    for(const auto& config : markets)
+    {
+        const MarketID marketID = static_cast<MarketID>(m_markets.size());
+        const auto [it, inserted] = m_marketLookup.try_emplace(config.name, marketID);
+
+        if(inserted)
+        {
+            if(config.layout == PriceLevelLayout::Ladder)
+            {
+                m_markets.emplace_back(std::in_place_type<OrderBook<PriceLadder>>, config, m_pMemory);
+            }
+            else
+            {
+                m_markets.emplace_back(std::in_place_type<OrderBook<PriceMap>>, config, m_pMemory);
+            }
+        }
+
+        marketIDs.push_back(it->second);
+    }
+
+    return marketIDs;
+}
+
+template<typename... Sinks>
+MarketID BasicMatchingEngine<Sinks...>::GetMarketID(const std::string& market) const
+{
+    const typename MarketLookup::const_iterator it = m_marketLookup.find(market);
+    return it == m_marketLookup.end() ? InvalidMarketID : it->second;
+}
+
+template<typename... Sinks>
+const std::string& BasicMatchingEngine<Sinks...>::GetMarketName(MarketID market) const
+{
+    static const std::string unknown;
+    return market < m_markets.size() ? m_markets[market].name : unknown;
+}
+
+template<typename... Sinks>
+TopOfBook BasicMatchingEngine<Sinks...>::GetTopOfBook(MarketID market) const
+{
+    if(market >= m_markets.size())
+    {
+        return TopOfBook{};
+    }
+
+    const Market& entry = m_markets[market];
+
+    return std::visit([&entry](const auto& book)
+    {
+        return TopOfBook
+        {
+            book.bids.Empty() ? 0 : entry.ToPrice(book.bids.BestTick()),
+            book.asks.Empty() ? 0 : entry.ToPrice(book.asks.BestTick())
+        };
+    }, entry.book);
+}
+
+template<typename... Sinks>
+const RiskExposure& BasicMatchingEngine<Sinks...>::SetRiskLimits(OwnerID owner, const RiskLimits& limits)
+{
+    Account& account = m_accounts.try_emplace(owner).first->second;
+    account.limits = limits;
+
+    return account.exposure;
+}
+
+template<typename... Sinks>
+const RiskExposure* BasicMatchingEngine<Sinks...>::GetRiskExposure(OwnerID owner) const
+{
+    const typename AccountLookup::const_iterator it = m_accounts.find(owner);
+    return it == m_accounts.end() ? nullptr : &it->second.exposure;
+}
+
+template<typename... Sinks>
+size_t BasicMatchingEngine<Sinks...>::GetDepth(MarketID market, OrderType side, DepthLevel* levels, size_t maxLevels) const
+{
+    if(market >= m_markets.size() || maxLevels == 0)
+    {
+        return 0;
+    }
+
+    size_t count{0};
+
+    const Market& entry = m_markets[market];
+
+    const auto AddLevel = [levels, maxLevels, &count, &entry](Tick tick, const PriceLevel& level)
+    {
+        levels[count++] = DepthLevel{entry.ToPrice(tick), level.volume, level.orderCount};
+        return count < maxLevels;
+    };
+
+    std::visit([side, &AddLevel](const auto& book)
+    {
+        if(side == OrderType::Bid)
+        {
+            book.bids.ForEachLevel(AddLevel);
+        }
+        else
+        {
+            book.asks.ForEachLevel(AddLevel);
+        }
+    }, m_markets[market].book);
+
+    return count;
+}
+
+template<typename... Sinks>
+void BasicMatchingEngine<Sinks...>::AttachJournal(JournalWriter* pJournal)
+{
+    m_pJournal = pJournal;
+}
+
+template<typename... Sinks>
+uint64_t BasicMatchingEngine<Sinks...>::Replay(JournalReader& journal)
+{
+    // Replayed inputs are already in the journal
+    JournalWriter* pJournal = m_pJournal;
+    m_pJournal = nullptr;
+    m_muted = true;
+    m_replaying = true;
+
+    uint64_t replayed{0};
+    JournalRecord record;
+
+    while(journal.Next(record))
+    {
+        ApplyRecord(record);
+        ++replayed;
+    }
+
+    m_replaying = false;
+    m_muted = false;
+    m_pJournal = pJournal;
+
+    return replayed;
+}
+
+template<typename... Sinks>
+void BasicMatchingEngine<Sinks...>::Apply(const JournalRecord& record)
+{
+    JournalWriter* pJournal = m_pJournal;
+    m_pJournal = nullptr;
+    m_replaying = true;
+
+    ApplyRecord(record);
+    PublishDepthUpdates();
+
+    m_replaying = false;
+    m_pJournal = pJournal;
+}
+
+template<typename... Sinks>
+void BasicMatchingEngine<Sinks...>::ApplyRecord(const JournalRecord& record)
+{
+    if(record.type == JournalRecordType::Cancel)
+    {
+        HandleOrderBookCancel(record.oid);
+    }
+    else if(record.type == JournalRecordType::Modify)
+    {
+        HandleOrderBookModify(record.oid, record.price, record.volume);
+    }
+    else if(record.type == JournalRecordType::MassCancel)
+    {
+        HandleMassCancel(record.owner, record.market);
+    }
+    else if(record.market < m_markets.size())
+    {
+        Order o;
+        o.marketID = record.market;
+        o.price = record.price;
+        o.volume = record.volume;
+        o.type = record.side;
+        o.timeInForce = record.timeInForce;
+        o.kind = record.kind;
+        o.owner = record.owner;
+        o.stopPrice = record.stopPrice;
+
+        // Placements take the ID they were first given
+        m_nextOrderID = record.oid;
+
+        Market& market = m_markets[record.market];
+
+        std::visit([this, &market, &o](auto& book)
+        {
+            PlaceOrder(market, book, o);
+        }, market.book);
+    }
+}
+
+template<typename... Sinks>
+bool BasicMatchingEngine<Sinks...>::WriteSnapshot(const std::string& path) const
+{
+    SnapshotImage image;
+    image.header.marketCount = static_cast<uint32_t>(m_markets.size());
+    image.header.nextOrderID = m_nextOrderID;
+    image.markets.reserve(m_markets.size());
+
+    for(const Market& market : m_markets)
+    {
+        SnapshotMarket& entry = image.markets.emplace_back();
+        entry.lastTradePrice = market.lastTradePrice;
+
+        const auto AddLevel = [&image, &market](Tick tick, const PriceLevel& level)
+        {
+            SnapshotLevel& levelEntry = image.levels.emplace_back();
+            levelEntry.price = market.ToPrice(tick);
+
+            for(const OrderNode* pNode = level.orders.Front(); pNode != nullptr; pNode = OrderQueue::Next(pNode))
+            {
+                SnapshotOrder& orderEntry = image.orders.emplace_back();
+                orderEntry.id = pNode->id;
+                orderEntry.volume = pNode->volume;
+                orderEntry.owner = pNode->owner;
+                ++levelEntry.orderCount;
+            }
+
+            return true;
+        };
+
+        std::visit([&](const auto& book)
+        {
+            const size_t levels = image.levels.size();
+            book.bids.ForEachLevel(AddLevel);
+            entry.bidLevels = static_cast<uint32_t>(image.levels.size() - levels);
+            book.asks.ForEachLevel(AddLevel);
+            entry.askLevels = static_cast<uint32_t>(image.levels.size() - levels) - entry.bidLevels;
+        }, market.book);
+    }
+
+    // Stops of each market in the order they would be set off on each side
+    for(const Market& market : m_markets)
+    {
+        for(const StopIndex::Orders* pOrders : {&market.stops.buys, &market.stops.sells})
+        {
+            for(const auto& [stopPrice, oid] : *pOrders)
+            {
+                const Order& o = m_stopOrders.find(oid)->second.order;
+
+                SnapshotStop& stopEntry = image.stops.emplace_back();
+                stopEntry.id = oid;
+                stopEntry.price = o.price;
+                stopEntry.stopPrice = stopPrice;
+                stopEntry.volume = o.volume;
+                stopEntry.market = o.marketID;
+                stopEntry.owner = o.owner;
+                stopEntry.side = o.type;
+                stopEntry.timeInForce = o.timeInForce;
+                stopEntry.kind = o.kind;
+            }
+        }
+    }
+
+    image.header.levelCount = image.levels.size();
+    image.header.orderCount = image.orders.size();
+    image.header.stopCount = image.stops.size();
+
+    return WriteSnapshotFile(path, image);
+}
+
+template<typename... Sinks>
+bool BasicMatchingEngine<Sinks...>::LoadSnapshot(const std::string& path)
+{
+    SnapshotFile snapshot;
+
+    if(!snapshot.Open(path))
+    {
+        return false;
+    }
+
+    const SnapshotHeader& header = snapshot.GetHeader();
+
+    if(header.marketCount != m_markets.size() || header.nextOrderID < m_nextOrderID || !m_stopOrders.empty())
+    {
+        return false;
+    }
+
+    for(const Market& market : m_markets)
+    {
+        const bool empty = std::visit([](const auto& book)
+        {
+            return book.bids.Empty() && book.asks.Empty();
+        }, market.book);
+
+        if(!empty)
+        {
+            return false;
+        }
+    }
+
+    // Check the sections agree with each other before touching any book
+    const SnapshotMarket* pMarkets = snapshot.GetMarkets();
+    const SnapshotLevel* pLevels = snapshot.GetLevels();
+    const SnapshotOrder* pOrders = snapshot.GetOrders();
+
+    uint64_t levelCount{0};
+    uint64_t orderCount{0};
+
+    for(uint32_t market = 0; market < header.marketCount; ++market)
+    {
+        levelCount += uint64_t{pMarkets[market].bidLevels} + pMarkets[market].askLevels;
+    }
+
+    if(levelCount != header.levelCount)
+    {
+        return false;
+    }
+
+    // Every level has to sit on a tick of the market it is restored in to and
+    // hold at least one order, each sized in whole lots. Each side runs best
+    // first, so bids have to fall and asks rise, which also keeps a price from
+    // appearing twice, and the best bid has to be below the best ask as
+    // matching never leaves a book crossed.
+    uint64_t level{0};
+
+    for(uint32_t market = 0; market < header.marketCount; ++market)
+    {
+        const Market& target = m_markets[market];
+        const uint64_t bids = level;
+        const uint64_t asks = bids + pMarkets[market].bidLevels;
+        const uint64_t end = asks + pMarkets[market].askLevels;
+
+        if(pMarkets[market].lastTradePrice % target.tickSize != 0)
+        {
+            return false;
+        }
+
+        if(bids != asks && asks != end && pLevels[bids].price >= pLevels[asks].price)
+        {
+            return false;
+        }
+
+        for(; level < end; ++level)
+        {
+            const SnapshotLevel& entry = pLevels[level];
+
+            if(!target.IsOnTick(entry.price) || entry.orderCount == 0 || entry.orderCount > header.orderCount - orderCount)
+            {
+                return false;
+            }
+
+            if(level != bids && level != asks
+                && (level < asks ? entry.price >= pLevels[level - 1].price : entry.price <= pLevels[level - 1].price))
+            {
+                return false;
+            }
+
+            for(uint64_t order = orderCount; order < orderCount + entry.orderCount; ++order)
+            {
+                if(!target.IsWholeLots(pOrders[order].volume))
+                {
+                    return false;
+                }
+            }
+
+            orderCount += entry.orderCount;
+        }
+    }
+
+    if(orderCount != header.orderCount)
+    {
+        return false;
+    }
+
+    // IDs have to be unique across resting orders and stops as well as in
+    // range, or one would take another's place in the lookup
+    std::pmr::vector<OrderID> ids{m_pMemory};
+    ids.reserve(static_cast<size_t>(orderCount + header.stopCount));
+
+    for(uint64_t order = 0; order < orderCount; ++order)
+    {
+        if(pOrders[order].id < m_nextOrderID || pOrders[order].id >= header.nextOrderID)
+        {
+            return false;
+        }
+
+        ids.push_back(pOrders[order].id);
+    }
+
+    const SnapshotStop* pStops = snapshot.GetStops();
+
+    for(uint64_t stop = 0; stop < header.stopCount; ++stop)
+    {
+        const SnapshotStop& entry = pStops[stop];
+        Order o;
+        o.price = entry.price;
+        o.volume = entry.volume;
+        o.kind = entry.kind;
+        o.stopPrice = entry.stopPrice;
+
+        if(    entry.id < m_nextOrderID || entry.id >= header.nextOrderID
+            || entry.market >= m_markets.size() || !IsStop(entry.kind)
+            || !m_markets[entry.market].Accepts(o))
+        {
+            return false;
+        }
+
+        ids.push_back(entry.id);
+    }
+
+    std::sort(ids.begin(), ids.end());
+
+    if(std::adjacent_find(ids.begin(), ids.end()) != ids.end())
+    {
+        return false;
+    }
+
+    m_orderPool.Reserve(static_cast<size_t>(orderCount));
+
+    const auto RestoreSide = [&](auto& side, OrderType type, MarketID market, uint32_t levels)
+    {
+        for(uint32_t i = 0; i < levels; ++i, ++pLevels)
+        {
+            // Levels are restored best first, so a ladder centres its
+            // window on the touch and every later level is passive
+            const Tick tick = m_markets[market].ToTick(pLevels->price);
+            PriceLevel& level = side.FindOrInsert(tick);
+
+            for(uint32_t j = 0; j < pLevels->orderCount; ++j, ++pOrders)
+            {
+                OrderNode* pNode = m_orderPool.Acquire();
+                pNode->id = pOrders->id;
+                pNode->market = market;
+                pNode->tick = tick;
+                pNode->volume = pOrders->volume;
+                pNode->type = type;
+                pNode->level = &level;
+
+                level.orders.PushBack(pNode);
+                level.volume += pNode->volume;
+                ++level.orderCount;
+                m_orderLookup.Insert(pNode->id, pNode);
+                LinkOwner(pNode, pOrders->owner);
+            }
+
+            ReserveAllocations(m_markets[market], level);
+        }
+    };
+
+    for(MarketID market = 0; market < header.marketCount; ++market)
+    {
+        std::visit([&](auto& book)
+        {
+            RestoreSide(book.bids, OrderType::Bid, market, pMarkets[market].bidLevels);
+            RestoreSide(book.asks, OrderType::Ask, market, pMarkets[market].askLevels);
+        }, m_markets[market].book);
+
+        m_markets[market].lastTradePrice = pMarkets[market].lastTradePrice;
+    }
+
+    for(uint64_t stop = 0; stop < header.stopCount; ++stop, ++pStops)
+    {
+        PendingStop& pending = m_stopOrders.try_emplace(pStops->id).first->second;
+        pending.order.marketID = pStops->market;
+        pending.order.price = pStops->price;
+        pending.order.volume = pStops->volume;
+        pending.order.type = pStops->side;
+        pending.order.timeInForce = pStops->timeInForce;
+        pending.order.kind = pStops->kind;
+        pending.order.owner = pStops->owner;
+        pending.order.stopPrice = pStops->stopPrice;
+        pending.position = m_markets[pStops->market].stops.Insert(pStops->side, pStops->stopPrice, pStops->id);
+    }
+
+    m_nextOrderID = header.nextOrderID;
+
+    return true;
+}
+
+template<typename... Sinks>
+OrderPlaceEventResult BasicMatchingEngine<Sinks...>::OnOrderPlace(Order&& o)
+{
+    if(o.market.empty())
+    {
+        return OrderPlaceEventResult::OrderCancelled;
+    }
+
+    INSTRUMENT_BEGIN(lookupStart);
+    const typename MarketLookup::const_iterator itMarket = m_marketLookup.find(o.market);
+    INSTRUMENT_END(lookupStart, EngineStage::MarketLookup);
+
+    if(itMarket == m_marketLookup.end())
+    {
+        // trying to place an order on a market that doesn't exist
+        return OrderPlaceEventResult::OrderCancelled;
+    }
+
+    return OnOrderPlace(itMarket->second, std::move(o));
+}
+
+template<typename... Sinks>
+OrderPlaceEventResult BasicMatchingEngine<Sinks...>::OnOrderPlace(MarketID market, Order&& o)
+{
+    if(market >= m_markets.size() || !m_markets[market].Accepts(o))
+    {
+        return OrderPlaceEventResult::OrderCancelled;
+    }
+
+    if(!PassesRisk(m_markets[market], o))
+    {
+        return OrderPlaceEventResult::RiskRejected;
+    }
+
+    o.marketID = market;
+
+    const OrderPlaceEventResult result = HandleOrderBookUpdate(m_markets[market], std::move(o));
+    PublishDepthUpdates();
+
+    return result;
+}
+
+template<typename... Sinks>
+OrderCancelEventResult BasicMatchingEngine<Sinks...>::OnOrderCancel(OrderID oid)
+{
+    INSTRUMENT_BEGIN(cancelStart);
+    const bool cancelled = HandleOrderBookCancel(oid);
+    INSTRUMENT_END(cancelStart, EngineStage::Cancel);
+
+    PublishDepthUpdates();
+
+    INSTRUMENT_COUNT(cancelsRequested, 1);
+    INSTRUMENT_COUNT(cancelsFound, cancelled ? 1 : 0);
+
+    return 
+        cancelled == true 
+            ? OrderCancelEventResult::OrderCancelled : OrderCancelEventResult::OrderNotFound;
+}
+
+template<typename... Sinks>
+OrderModifyEventResult BasicMatchingEngine<Sinks...>::OnOrderModify(OrderID oid, Price price, Quantity volume)
+{
+    INSTRUMENT_BEGIN(modifyStart);
+    const OrderModifyEventResult result = HandleOrderBookModify(oid, price, volume);
+    INSTRUMENT_END(modifyStart, EngineStage::Modify);
+
+    PublishDepthUpdates();
+
+    return result;
+}
+
+template<typename... Sinks>
+OrderCancelEventResult BasicMatchingEngine<Sinks...>::OnMassCancel(OwnerID owner, MarketID market)
+{
+    INSTRUMENT_BEGIN(cancelStart);
+    const uint64_t cancelled = HandleMassCancel(owner, market);
+    INSTRUMENT_END(cancelStart, EngineStage::Cancel);
+
+    PublishDepthUpdates();
+
+    return
+        cancelled > 0
+            ? OrderCancelEventResult::OrderCancelled : OrderCancelEventResult::OrderNotFound;
+}
+
+template<typename... Sinks>
+void BasicMatchingEngine<Sinks...>::OnOrderBatch(OrderRequest* requests, size_t count, OrderRequestResult* results)
+{
+    const auto SameMarket = [](const OrderRequest& lhs, const OrderRequest& rhs)
+    {
+        return lhs.market == InvalidMarketID
+            ? rhs.market == InvalidMarketID && lhs.order.market == rhs.order.market
+            : lhs.market == rhs.market;
+    };
+
+    size_t first{0};
+
+    while(first < count)
+    {
+        if(requests[first].type == OrderRequestType::Cancel)
+        {
+            results[first].cancelled = OnOrderCancel(requests[first].oid);
+            ++first;
+            continue;
+        }
+
+        if(requests[first].type == OrderRequestType::MassCancel)
+        {
+            results[first].cancelled = OnMassCancel(requests[first].order.owner, requests[first].market);
+            ++first;
+            continue;
+        }
+
+        if(requests[first].type == OrderRequestType::Modify)
+        {
+            const Order& o = requests[first].order;
+            results[first].modified = OnOrderModify(requests[first].oid, o.price, o.volume);
+            ++first;
+            continue;
+        }
+
+        // Gather the run of placements on the same market so the
+        // market only has to be looked up once for all of them
+        size_t last{first + 1};
+
+        while(    last < count
+               && requests[last].type == OrderRequestType::Place
+               && SameMarket(requests[first], requests[last]))
+        {
+            ++last;
+        }
+
+        const MarketID marketID = requests[first].market == InvalidMarketID
+            ? GetMarketID(requests[first].order.market)
+            : requests[first].market;
+
+        if(marketID >= m_markets.size())
+        {
+            for(size_t i = first; i < last; ++i)
+            {
+                results[i].placed = OrderPlaceEventResult::OrderCancelled;
+            }
+        }
+        else
+        {
+            Market& market = m_markets[marketID];
+
+            std::visit([&](auto& book)
+            {
+                for(size_t i = first; i < last; ++i)
+                {
+                    Order& o = requests[i].order;
+
+                    if(!market.Accepts(o))
+                    {
+                        results[i].placed = OrderPlaceEventResult::OrderCancelled;
+                        continue;
+                    }
+
+                    if(!PassesRisk(market, o))
+                    {
+                        results[i].placed = OrderPlaceEventResult::RiskRejected;
+                        continue;
+                    }
+
+                    o.marketID = marketID;
+                    results[i].placed = PlaceOrder(market, book, o);
+                    PublishDepthUpdates();
+                }
+            }, market.book);
+        }
+
+        first = last;
+    }
+}
+
+template<typename... Sinks>
+OrderPlaceEventResult BasicMatchingEngine<Sinks...>::HandleOrderBookUpdate(Market& market, Order&& o)
+{
+    return std::visit([this, &market, &o](auto& book)
+    {
+        return PlaceOrder(market, book, o);
+    }, market.book);
+}
+
+template<typename... Sinks>
+bool BasicMatchingEngine<Sinks...>::PassesRisk(const Market& market, const Order& o)
+{
+    if(o.owner == NoOwner)
+    {
+        return true;
+    }
+
+    INSTRUMENT_BEGIN(riskStart);
+
+    const typename AccountLookup::const_iterator it = m_accounts.find(o.owner);
+    const bool passes = it == m_accounts.end() || WithinRiskLimits(market, it->second, o, nullptr);
+
+    INSTRUMENT_END(riskStart, EngineStage::Risk);
+
+    return passes;
+}
+
+template<typename... Sinks>
+bool BasicMatchingEngine<Sinks...>::WithinRiskLimits(const Market& market, const Account& account, const Order& o, const OrderNode* pAmended) const
+{
+    const RiskLimits& limits = account.limits;
+    const RiskExposure& exposure = account.exposure;
+
+    if(limits.maxOrderVolume != 0 && o.volume > limits.maxOrderVolume)
+    {
+        return false;
+    }
+
+    if(limits.maxOpenOrders != 0 && pAmended == nullptr && exposure.GetOpenOrders() >= limits.maxOpenOrders)
+    {
+        return false;
+    }
+
+    if(limits.priceBandBasisPoints == 0 && limits.maxNotional == 0)
+    {
+        return true;
+    }
+
+    const bool isBid = o.type == OrderType::Bid;
+
+    // Best prices on the order's own side and the side it would trade against
+    const auto [touch, opposite] = std::visit([&market, isBid](const auto& book)
+    {
+        const Price bid = book.bids.Empty() ? 0 : market.ToPrice(book.bids.BestTick());
+        const Price ask = book.asks.Empty() ? 0 : market.ToPrice(book.asks.BestTick());
+
+        return isBid ? std::make_pair(bid, ask) : std::make_pair(ask, bid);
+    }, market.book);
+
+    // A market order is valued at the touch it will take and has no band,
+    // a stop is valued as what it becomes
+    const Price price = o.kind == OrderKind::Market || o.kind == OrderKind::Stop ? opposite : o.price;
+
+    if(limits.priceBandBasisPoints != 0 && o.kind == OrderKind::Limit)
+    {
+        const Price reference = market.lastTradePrice != 0 ? market.lastTradePrice : (opposite != 0 ? opposite : touch);
+
+        if(reference != 0)
+        {
+            const Price distance = price > reference ? price - reference : reference - price;
+
+            if(static_cast<double>(distance) * 10000.0 > static_cast<double>(reference) * limits.priceBandBasisPoints)
+            {
+                return false;
+            }
+        }
+    }
+
+    if(limits.maxNotional != 0)
+    {
+        const uint64_t released = pAmended != nullptr ? NotionalOf(pAmended) : 0;
+
+        if(exposure.GetNotional() - released + price * o.volume > limits.maxNotional)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+template<typename... Sinks>
+uint64_t BasicMatchingEngine<Sinks...>::NotionalOf(const OrderNode* pNode) const
+{
+    return m_markets[pNode->market].ToPrice(pNode->tick) * pNode->volume;
+}
+
+template<typename... Sinks>
+template<typename Book>
+OrderPlaceEventResult BasicMatchingEngine<Sinks...>::PlaceOrder(Market& market, Book& book, const Order& o)
+{
+    if(IsStop(o.kind))
+    {
+        return PlaceStop(market, o);
+    }
+
+    const bool isBid = o.type == OrderType::Bid;
+
+    // A market order crosses every level of the opposite side
+    const Tick tick = o.kind == OrderKind::Market
+        ? (isBid ? MaxTick : 0)
+        : market.ToTick(o.price);
+
+    // A fill or kill order the opposite side can't fill in full is killed
+    // before it is given an ID, so it leaves no trace in the journal or sinks
+    if(    o.timeInForce == TimeInForce::FillOrKill
+        && !(isBid ? CanFill(book.asks, o, tick) : CanFill(book.bids, o, tick)))
+    {
+        return OrderPlaceEventResult::OrderExpired;
+    }
+
+    const OrderID oid = m_nextOrderID++;
+
+    JournalPlacement(oid, o);
+    NotifyOrderBookEventObservers(oid, o);
+
+    const OrderPlaceEventResult result = MatchOrder(market, book, oid, o, tick);
+
+    // Only an order that traded can have reached a stop
+    if(result == OrderPlaceEventResult::OrderMatched && market.stops.Triggers(market.lastTradePrice))
+    {
+        TriggerStops(market);
+    }
+
+    return result;
+}
+
+template<typename... Sinks>
+template<typename Book>
+OrderPlaceEventResult BasicMatchingEngine<Sinks...>::MatchOrder(Market& market, Book& book, OrderID oid, const Order& o, Tick tick)
+{
+    const bool isBid = o.type == OrderType::Bid;
+
+    // The incoming order is matched against the opposite side before it
+    // is ever inserted, whatever remains afterwards rests on its own side
+    // unless the order is only allowed to take liquidity
+    const bool rests = o.kind == OrderKind::Limit && o.timeInForce == TimeInForce::GoodTillCancel;
+
+    MatchOutcome outcome;
+    bool rested{false};
+
+    INSTRUMENT_BEGIN(matchStart);
+
+    if(isBid)
+    {
+        outcome = MatchAggressor(market, book.asks, oid, o, tick);
+        INSTRUMENT_END(matchStart, EngineStage::Match);
+
+        if(outcome.remaining > 0 && rests && !outcome.cancelled)
+        {
+            INSTRUMENT_BEGIN(restStart);
+            RestOrder(book.bids, oid, o, tick, outcome.remaining);
+            INSTRUMENT_END(restStart, EngineStage::Rest);
+            rested = true;
+        }
+    }
+    else
+    {
+        outcome = MatchAggressor(market, book.bids, oid, o, tick);
+        INSTRUMENT_END(matchStart, EngineStage::Match);
+
+        if(outcome.remaining > 0 && rests && !outcome.cancelled)
+        {
+            INSTRUMENT_BEGIN(restStart);
+            RestOrder(book.asks, oid, o, tick, outcome.remaining);
+            INSTRUMENT_END(restStart, EngineStage::Rest);
+            rested = true;
+        }
+    }
+
+    // Self-trade prevention may have taken volume from the order without it
+    // trading, which its fills alone don't account for
+    const bool decremented = outcome.remaining + outcome.filled < o.volume;
+
+    if(rested && decremented)
+    {
+        NotifyModifyEventObservers(ModifiedOrder{o.marketID, oid, o.price, outcome.remaining, o.type});
+    }
+
+    if(outcome.cancelled || (outcome.remaining > 0 && !rests) || (outcome.remaining == 0 && decremented))
+    {
+        // The rest of an immediate order is cancelled without ever
+        // having touched its own side of the book
+        NotifyCancelEventObservers(oid);
+    }
+
+    INSTRUMENT_COUNT(ordersPlaced, 1);
+    INSTRUMENT_COUNT(aggressors, outcome.filled > 0 ? 1 : 0);
+
+    if(outcome.filled > 0)
+    {
+        return OrderPlaceEventResult::OrderMatched;
+    }
+
+    return rests && !outcome.cancelled
+        ? OrderPlaceEventResult::OrderPlaced
+        : OrderPlaceEventResult::OrderExpired;
+}
+
+template<typename... Sinks>
+void BasicMatchingEngine<Sinks...>::JournalPlacement(OrderID oid, const Order& o)
+{
+    if(m_pJournal)
+    {
+        INSTRUMENT_BEGIN(journalStart);
+
+        JournalRecord record;
+        record.type = JournalRecordType::Place;
+        record.oid = oid;
+        record.market = o.marketID;
+        record.price = o.price;
+        record.stopPrice = o.stopPrice;
+        record.volume = o.volume;
+        record.side = o.type;
+        record.timeInForce = o.timeInForce;
+        record.kind = o.kind;
+        record.owner = o.owner;
+
+        m_pJournal->Append(record);
+
+        INSTRUMENT_END(journalStart, EngineStage::Journal);
+    }
+}
+
+template<typename... Sinks>
+OrderPlaceEventResult BasicMatchingEngine<Sinks...>::PlaceStop(Market& market, const Order& o)
+{
+    const OrderID oid = m_nextOrderID++;
+
+    JournalPlacement(oid, o);
+    NotifyOrderBookEventObservers(oid, o);
+
+    // Only what the stop becomes is kept, not the name of its market
+    PendingStop& stop = m_stopOrders.try_emplace(oid).first->second;
+    stop.order.marketID = o.marketID;
+    stop.order.price = o.price;
+    stop.order.volume = o.volume;
+    stop.order.type = o.type;
+    stop.order.timeInForce = o.timeInForce;
+    stop.order.kind = o.kind;
+    stop.order.owner = o.owner;
+    stop.order.stopPrice = o.stopPrice;
+    stop.position = market.stops.Insert(o.type, o.stopPrice, oid);
+
+    // A stop price the market has already traded through sets it off at once
+    if(market.lastTradePrice != 0 && market.stops.Triggers(market.lastTradePrice))
+    {
+        TriggerStops(market);
+    }
+
+    return OrderPlaceEventResult::OrderPlaced;
+}
+
+template<typename... Sinks>
+void BasicMatchingEngine<Sinks...>::TriggerStops(Market& market)
+{
+    StopIndex& stops = market.stops;
+
+    while(stops.Triggers(market.lastTradePrice))
+    {
+        const Price lastTradePrice = market.lastTradePrice;
+
+        // Everything the last trade reached goes as one batch, nearest
+        // stop price first and in arrival order at the same stop price
+        m_triggeredStops.clear();
+
+        StopIndex::Orders::iterator buy = stops.buys.begin();
+
+        for(; buy != stops.buys.end() && buy->first <= lastTradePrice; ++buy)
+        {
+            m_triggeredStops.push_back(buy->second);
+        }
+
+        stops.buys.erase(stops.buys.begin(), buy);
+
+        StopIndex::Orders::iterator sell = stops.sells.end();
+
+        // Sells are walked down a stop price at a time
+        while(sell != stops.sells.begin() && std::prev(sell)->first >= lastTradePrice)
+        {
+            const StopIndex::Orders::iterator first = stops.sells.lower_bound(std::prev(sell)->first);
+
+            for(StopIndex::Orders::iterator it = first; it != sell; ++it)
+            {
+                m_triggeredStops.push_back(it->second);
+            }
+
+            sell = first;
+        }
+
+        stops.sells.erase(sell, stops.sells.end());
+        stops.Update();
+
+        // The trades of this batch can reach further stops, which the
+        // next pass picks up
+        for(const OrderID oid : m_triggeredStops)
+        {
+            const typename StopLookup::iterator it = m_stopOrders.find(oid);
+            Order o = std::move(it->second.order);
+            m_stopOrders.erase(it);
+
+            o.kind = o.kind == OrderKind::Stop ? OrderKind::Market : OrderKind::Limit;
+
+            NotifyStopTriggeredEventObservers(oid, o);
+
+            std::visit([&](auto& book)
+            {
+                const bool isBid = o.type == OrderType::Bid;
+                const Tick tick = o.kind == OrderKind::Market
+                    ? (isBid ? MaxTick : 0)
+                    : market.ToTick(o.price);
+
+                // Already given an ID, so a fill or kill that can't fill is cancelled
+                if(    o.timeInForce == TimeInForce::FillOrKill
+                    && !(isBid ? CanFill(book.asks, o, tick) : CanFill(book.bids, o, tick)))
+                {
+                    NotifyCancelEventObservers(oid);
+                    return;
+                }
+
+                MatchOrder(market, book, oid, o, tick);
+            }, market.book);
+        }
+    }
+}
+
+template<typename... Sinks>
+bool BasicMatchingEngine<Sinks...>::CancelStop(OrderID oid)
+{
+    const typename StopLookup::iterator it = m_stopOrders.find(oid);
+
+    if(it == m_stopOrders.end())
+    {
+        return false;
+    }
+
+    const Order& o = it->second.order;
+
+    if(m_pJournal)
+    {
+        JournalRecord record;
+        record.type = JournalRecordType::Cancel;
+        record.oid = oid;
+        record.market = o.marketID;
+
+        m_pJournal->Append(record);
+    }
+
+    m_markets[o.marketID].stops.Erase(o.type, it->second.position);
+    m_stopOrders.erase(it);
+
+    NotifyCancelEventObservers(oid);
+    return true;
+}
+
+template<typename... Sinks>
+void BasicMatchingEngine<Sinks...>::CancelStops(OwnerID owner, MarketID market)
+{
+    const auto CancelFrom = [this, owner](StopIndex::Orders& orders)
+    {
+        for(StopIndex::Orders::iterator it = orders.begin(); it != orders.end();)
+        {
+            const typename StopLookup::iterator stop = m_stopOrders.find(it->second);
+
+            if(owner == NoOwner || stop->second.order.owner == owner)
+            {
+                m_cancelledOrders.push_back(it->second);
+                m_stopOrders.erase(stop);
+                it = orders.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+    };
+
+    const MarketID first = market == InvalidMarketID ? 0 : market;
+    const MarketID last = market == InvalidMarketID ? static_cast<MarketID>(m_markets.size()) : market + 1;
+
+    for(MarketID id = first; id < last && !m_stopOrders.empty(); ++id)
+    {
+        StopIndex& stops = m_markets[id].stops;
+
+        if(!stops.Empty())
+        {
+            CancelFrom(stops.buys);
+            CancelFrom(stops.sells);
+            stops.Update();
+        }
+    }
+}
+
+template<typename... Sinks>
+template<typename Side>
+bool BasicMatchingEngine<Sinks...>::CanFill(const Side& opposite, const Order& o, Tick tick) const
+{
+    const bool isBid = o.type == OrderType::Bid;
+
+    Quantity available{0};
+
+    // Only the aggregate of each level is needed, no order is visited
+    opposite.ForEachLevel([isBid, tick, &o, &available](Tick levelTick, const PriceLevel& level)
+    {
+        if(isBid ? tick < levelTick : tick > levelTick)
+        {
+            return false;
+        }
+
+        available += level.volume;
+        return available < o.volume;
+    });
+
+    return available >= o.volume;
+}
+
+template<typename... Sinks>
+template<typename Side>
+void BasicMatchingEngine<Sinks...>::RestOrder(Side& side, OrderID oid, const Order& o, Tick tick, Quantity volume)
+{
+    OrderNode* pNode = m_orderPool.Acquire();
+    pNode->market = o.marketID;
+    pNode->id = oid;
+    pNode->tick = tick;
+    pNode->volume = volume;
+    pNode->type = o.type;
+
+    // Create position if it doesn't already exist    
+    PriceLevel& level = side.FindOrInsert(tick);
+    level.orders.PushBack(pNode);
+    level.volume += volume;
+    ++level.orderCount;
+    pNode->level = &level;
+
+    ReserveAllocations(m_markets[o.marketID], level);
+    RecordDepthChange(o.marketID, o.type, o.price, level);
+
+    m_orderLookup.Insert(oid, pNode);
+    LinkOwner(pNode, o.owner);
+}
+
+template<typename... Sinks>
+void BasicMatchingEngine<Sinks...>::LinkOwner(OrderNode* pNode, OwnerID owner)
+{
+    pNode->owner = owner;
+
+    if(owner != NoOwner)
+    {
+        // Only an owner's first order allocates, its account is kept once empty
+        Account& account = m_accounts.try_emplace(owner).first->second;
+        account.orders.PushBack(pNode);
+        account.exposure.Add(NotionalOf(pNode));
+        pNode->account = &account;
+    }
+}
+
+template<typename... Sinks>
+void BasicMatchingEngine<Sinks...>::RemoveOrder(Market& market, OrderNode* pNode)
+{
+    // Unlink the order from its position in place
+    PriceLevel& level = *pNode->level;
+    level.orders.Erase(pNode);
+    level.volume -= pNode->volume;
+    --level.orderCount;
+
+    RecordDepthChange(pNode->market, pNode->type, market.ToPrice(pNode->tick), level);
+
+    if(level.orders.Empty())
+    {
+        // Never leave an empty position behind, matching relies on
+        // the best position of each side always holding orders
+        std::visit([pNode](auto& book)
+        {
+            if(pNode->type == OrderType::Bid)
+            {
+                book.bids.Erase(pNode->tick);
+            }
+            else
+            {
+                book.asks.Erase(pNode->tick);
+            }
+        }, market.book);
+    }
+}
+
+template<typename... Sinks>
+void BasicMatchingEngine<Sinks...>::ReleaseOrder(OrderNode* pNode)
+{
+    m_orderLookup.Erase(pNode->id);
+
+    if(pNode->account != nullptr)
+    {
+        pNode->account->orders.Erase(pNode);
+        pNode->account->exposure.Remove(NotionalOf(pNode));
+    }
+
+    m_orderPool.Release(pNode);
+}
+
+template<typename... Sinks>
+bool BasicMatchingEngine<Sinks...>::HandleOrderBookCancel(OrderID oid)
+{
+    OrderNode* pNode = m_orderLookup.Find(oid);
+
+    if(pNode == nullptr)
+    {
+        // Stops are only looked for once there are any
+        return !m_stopOrders.empty() && CancelStop(oid);
+    }
+
+    if(m_pJournal)
+    {
+        JournalRecord record;
+        record.type = JournalRecordType::Cancel;
+        record.oid = oid;
+        record.market = pNode->market;
+
+        m_pJournal->Append(record);
+    }
+
+    RemoveOrder(m_markets[pNode->market], pNode);
+    ReleaseOrder(pNode);
+
+    NotifyCancelEventObservers(oid);
+    return true;
+}
+
+template<typename... Sinks>
+uint64_t BasicMatchingEngine<Sinks...>::HandleMassCancel(OwnerID owner, MarketID market)
+{
+    OwnerOrders* pOrders{nullptr};
+
+    if(owner == NoOwner)
+    {
+        if(market >= m_markets.size())
+        {
+            return 0;
+        }
+    }
+    else
+    {
+        const typename AccountLookup::iterator it = m_accounts.find(owner);
+
+        if(it != m_accounts.end() && !it->second.orders.Empty())
+        {
+            pOrders = &it->second.orders;
+        }
+        else if(m_stopOrders.empty())
+        {
+            return 0;
+        }
+    }
+
+    if(m_pJournal)
+    {
+        JournalRecord record;
+        record.type = JournalRecordType::MassCancel;
+        record.owner = owner;
+        record.market = market;
+
+        m_pJournal->Append(record);
+    }
+
+    if(owner == NoOwner)
+    {
+        // A whole market goes a level at a time rather than order by order
+        Market& entry = m_markets[market];
+
+        std::visit([&](auto& book)
+        {
+            CancelSide(entry, market, book.bids, OrderType::Bid);
+            CancelSide(entry, market, book.asks, OrderType::Ask);
+        }, entry.book);
+    }
+    else if(pOrders != nullptr)
+    {
+        for(OrderNode* pNode = pOrders->Front(); pNode != nullptr;)
+        {
+            OrderNode* pNext = OwnerOrders::Next(pNode);
+
+            if(market == InvalidMarketID || pNode->market == market)
+            {
+                m_cancelledOrders.push_back(pNode->id);
+                RemoveOrder(m_markets[pNode->market], pNode);
+                ReleaseOrder(pNode);
+            }
+
+            pNode = pNext;
+        }
+    }
+
+    if(!m_stopOrders.empty())
+    {
+        CancelStops(owner, market);
+    }
+
+    const uint64_t cancelled = m_cancelledOrders.size();
+
+    NotifyMassCancelEventObservers();
+    m_cancelledOrders.clear();
+
+    return cancelled;
+}
+
+template<typename... Sinks>
+template<typename Side>
+void BasicMatchingEngine<Sinks...>::CancelSide(const Market& market, MarketID marketID, Side& side, OrderType type)
+{
+    while(!side.Empty())
+    {
+        const Tick tick = side.BestTick();
+        PriceLevel& level = side.Best();
+
+        while(!level.orders.Empty())
+        {
+            OrderNode* pNode = level.orders.PopFront();
+            m_cancelledOrders.push_back(pNode->id);
+            ReleaseOrder(pNode);
+        }
+
+        level.volume = 0;
+        level.orderCount = 0;
+
+        RecordDepthChange(marketID, type, market.ToPrice(tick), level);
+        side.EraseBest();
+    }
+}
+
+template<typename... Sinks>
+OrderModifyEventResult BasicMatchingEngine<Sinks...>::HandleOrderBookModify(OrderID oid, Price price, Quantity volume)
+{
+    OrderNode* pNode = m_orderLookup.Find(oid);
+
+    if(pNode == nullptr)
+    {
+        return OrderModifyEventResult::OrderNotFound;
+    }
+
+    Market& market = m_markets[pNode->market];
+
+    if(!market.IsOnTick(price) || !market.IsWholeLots(volume))
+    {
+        return OrderModifyEventResult::OrderRejected;
+    }
+
+    // Amendments replayed from the journal were checked when first made
+    if(pNode->account != nullptr && !m_replaying)
+    {
+        INSTRUMENT_BEGIN(riskStart);
+
+        Order o;
+        o.price = price;
+        o.volume = volume;
+        o.type = pNode->type;
+
+        const bool passes = WithinRiskLimits(market, *pNode->account, o, pNode);
+
+        INSTRUMENT_END(riskStart, EngineStage::Risk);
+
+        if(!passes)
+        {
+            return OrderModifyEventResult::OrderRejected;
+        }
+    }
+
+    if(m_pJournal)
+    {
+        INSTRUMENT_BEGIN(journalStart);
+
+        JournalRecord record;
+        record.type = JournalRecordType::Modify;
+        record.oid = oid;
+        record.market = pNode->market;
+        record.price = price;
+        record.volume = volume;
+        record.side = pNode->type;
+
+        m_pJournal->Append(record);
+
+        INSTRUMENT_END(journalStart, EngineStage::Journal);
+    }
+
+    const Tick tick = market.ToTick(price);
+
+    if(tick == pNode->tick && volume <= pNode->volume)
+    {
+        // Giving up quantity at the same price keeps the order's place
+        PriceLevel& level = *pNode->level;
+        level.volume -= pNode->volume - volume;
+
+        if(pNode->account != nullptr)
+        {
+            pNode->account->exposure.Reduce(price * (pNode->volume - volume));
+        }
+
+        pNode->volume = volume;
+
+        NotifyModifyEventObservers(ModifiedOrder{pNode->market, oid, price, volume, pNode->type});
+        RecordDepthChange(pNode->market, pNode->type, price, level);
+
+        return OrderModifyEventResult::OrderModified;
+    }
+
+    const OrderModifyEventResult result = std::visit([&](auto& book)
+    {
+        return pNode->type == OrderType::Bid
+            ? MoveOrder(market, book.bids, book.asks, pNode, tick, volume)
+            : MoveOrder(market, book.asks, book.bids, pNode, tick, volume);
+    }, market.book);
+
+    if(result == OrderModifyEventResult::OrderMatched && market.stops.Triggers(market.lastTradePrice))
+    {
+        TriggerStops(market);
+    }
+
+    return result;
+}
+
+template<typename... Sinks>
+template<typename Side, typename Opposite>
+OrderModifyEventResult BasicMatchingEngine<Sinks...>::MoveOrder(Market& market, Side& side, Opposite& opposite, OrderNode* pNode, Tick tick, Quantity volume)
+{
+    const bool isBid = pNode->type == OrderType::Bid;
+
+    // The order stays open while it moves, only its size is taken back out
+    if(pNode->account != nullptr)
+    {
+        pNode->account->exposure.Reduce(NotionalOf(pNode));
+    }
+
+    PriceLevel& from = *pNode->level;
+    from.orders.Erase(pNode);
+    from.volume -= pNode->volume;
+    --from.orderCount;
+
+    RecordDepthChange(pNode->market, pNode->type, market.ToPrice(pNode->tick), from);
+
+    if(from.orders.Empty())
+    {
+        side.Erase(pNode->tick);
+    }
+
+    MatchOutcome outcome;
+    outcome.remaining = volume;
+
+    // Only a move through the touch can trade, anything else goes
+    // straight to its new level
+    if(!opposite.Empty() && (isBid ? tick >= opposite.BestTick() : tick <= opposite.BestTick()))
+    {
+        Order o;
+        o.marketID = pNode->market;
+        o.price = market.ToPrice(tick);
+        o.volume = volume;
+        o.type = pNode->type;
+        o.owner = pNode->owner;
+
+        INSTRUMENT_BEGIN(matchStart);
+        outcome = MatchAggressor(market, opposite, pNode->id, o, tick);
+        INSTRUMENT_END(matchStart, EngineStage::Match);
+    }
+
+    // Used up partly by self-trade prevention rather than entirely by fills
+    const bool decremented = outcome.remaining == 0 && outcome.filled < volume;
+
+    if(outcome.cancelled || decremented)
+    {
+        NotifyCancelEventObservers(pNode->id);
+    }
+
+    if(outcome.cancelled || outcome.remaining == 0)
+    {
+        pNode->volume = 0;
+        ReleaseOrder(pNode);
+
+        return outcome.filled > 0
+            ? OrderModifyEventResult::OrderMatched
+            : OrderModifyEventResult::OrderCancelled;
+    }
+
+    const Quantity remaining = outcome.remaining;
+
+    pNode->tick = tick;
+    pNode->volume = remaining;
+
+    if(pNode->account != nullptr)
+    {
+        pNode->account->exposure.Increase(NotionalOf(pNode));
+    }
+
+    PriceLevel& to = side.FindOrInsert(tick);
+    to.orders.PushBack(pNode);
+    to.volume += remaining;
+    ++to.orderCount;
+    pNode->level = &to;
+
+    ReserveAllocations(market, to);
+
+    // Reported only once it is known where the order comes to rest, and with
+    // what is left of it
+    NotifyModifyEventObservers(ModifiedOrder{pNode->market, pNode->id, market.ToPrice(tick), remaining, pNode->type});
+    RecordDepthChange(pNode->market, pNode->type, market.ToPrice(tick), to);
+
+    return outcome.filled > 0
+        ? OrderModifyEventResult::OrderMatched
+        : OrderModifyEventResult::OrderModified;
+}
+
+template<typename... Sinks>
+template<typename Side>
+typename BasicMatchingEngine<Sinks...>::MatchOutcome BasicMatchingEngine<Sinks...>::MatchAggressor(Market& market, Side& opposite, OrderID oid, const Order& o, Tick tick)
+{
+    switch(market.matchingPolicy)
+    {
+    case MatchingPolicy::ProRata:
+        return MatchWithPolicy<MatchingPolicy::ProRata>(market, opposite, oid, o, tick);
+
+    case MatchingPolicy::Hybrid:
+        return MatchWithPolicy<MatchingPolicy::Hybrid>(market, opposite, oid, o, tick);
+
+    default:
+        return MatchWithPolicy<MatchingPolicy::Fifo>(market, opposite, oid, o, tick);
+    }
+}
+
+template<typename... Sinks>
+template<MatchingPolicy Policy, typename Side>
+typename BasicMatchingEngine<Sinks...>::MatchOutcome BasicMatchingEngine<Sinks...>::MatchWithPolicy(Market& market, Side& opposite, OrderID oid, const Order& o, Tick tick)
+{
+    const bool isBid = o.type == OrderType::Bid;
+
+    MatchOutcome outcome;
+    outcome.remaining = o.volume;
+
+    // Walk the opposite side outwards from the touch for as long as the
+    // incoming order still crosses it. The book is never left crossed, so
+    // an order that doesn't reach the touch stops here without matching.
+    while(outcome.remaining > 0 && !opposite.Empty())
+    {
+        const Tick positionTick = opposite.BestTick();
+
+        if(isBid ? tick < positionTick : tick > positionTick)
+        {
+            break;
+        }
+
+        const Price positionPrice = market.ToPrice(positionTick);
+
+        PriceLevel& position = opposite.Best();
+        INSTRUMENT_COUNT(levelsWalked, 1);
+
+        if constexpr(Policy == MatchingPolicy::Fifo)
+        {
+            MatchInTimeOrder(market, position, positionPrice, oid, o, outcome, 0);
+        }
+        else
+        {
+            // An aggressor taking the whole level fills every order there
+            // in full whatever the policy, which time priority does fastest
+            if(outcome.remaining < position.volume)
+            {
+                if constexpr(Policy == MatchingPolicy::Hybrid)
+                {
+                    // The share taken in time priority is rounded down to whole lots
+                    const Quantity lots = outcome.remaining / market.lotSize * market.fifoPercent / 100;
+                    MatchInTimeOrder(market, position, positionPrice, oid, o, outcome, outcome.remaining - lots * market.lotSize);
+                }
+
+                if(!outcome.cancelled && !position.orders.Empty())
+                {
+                    MatchProRata(market, position, positionPrice, oid, o, outcome);
+                }
+            }
+
+            if(!outcome.cancelled)
+            {
+                MatchInTimeOrder(market, position, positionPrice, oid, o, outcome, 0);
+            }
+        }
+
+        RecordDepthChange(o.marketID, isBid ? OrderType::Ask : OrderType::Bid, positionPrice, position);
+
+        if(position.orders.Empty())
+        {
+            opposite.EraseBest();
+        }
+
+        if(outcome.cancelled)
+        {
+            break;
+        }
+    }
+
+    return outcome;
+}
+
+template<typename... Sinks>
+void BasicMatchingEngine<Sinks...>::MatchInTimeOrder(Market& market, PriceLevel& position, Price price, OrderID oid, const Order& o, MatchOutcome& outcome, Quantity floor)
+{
+    // Orders without an owner can never meet one of their own
+    const bool preventSelfTrade = o.owner != NoOwner && market.selfTradePrevention != SelfTradePrevention::None;
+
+    OrderQueue& positionOrders = position.orders;
+
+    while(outcome.remaining > floor && !positionOrders.Empty())
+    {
+        OrderNode* pResting = positionOrders.Front();
+
+        if(preventSelfTrade && pResting->owner == o.owner)
+        {
+            if(PreventSelfTrade(market, position, pResting, outcome.remaining))
+            {
+                outcome.cancelled = true;
+                break;
+            }
+
+            continue;
+        }
+
+        // The smaller of the two orders is satisfied entirely
+        FillResting(market, position, pResting, price, oid, o, outcome, std::min(outcome.remaining - floor, pResting->volume));
+    }
+}
+
+template<typename... Sinks>
+void BasicMatchingEngine<Sinks...>::MatchProRata(Market& market, PriceLevel& position, Price price, OrderID oid, const Order& o, MatchOutcome& outcome)
+{
+    OrderQueue& positionOrders = position.orders;
+
+    // Orders of the aggressor's own owner are dealt with before anything is
+    // allocated, so they take no share of it
+    if(o.owner != NoOwner && market.selfTradePrevention != SelfTradePrevention::None)
+    {
+        for(OrderNode* pResting = positionOrders.Front(); pResting != nullptr; )
+        {
+            OrderNode* pNext = OrderQueue::Next(pResting);
+
+            if(    pResting->owner == o.owner
+                && PreventSelfTrade(market, position, pResting, outcome.remaining))
+            {
+                outcome.cancelled = true;
+                return;
+            }
+
+            pResting = pNext;
+        }
+    }
+
+    // Anything taken out of the level on the way may leave the aggressor
+    // able to take all of it, which is left to time priority
+    if(outcome.remaining >= position.volume)
+    {
+        return;
+    }
+
+    // Every order is given the same fraction of its volume, rounded down
+    // to whole lots, over a contiguous copy of the level's volumes
+    const Quantity lotSize = market.lotSize;
+    const Quantity levelLots = position.volume / lotSize;
+    const Quantity aggressorLots = outcome.remaining / lotSize;
+
+    Quantity* allocations = m_allocations.data();
+    const size_t count = position.orderCount;
+
+    size_t i = 0;
+    for(OrderNode* pResting = positionOrders.Front(); pResting != nullptr; pResting = OrderQueue::Next(pResting))
+    {
+        allocations[i++] = pResting->volume / lotSize;
+    }
+
+    Quantity allocated = 0;
+    for(i = 0; i < count; ++i)
+    {
+        allocations[i] = MulDiv(allocations[i], aggressorLots, levelLots);
+        allocated += allocations[i];
+    }
+
+    // Rounding leaves fewer lots over than there are orders, and every order
+    // was given less than its volume, so the first orders in time priority
+    // take one more lot each
+    Quantity oddLots = aggressorLots - allocated;
+
+    i = 0;
+    for(OrderNode* pResting = positionOrders.Front(); pResting != nullptr; ++i)
+    {
+        OrderNode* pNext = OrderQueue::Next(pResting);
+
+        Quantity lots = allocations[i];
+
+        if(oddLots > 0)
+        {
+            ++lots;
+            --oddLots;
+        }
+
+        if(lots > 0)
+        {
+            FillResting(market, position, pResting, price, oid, o, outcome, lots * lotSize);
+        }
+
+        pResting = pNext;
+    }
+}
+
+template<typename... Sinks>
+void BasicMatchingEngine<Sinks...>::ReserveAllocations(const Market& market, const PriceLevel& level)
+{
+    if(market.matchingPolicy != MatchingPolicy::Fifo && level.orderCount > m_allocations.size())
+    {
+        m_allocations.resize(std::max<size_t>(level.orderCount, m_allocations.size() * 2));
+    }
+}
+
+template<typename... Sinks>
+void BasicMatchingEngine<Sinks...>::FillResting(Market& market, PriceLevel& position, OrderNode* pResting, Price price, OrderID oid, const Order& o, MatchOutcome& outcome, Quantity volume)
+{
+    const bool isBid = o.type == OrderType::Bid;
+
+    // The resting order was placed first, so the trade takes
+    // place at its price and on its side of the book
+    MatchedOrder mo
+    {
+        o.marketID,
+        isBid ? oid : pResting->id,
+        isBid ? pResting->id : oid,
+        price,
+        volume,
+        pResting->type,
+        pResting->volume - volume
+    };
+
+    NotifyMatchingEventObservers(mo);
+    INSTRUMENT_COUNT(fills, 1);
+
+    if(pResting->account != nullptr)
+    {
+        pResting->account->exposure.Reduce(price * volume);
+    }
+
+    outcome.remaining -= volume;
+    outcome.filled += volume;
+    pResting->volume -= volume;
+    position.volume -= volume;
+    market.lastTradePrice = price;
+
+    if(pResting->volume == 0)
+    {
+        position.orders.Erase(pResting);
+        --position.orderCount;
+        ReleaseOrder(pResting);
+    }
+}
+
+template<typename... Sinks>
+bool BasicMatchingEngine<Sinks...>::PreventSelfTrade(const Market& market, PriceLevel& position, OrderNode* pResting, Quantity& remaining)
+{
+    INSTRUMENT_COUNT(selfTrades, 1);
+
+    switch(market.selfTradePrevention)
+    {
+    case SelfTradePrevention::CancelOldest:
+        CancelResting(position, pResting);
+        return false;
+
+    case SelfTradePrevention::CancelBoth:
+        CancelResting(position, pResting);
+        return true;
+
+    case SelfTradePrevention::Decrement:
+    {
+        // Both orders shrink by the volume that would have traded, without
+        // a trade being reported, and whichever is used up is cancelled.
+        // The aggressor isn't on the book yet, what it is left with is only
+        // reported once it rests.
+        const Quantity decrement = std::min(remaining, pResting->volume);
+        remaining -= decrement;
+
+        if(decrement == pResting->volume)
+        {
+            CancelResting(position, pResting);
+
+        }
+        else
+        {
+            if(pResting->account != nullptr)
+            {
+                pResting->account->exposure.Reduce(market.ToPrice(pResting->tick) * decrement);
+            }
+
+            pResting->volume -= decrement;
+            position.volume -= decrement;
+
+            NotifyModifyEventObservers(ModifiedOrder{pResting->market, pResting->id, market.ToPrice(pResting->tick), pResting->volume, pResting->type});
+        }
+
+        return remaining == 0;
+    }
+
+    default:
+        return true;
+    }
+}
+
+template<typename... Sinks>
+void BasicMatchingEngine<Sinks...>::CancelResting(PriceLevel& position, OrderNode* pResting)
+{
+    position.orders.Erase(pResting);
+    position.volume -= pResting->volume;
+    --position.orderCount;
+
+    NotifyCancelEventObservers(pResting->id);
+    ReleaseOrder(pResting);
+}
+
+template<typename... Sinks>
+void BasicMatchingEngine<Sinks...>::RecordDepthChange(MarketID market, OrderType side, Price price, const PriceLevel& level)
+{
+    if(m_muted)
+    {
+        return;
+    }
+
+    // Successive changes to the same level, as when a sweep works through
+    // the orders at one price, collapse in to a single update
+    if(!m_depthUpdates.empty())
+    {
+        DepthUpdate& last = m_depthUpdates.back();
+
+        if(last.market == market && last.side == side && last.price == price)
+        {
+            last.volume = level.volume;
+            last.orderCount = level.orderCount;
+            return;
+        }
+    }
+
+    m_depthUpdates.push_back(DepthUpdate{market, side, price, level.volume, level.orderCount});
+}
+
+template<typename... Sinks>
+void BasicMatchingEngine<Sinks...>::PublishDepthUpdates()
+{
+    if(m_depthUpdates.empty())
+    {
+        return;
+    }
+
+    INSTRUMENT_BEGIN(notifyStart);
+
+    const DepthUpdate* updates = m_depthUpdates.data();
+    const size_t count = m_depthUpdates.size();
+
+    std::apply([updates, count](auto&... sinks)
+    {
+        (sinks.OnDepthUpdate(updates, count), ...);
+    }, m_sinks);
+
+    INSTRUMENT_END(notifyStart, EngineStage::Notify);
+
+    m_depthUpdates.clear();
+}
+
+template<typename... Sinks>
+void BasicMatchingEngine<Sinks...>::NotifyOrderBookEventObservers(OrderID oid, const Order& mo)
+{
+    if(m_muted)
+    {
+        return;
+    }
+
+    INSTRUMENT_BEGIN(notifyStart);
+
+    std::apply([oid, &mo](auto&... sinks)
+    {
+        (sinks.OnNewOrder(oid, mo), ...);
+    }, m_sinks);
+
+    INSTRUMENT_END(notifyStart, EngineStage::Notify);
+}
+
+template<typename... Sinks>
+void BasicMatchingEngine<Sinks...>::NotifyMatchingEventObservers(const MatchedOrder& mo)
+{
+    if(m_muted)
+    {
+        return;
+    }
+
+    INSTRUMENT_BEGIN(notifyStart);
+
+    std::apply([&mo](auto&... sinks)
+    {
+        (sinks.OnOrderMatched(mo), ...);
+    }, m_sinks);
+
+    INSTRUMENT_END(notifyStart, EngineStage::Notify);
+}
+
+template<typename... Sinks>
+void BasicMatchingEngine<Sinks...>::NotifyModifyEventObservers(const ModifiedOrder& mo)
+{
+    if(m_muted)
+    {
+        return;
+    }
+
+    INSTRUMENT_BEGIN(notifyStart);
+
+    std::apply([&mo](auto&... sinks)
+    {
+        (sinks.OnModifiedOrder(mo), ...);
+    }, m_sinks);
+
+    INSTRUMENT_END(notifyStart, EngineStage::Notify);
+}
+
+template<typename... Sinks>
+void BasicMatchingEngine<Sinks...>::NotifyStopTriggeredEventObservers(OrderID oid, const Order& o)
+{
+    if(m_muted)
+    {
+        return;
+    }
+
+    INSTRUMENT_BEGIN(notifyStart);
+
+    std::apply([oid, &o](auto&... sinks)
+    {
+        (sinks.OnStopTriggered(oid, o), ...);
+    }, m_sinks);
+
+    INSTRUMENT_END(notifyStart, EngineStage::Notify);
+}
+
+template<typename... Sinks>
+void BasicMatchingEngine<Sinks...>::NotifyMassCancelEventObservers()
+{
+    if(m_muted || m_cancelledOrders.empty())
+    {
+        return;
+    }
+
+    INSTRUMENT_BEGIN(notifyStart);
+
+    const OrderID* oids = m_cancelledOrders.data();
+    const size_t count = m_cancelledOrders.size();
+
+    std::apply([oids, count](auto&... sinks)
+    {
+        (sinks.OnOrdersCancelled(oids, count), ...);
+    }, m_sinks);
+
+    INSTRUMENT_END(notifyStart, EngineStage::Notify);
+}
+
+template<typename... Sinks>
+void BasicMatchingEngine<Sinks...>::NotifyCancelEventObservers(OrderID o)
+{
+    if(m_muted)
+    {
+        return;
+    }
+
+    INSTRUMENT_BEGIN(notifyStart);
+
+    std::apply([o](auto&... sinks)
+    {
+        (sinks.OnCancelledOrder(o), ...);
+    }, m_sinks);
+
+    INSTRUMENT_END(notifyStart, EngineStage::Notify);
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstddef>
+#include <memory_resource>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+// Hands out objects carved from slabs allocated in bulk from a memory
+// resource. Released objects are recycled through a free list, so once the
+// pool has grown to the peak number of live objects acquiring and releasing
+// never touch the resource.
+template<typename T>
+class ObjectPool
+{
+    // Live objects are simply abandoned when the pool goes away
+    static_assert(std::is_trivially_destructible_v<T>, "pooled objects must be trivially destructible");
+
+public:
+    explicit ObjectPool(size_t slabSize = 4096, std::pmr::memory_resource* pResource = std::pmr::get_default_resource())
+        : m_slabSize(slabSize == 0 ? 1 : slabSize)
+        , m_slabs(pResource)
+    {
+    }
+
+    ~ObjectPool()
+    {
+        std::pmr::memory_resource* pResource = m_slabs.get_allocator().resource();
+
+        for(Slot* slab : m_slabs)
+        {
+            pResource->deallocate(slab, m_slabSize * sizeof(Slot), alignof(Slot));
+        }
+    }
+
+    ObjectPool(const ObjectPool&) = delete;
+    ObjectPool& operator =(const ObjectPool&) = delete;
+
+    // Preallocates enough slabs for the given number of live objects
+    void Reserve(size_t count)
+    {
+        while(m_capacity < count)
+        {
+            AllocateSlab();
+        }
+    }
+
+    T* Acquire()
+    {
+        if(m_free == nullptr)
+        {
+            AllocateSlab();
+        }
+
+        Slot* slot = m_free;
+        m_free = slot->nextFree;
+
+        return new (slot->storage) T{};
+    }
+
+    void Release(T* object)
+    {
+        Slot* slot = reinterpret_cast<Slot*>(object);
+        slot->nextFree = m_free;
+        m_free = slot;
+    }
+
+private:
+    union Slot
+    {
+        Slot* nextFree;
+        alignas(T) unsigned char storage[sizeof(T)];
+    };
+
+    void AllocateSlab()
+    {
+        // Make room to track the slab first so that a failure can't leak it
+        m_slabs.reserve(m_slabs.size() + 1);
+
+        Slot* slab = static_cast<Slot*>(
+            m_slabs.get_allocator().resource()->allocate(m_slabSize * sizeof(Slot), alignof(Slot)));
+
+        for(size_t i = m_slabSize; i > 0; --i)
+        {
+            slab[i - 1].nextFree = m_free;
+            m_free = &slab[i - 1];
+        }
+
+        m_slabs.push_back(slab);
+        m_capacity += m_slabSize;
+    }
+
+    const size_t m_slabSize;
+    size_t m_capacity{0};
+
+    Slot* m_free{nullptr};
+    std::pmr::vector<Slot*> m_slabs;
+};
@@ -0,0 +1,270 @@
+#pragma once
+
+#include <atomic>
+#include <limits>
+#include <map>
+#include <memory>
+#include <memory_resource>
+#include <string>
+#include <utility>
+#include <variant>
+
+#include "IntrusiveList.h"
+#include "MarketArena.h"
+#include "PriceLadder.h"
+#include "PriceMap.h"
+#include "Types.h"
+
+struct PriceLevel;
+struct Account;
+
+// A resting order, queued at its price level in time priority
+struct OrderNode
+{
+    IntrusiveListHook<OrderNode> levelHook;
+    IntrusiveListHook<OrderNode> ownerHook;
+
+    PriceLevel* level{nullptr};
+
+    // Account of the order's owner, null for an order without one
+    Account* account{nullptr};
+
+    OrderID id{0};
+    MarketID market{InvalidMarketID};
+    Tick tick{0};
+    Quantity volume{0};         // volume remaining
+    OwnerID owner{NoOwner};
+    OrderType type{OrderType::Bid};
+};
+
+using OrderQueue = IntrusiveList<OrderNode, &OrderNode::levelHook>;
+using OwnerOrders = IntrusiveList<OrderNode, &OrderNode::ownerHook>;
+
+// What an owner's resting orders add up to. Only ever written by the thread
+// matching the orders, so counters are stored rather than incremented
+// atomically, and any other thread may read them without taking a lock.
+struct RiskExposure
+{
+    std::atomic<uint32_t> openOrders{0};
+    std::atomic<uint64_t> notional{0};
+
+    uint32_t GetOpenOrders() const
+    {
+        return openOrders.load(std::memory_order_relaxed);
+    }
+
+    uint64_t GetNotional() const
+    {
+        return notional.load(std::memory_order_relaxed);
+    }
+
+    void Add(uint64_t value)
+    {
+        openOrders.store(GetOpenOrders() + 1, std::memory_order_relaxed);
+        notional.store(GetNotional() + value, std::memory_order_relaxed);
+    }
+
+    void Remove(uint64_t value)
+    {
+        openOrders.store(GetOpenOrders() - 1, std::memory_order_relaxed);
+        notional.store(GetNotional() - value, std::memory_order_relaxed);
+    }
+
+    // An order that stays open trading, or being amended, changes size
+    void Increase(uint64_t value)
+    {
+        notional.store(GetNotional() + value, std::memory_order_relaxed);
+    }
+
+    void Reduce(uint64_t value)
+    {
+        notional.store(GetNotional() - value, std::memory_order_relaxed);
+    }
+};
+
+// Everything the engine keeps for one owner
+struct Account
+{
+    OwnerOrders orders;
+    RiskExposure exposure;
+    RiskLimits limits;
+};
+
+// All the orders resting at one price, earliest first
+struct PriceLevel
+{
+    PriceLevel() = default;
+
+    PriceLevel(const PriceLevel&) = delete;
+    PriceLevel& operator =(const PriceLevel&) = delete;
+
+    // Levels are relocated when a ladder recentres, so the orders
+    // queued at the level have to follow it to its new address
+    PriceLevel(PriceLevel&& other) noexcept
+        : orders(std::move(other.orders))
+        , volume(other.volume)
+        , orderCount(other.orderCount)
+    {
+        other.volume = 0;
+        other.orderCount = 0;
+        Rebind();
+    }
+
+    PriceLevel& operator =(PriceLevel&& other) noexcept
+    {
+        orders = std::move(other.orders);
+        volume = other.volume;
+        orderCount = other.orderCount;
+        other.volume = 0;
+        other.orderCount = 0;
+        Rebind();
+        return *this;
+    }
+
+    OrderQueue orders;
+
+    // Kept up to date as orders come and go so depth never has to be summed
+    Quantity volume{0};
+    uint32_t orderCount{0};
+
+private:
+    void Rebind()
+    {
+        for(OrderNode* node = orders.Front(); node != nullptr; node = OrderQueue::Next(node))
+        {
+            node->level = this;
+        }
+    }
+};
+
+// Each market consists of positions of bids and asks stored individually,
+// the layout of the positions is chosen per market
+template<template<typename, OrderType> class PriceLevels>
+struct OrderBook
+{
+    OrderBook(const MarketConfig& config, std::pmr::memory_resource* pResource)
+        : bids(config, pResource)
+        , asks(config, pResource)
+    {
+    }
+
+    PriceLevels<PriceLevel, OrderType::Bid> bids;
+    PriceLevels<PriceLevel, OrderType::Ask> asks;
+};
+
+// Stop orders of one market waiting for their trigger, by stop price. Orders
+// with the same stop price keep the order they arrived in.
+struct StopIndex
+{
+    using Orders = std::pmr::multimap<Price, OrderID>;
+
+    explicit StopIndex(std::pmr::memory_resource* pResource)
+        : buys(pResource)
+        , sells(pResource)
+    {
+    }
+
+    // Whether a trade at the price sets off any stop, the nearest trigger of
+    // each side is kept apart so a trade short of both only costs this
+    bool Triggers(Price price) const
+    {
+        return price >= nextBuy || price <= nextSell;
+    }
+
+    bool Empty() const
+    {
+        return buys.empty() && sells.empty();
+    }
+
+    Orders::iterator Insert(OrderType side, Price stopPrice, OrderID oid)
+    {
+        const Orders::iterator it = (side == OrderType::Bid ? buys : sells).emplace(stopPrice, oid);
+        Update();
+        return it;
+    }
+
+    void Erase(OrderType side, Orders::iterator it)
+    {
+        (side == OrderType::Bid ? buys : sells).erase(it);
+        Update();
+    }
+
+    void Update()
+    {
+        nextBuy = buys.empty() ? std::numeric_limits<Price>::max() : buys.begin()->first;
+        nextSell = sells.empty() ? 0 : sells.rbegin()->first;
+    }
+
+    Orders buys;    // Set off lowest first as the price rises
+    Orders sells;   // Set off highest first as the price falls
+
+    Price nextBuy{std::numeric_limits<Price>::max()};
+    Price nextSell{0};
+};
+
+struct Market
+{
+    template<typename Book>
+    Market(std::in_place_type_t<Book> layout, const MarketConfig& config, std::pmr::memory_resource* pUpstream)
+        : name(config.name)
+        , priceScale(config.priceScale)
+        , tickSize(config.tickSize == 0 ? 1 : config.tickSize)
+        , lotSize(config.lotSize == 0 ? 1 : config.lotSize)
+        , selfTradePrevention(config.selfTradePrevention)
+        , matchingPolicy(config.matchingPolicy)
+        , fifoPercent(config.fifoPercent > 100 ? 100 : config.fifoPercent)
+        , arena(std::make_unique<MarketArena>(config.arenaBytes, pUpstream))
+        , book(layout, config, arena->GetResource())
+        , stops(arena->GetResource())
+    {
+    }
+
+    // Whether an order is priced on the tick and sized in whole lots, the
+    // price of a market or stop order is ignored and a stop price of either
+    // kind of stop has to be on the tick as well
+    bool Accepts(const Order& o) const
+    {
+        return IsWholeLots(o.volume)
+            && (o.kind == OrderKind::Market || o.kind == OrderKind::Stop || IsOnTick(o.price))
+            && (!IsStop(o.kind) || IsOnTick(o.stopPrice));
+    }
+
+    bool IsOnTick(Price price) const
+    {
+        return price != 0 && (tickSize == 1 || price % tickSize == 0);
+    }
+
+    bool IsWholeLots(Quantity volume) const
+    {
+        return volume != 0 && (lotSize == 1 || volume % lotSize == 0);
+    }
+
+    Tick ToTick(Price price) const
+    {
+        return tickSize == 1 ? price : price / tickSize;
+    }
+
+    Price ToPrice(Tick tick) const
+    {
+        return tick * tickSize;
+    }
+
+    std::string name;
+    uint32_t priceScale;
+    Price tickSize;
+    Quantity lotSize;
+    SelfTradePrevention selfTradePrevention;
+    MatchingPolicy matchingPolicy;
+    uint8_t fifoPercent;
+
+    // Centre of the risk price band, zero until the market first trades
+    Price lastTradePrice{0};
+
+    // Held apart from the market so the book's containers keep pointing at
+    // it when markets are moved, and declared first so it outlives them
+    std::unique_ptr<MarketArena> arena;
+
+    std::variant<OrderBook<PriceMap>, OrderBook<PriceLadder>> book;
+
+    StopIndex stops;
+};
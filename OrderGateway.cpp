@@ -0,0 +1,342 @@
+#include "pch.h"
+
+#include <new>
+
+#include <cerrno>
+
+#ifdef Linux
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "OrderGateway.h"
+
+struct GatewaySegment::Header
+{
+    uint32_t magic{0x59574741};    // "AGWY"
+    uint32_t version{4};
+    uint32_t channelCount{0};
+    uint32_t ringCapacity{0};
+    std::atomic<uint32_t> stop{0};
+};
+
+namespace
+{
+    constexpr size_t CacheLine{64};
+
+    size_t RoundUp(size_t bytes, size_t multiple)
+    {
+        return (bytes + multiple - 1) / multiple * multiple;
+    }
+
+    uint32_t RoundUpToPowerOfTwo(uint32_t value)
+    {
+        uint32_t result{2};
+
+        while(result < value)
+        {
+            result <<= 1;
+        }
+
+        return result;
+    }
+
+    // Shared memory object names have to start with a slash
+    std::string ObjectName(const std::string& name)
+    {
+        return name.empty() || name.front() != '/' ? "/" + name : name;
+    }
+
+    // Written in to the owner flag of the channel a client claims
+    uint32_t CurrentProcess()
+    {
+#ifdef Linux
+        return static_cast<uint32_t>(getpid());
+#else
+        return 1;
+#endif
+    }
+
+    // Whether the process holding a channel has gone without releasing it
+    bool HasExited(uint32_t process)
+    {
+#ifdef Linux
+        return process != 0 && kill(static_cast<pid_t>(process), 0) != 0 && errno == ESRCH;
+#else
+        (void)process;
+        return false;
+#endif
+    }
+}
+
+GatewaySegment::~GatewaySegment()
+{
+    Close();
+}
+
+size_t GatewaySegment::ChannelBytes(uint32_t ringCapacity)
+{
+    // The owner flag and generation get a cache line of their own ahead of the two rings
+    return CacheLine
+        + RoundUp(SharedRing<GatewayRequest>::BytesFor(ringCapacity), CacheLine)
+        + RoundUp(SharedRing<GatewayResponse>::BytesFor(ringCapacity), CacheLine);
+}
+
+bool GatewaySegment::Create(const GatewayConfig& config)
+{
+    Close();
+
+#ifdef Linux
+    const std::string name = ObjectName(config.name);
+    const uint32_t channelCount = config.maxClients == 0 ? 1 : config.maxClients;
+    const uint32_t ringCapacity = RoundUpToPowerOfTwo(config.ringCapacity);
+    const size_t size = RoundUp(sizeof(Header), CacheLine) + channelCount * ChannelBytes(ringCapacity);
+
+    shm_unlink(name.c_str());
+
+    const int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+
+    if(fd < 0)
+    {
+        return false;
+    }
+
+    if(ftruncate(fd, static_cast<off_t>(size)) != 0)
+    {
+        close(fd);
+        shm_unlink(name.c_str());
+        return false;
+    }
+
+    void* pMapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+    close(fd);
+
+    if(pMapping == MAP_FAILED)
+    {
+        shm_unlink(name.c_str());
+        return false;
+    }
+
+    m_size = size;
+    m_name = name;
+    m_owner = true;
+
+    m_pHeader = new (pMapping) Header{};
+    m_pHeader->channelCount = channelCount;
+    m_pHeader->ringCapacity = ringCapacity;
+
+    for(uint32_t channel = 0; channel < channelCount; ++channel)
+    {
+        unsigned char* pChannel = GetChannel(channel);
+        new (pChannel) std::atomic<uint32_t>{0};
+        new (pChannel + sizeof(std::atomic<uint32_t>)) std::atomic<uint32_t>{0};
+        new (pChannel + CacheLine) SharedRing<GatewayRequest>::Control{};
+        new (pChannel + CacheLine + RoundUp(SharedRing<GatewayRequest>::BytesFor(ringCapacity), CacheLine)) SharedRing<GatewayResponse>::Control{};
+    }
+
+    return true;
+#else
+    (void)config;
+    return false;
+#endif
+}
+
+bool GatewaySegment::Attach(const std::string& segmentName)
+{
+    Close();
+
+#ifdef Linux
+    const std::string name = ObjectName(segmentName);
+    const int fd = shm_open(name.c_str(), O_RDWR, 0);
+
+    if(fd < 0)
+    {
+        return false;
+    }
+
+    struct stat status;
+
+    if(fstat(fd, &status) != 0 || status.st_size < static_cast<off_t>(sizeof(Header)))
+    {
+        close(fd);
+        return false;
+    }
+
+    const size_t size = static_cast<size_t>(status.st_size);
+    void* pMapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+    close(fd);
+
+    if(pMapping == MAP_FAILED)
+    {
+        return false;
+    }
+
+    m_pHeader = static_cast<Header*>(pMapping);
+    m_size = size;
+    m_name = name;
+    m_owner = false;
+
+    // A gateway still laying out the segment fails the size check
+    const Header expected;
+
+    if(    m_pHeader->magic != expected.magic
+        || m_pHeader->version != expected.version
+        || RoundUp(sizeof(Header), CacheLine) + m_pHeader->channelCount * ChannelBytes(m_pHeader->ringCapacity) != m_size)
+    {
+        Close();
+        return false;
+    }
+
+    return true;
+#else
+    (void)segmentName;
+    return false;
+#endif
+}
+
+void GatewaySegment::Close()
+{
+#ifdef Linux
+    if(m_pHeader != nullptr)
+    {
+        munmap(m_pHeader, m_size);
+
+        if(m_owner)
+        {
+            shm_unlink(m_name.c_str());
+        }
+    }
+#endif
+
+    m_pHeader = nullptr;
+    m_size = 0;
+    m_name.clear();
+    m_owner = false;
+}
+
+uint32_t GatewaySegment::GetChannelCount() const
+{
+    return m_pHeader->channelCount;
+}
+
+unsigned char* GatewaySegment::GetChannel(uint32_t channel) const
+{
+    return reinterpret_cast<unsigned char*>(m_pHeader)
+        + RoundUp(sizeof(Header), CacheLine)
+        + channel * ChannelBytes(m_pHeader->ringCapacity);
+}
+
+std::atomic<uint32_t>& GatewaySegment::GetChannelOwner(uint32_t channel)
+{
+    return *reinterpret_cast<std::atomic<uint32_t>*>(GetChannel(channel));
+}
+
+std::atomic<uint32_t>& GatewaySegment::GetChannelGeneration(uint32_t channel)
+{
+    return *reinterpret_cast<std::atomic<uint32_t>*>(GetChannel(channel) + sizeof(std::atomic<uint32_t>));
+}
+
+SharedRing<GatewayRequest> GatewaySegment::GetRequests(uint32_t channel)
+{
+    return SharedRing<GatewayRequest>(GetChannel(channel) + CacheLine, m_pHeader->ringCapacity);
+}
+
+SharedRing<GatewayResponse> GatewaySegment::GetResponses(uint32_t channel)
+{
+    const size_t offset = CacheLine + RoundUp(SharedRing<GatewayRequest>::BytesFor(m_pHeader->ringCapacity), CacheLine);
+    return SharedRing<GatewayResponse>(GetChannel(channel) + offset, m_pHeader->ringCapacity);
+}
+
+std::atomic<uint32_t>& GatewaySegment::GetStopFlag()
+{
+    return m_pHeader->stop;
+}
+
+bool OrderGateway::Open(const GatewayConfig& config)
+{
+    Close();
+
+    if(!m_segment.Create(config))
+    {
+        return false;
+    }
+
+    for(uint32_t channel = 0; channel < m_segment.GetChannelCount(); ++channel)
+    {
+        m_channels.push_back(Channel{m_segment.GetRequests(channel), m_segment.GetResponses(channel)});
+    }
+
+    return true;
+}
+
+void OrderGateway::Close()
+{
+    m_channels.clear();
+    m_nextChannel = 0;
+    m_segment.Close();
+}
+
+GatewayClient::~GatewayClient()
+{
+    Detach();
+}
+
+bool GatewayClient::Attach(const std::string& name)
+{
+    Detach();
+
+    if(!m_segment.Attach(name))
+    {
+        return false;
+    }
+
+    const uint32_t process = CurrentProcess();
+
+    for(uint32_t channel = 0; channel < m_segment.GetChannelCount(); ++channel)
+    {
+        std::atomic<uint32_t>& owner = m_segment.GetChannelOwner(channel);
+        uint32_t holder{0};
+
+        // A channel still held by a client that died is taken over, only
+        // one of the clients that notice can swap its own process in
+        if(    owner.compare_exchange_strong(holder, process, std::memory_order_acq_rel)
+            || (HasExited(holder) && owner.compare_exchange_strong(holder, process, std::memory_order_acq_rel)))
+        {
+            m_channel = channel;
+            m_attached = true;
+            m_requests = m_segment.GetRequests(channel);
+            m_responses = m_segment.GetResponses(channel);
+
+            // Anything a previous client left unread, or has yet to be
+            // answered, carries an earlier generation and is dropped
+            m_generation = m_segment.GetChannelGeneration(channel).fetch_add(1, std::memory_order_relaxed) + 1;
+
+            return true;
+        }
+    }
+
+    m_segment.Close();
+    return false;
+}
+
+void GatewayClient::Detach()
+{
+    if(m_attached)
+    {
+        m_segment.GetChannelOwner(m_channel).store(0, std::memory_order_release);
+        m_attached = false;
+    }
+
+    m_segment.Close();
+}
+
+void GatewayClient::RequestStop()
+{
+    if(m_segment.IsOpen())
+    {
+        m_segment.GetStopFlag().store(1, std::memory_order_release);
+    }
+}
@@ -0,0 +1,352 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "Types.h"
+
+enum class GatewayRequestType : uint8_t
+{
+    Place,
+    Cancel,
+    Modify,
+    MassCancel      // Every order of owner, limited to market when it is set
+};
+
+// Fixed layout messages exchanged with the gateway through shared memory.
+// Markets are addressed by ID, so clients have to agree with the engine on
+// the order its markets were initialised in.
+struct GatewayRequest
+{
+    uint64_t correlationID{0};  // Echoed back in the response
+    OrderID oid{0};             // Order to cancel or modify
+    Price price{0};
+    Price stopPrice{0};
+    Quantity volume{0};
+    MarketID market{InvalidMarketID};
+    OwnerID owner{NoOwner};
+    uint32_t generation{0};     // Filled in by the client, echoed back in the response
+    OrderType side{OrderType::Bid};
+    GatewayRequestType type{GatewayRequestType::Place};
+    TimeInForce timeInForce{TimeInForce::GoodTillCancel};
+    OrderKind kind{OrderKind::Limit};
+};
+
+struct GatewayResponse
+{
+    uint64_t correlationID{0};
+
+    // ID given to a placed order, or the order cancelled or modified.
+    // A placement that was never accepted carries NoOrderID.
+    OrderID oid{0};
+
+    OrderRequestResult result;
+    uint32_t generation{0};
+    GatewayRequestType type{GatewayRequestType::Place};
+};
+
+constexpr OrderID NoOrderID{UINT64_MAX};
+
+static_assert(std::is_trivially_copyable<GatewayRequest>::value, "gateway messages are copied through shared memory");
+static_assert(std::is_trivially_copyable<GatewayResponse>::value, "gateway messages are copied through shared memory");
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared memory needs address free atomics");
+
+// Single producer, single consumer ring laid out in memory shared between two
+// processes. Each side keeps a private copy of the other's position and only
+// rereads it once the ring looks full or empty, so in the common case a push
+// or pop touches nothing but the slot and its own position.
+template<typename T>
+class SharedRing
+{
+public:
+    struct Control
+    {
+        alignas(64) std::atomic<uint64_t> head;
+        alignas(64) std::atomic<uint64_t> tail;
+    };
+
+    static size_t BytesFor(size_t capacity)
+    {
+        return sizeof(Control) + capacity * sizeof(T);
+    }
+
+    SharedRing() = default;
+
+    // Capacity has to be a power of two
+    SharedRing(void* pMemory, size_t capacity)
+        : m_pControl(static_cast<Control*>(pMemory))
+        , m_pSlots(reinterpret_cast<T*>(static_cast<unsigned char*>(pMemory) + sizeof(Control)))
+        , m_mask(capacity - 1)
+        , m_cachedHead(m_pControl->head.load(std::memory_order_acquire))
+        , m_cachedTail(m_pControl->tail.load(std::memory_order_acquire))
+    {
+    }
+
+    // Only ever called by the producing process, fails when the ring is full
+    bool TryPush(const T& value)
+    {
+        const uint64_t head = m_pControl->head.load(std::memory_order_relaxed);
+
+        if(head - m_cachedTail > m_mask)
+        {
+            m_cachedTail = m_pControl->tail.load(std::memory_order_acquire);
+
+            if(head - m_cachedTail > m_mask)
+            {
+                return false;
+            }
+        }
+
+        m_pSlots[head & m_mask] = value;
+        m_pControl->head.store(head + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    bool HasRoom()
+    {
+        const uint64_t head = m_pControl->head.load(std::memory_order_relaxed);
+
+        if(head - m_cachedTail > m_mask)
+        {
+            m_cachedTail = m_pControl->tail.load(std::memory_order_acquire);
+        }
+
+        return head - m_cachedTail <= m_mask;
+    }
+
+    // Only ever called by the consuming process
+    bool TryPop(T& value)
+    {
+        const uint64_t tail = m_pControl->tail.load(std::memory_order_relaxed);
+
+        if(tail == m_cachedHead)
+        {
+            m_cachedHead = m_pControl->head.load(std::memory_order_acquire);
+
+            if(tail == m_cachedHead)
+            {
+                return false;
+            }
+        }
+
+        value = m_pSlots[tail & m_mask];
+        m_pControl->tail.store(tail + 1, std::memory_order_release);
+
+        return true;
+    }
+
+private:
+    Control* m_pControl{nullptr};
+    T* m_pSlots{nullptr};
+    uint64_t m_mask{0};
+
+    uint64_t m_cachedHead{0};
+    uint64_t m_cachedTail{0};
+};
+
+// Shared memory segment holding a request and a response ring for each client
+// slot. Created by the gateway, which unlinks it again when closed.
+class GatewaySegment
+{
+public:
+    GatewaySegment() = default;
+    ~GatewaySegment();
+
+    GatewaySegment(const GatewaySegment&) = delete;
+    GatewaySegment& operator =(const GatewaySegment&) = delete;
+
+    bool Create(const GatewayConfig& config);
+    bool Attach(const std::string& name);
+    void Close();
+
+    bool IsOpen() const
+    {
+        return m_pHeader != nullptr;
+    }
+
+    uint32_t GetChannelCount() const;
+
+    // Process ID of the client holding the channel, zero while it is free
+    std::atomic<uint32_t>& GetChannelOwner(uint32_t channel);
+
+    // Counts the clients that have attached to the channel, so responses to
+    // requests left behind by an earlier client can be told apart
+    std::atomic<uint32_t>& GetChannelGeneration(uint32_t channel);
+
+    SharedRing<GatewayRequest> GetRequests(uint32_t channel);
+    SharedRing<GatewayResponse> GetResponses(uint32_t channel);
+
+    // Set by a client to ask the gateway's host to shut down
+    std::atomic<uint32_t>& GetStopFlag();
+
+private:
+    struct Header;
+
+    unsigned char* GetChannel(uint32_t channel) const;
+
+    static size_t ChannelBytes(uint32_t ringCapacity);
+
+    Header* m_pHeader{nullptr};
+    size_t m_size{0};
+    std::string m_name;
+    bool m_owner{false};
+};
+
+// Order entry for processes on the same host. Requests are picked up from
+// every attached client's ring by whichever thread drives the engine and
+// answered on that client's response ring, so a round trip costs a handful
+// of cache line transfers and no system calls.
+class OrderGateway
+{
+public:
+    // Creates the segment, replacing any left behind by a gateway that died
+    bool Open(const GatewayConfig& config);
+    void Close();
+
+    bool IsStopRequested()
+    {
+        return m_segment.IsOpen() && m_segment.GetStopFlag().load(std::memory_order_acquire) != 0;
+    }
+
+    // Handles up to maxRequests waiting requests, called on the engine's
+    // own thread. Clients are served in turn so none can starve the rest,
+    // and a client whose response ring is full is skipped until it drains.
+    // Returns the number of requests handled.
+    template<typename Engine>
+    size_t Poll(Engine& engine, size_t maxRequests = 64);
+
+private:
+    struct Channel
+    {
+        SharedRing<GatewayRequest> requests;
+        SharedRing<GatewayResponse> responses;
+    };
+
+    template<typename Engine>
+    GatewayResponse Handle(Engine& engine, const GatewayRequest& request);
+
+    GatewaySegment m_segment;
+    std::vector<Channel> m_channels;
+    uint32_t m_nextChannel{0};
+};
+
+// A client's end of the gateway, used from one thread only
+class GatewayClient
+{
+public:
+    ~GatewayClient();
+
+    // Claims a free client slot, fails if there is no gateway or every slot is
+    // taken. A slot held by a process that has exited without detaching is
+    // free to claim, unless its process ID has already been reused.
+    bool Attach(const std::string& name);
+    void Detach();
+
+    bool TrySend(const GatewayRequest& request)
+    {
+        GatewayRequest stamped{request};
+        stamped.generation = m_generation;
+
+        return m_requests.TryPush(stamped);
+    }
+
+    // Requests a previous client of the slot left queued are still handled,
+    // their responses are dropped here rather than passed on as this client's
+    bool TryReceive(GatewayResponse& response)
+    {
+        while(m_responses.TryPop(response))
+        {
+            if(response.generation == m_generation)
+            {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    void RequestStop();
+
+private:
+    GatewaySegment m_segment;
+    uint32_t m_channel{0};
+    uint32_t m_generation{0};
+    bool m_attached{false};
+
+    SharedRing<GatewayRequest> m_requests;
+    SharedRing<GatewayResponse> m_responses;
+};
+
+template<typename Engine>
+size_t OrderGateway::Poll(Engine& engine, size_t maxRequests)
+{
+    size_t handled{0};
+    size_t idle{0};
+
+    while(handled < maxRequests && idle < m_channels.size())
+    {
+        const uint32_t index = m_nextChannel;
+        m_nextChannel = m_nextChannel + 1 == m_channels.size() ? 0 : m_nextChannel + 1;
+
+        Channel& channel = m_channels[index];
+        GatewayRequest request;
+
+        if(!channel.responses.HasRoom() || !channel.requests.TryPop(request))
+        {
+            ++idle;
+            continue;
+        }
+
+        idle = 0;
+        channel.responses.TryPush(Handle(engine, request));
+        ++handled;
+    }
+
+    return handled;
+}
+
+template<typename Engine>
+GatewayResponse OrderGateway::Handle(Engine& engine, const GatewayRequest& request)
+{
+    GatewayResponse response;
+    response.correlationID = request.correlationID;
+    response.generation = request.generation;
+    response.type = request.type;
+    response.oid = request.oid;
+
+    if(request.type == GatewayRequestType::Place)
+    {
+        Order o;
+        o.price = request.price;
+        o.volume = request.volume;
+        o.type = request.side;
+        o.timeInForce = request.timeInForce;
+        o.kind = request.kind;
+        o.owner = request.owner;
+        o.stopPrice = request.stopPrice;
+
+        // An order only takes an ID when the engine accepts it
+        const OrderID oid = engine.GetNextOrderID();
+        response.result.placed = engine.OnOrderPlace(request.market, std::move(o));
+        response.oid = engine.GetNextOrderID() != oid ? oid : NoOrderID;
+    }
+    else if(request.type == GatewayRequestType::Cancel)
+    {
+        response.result.cancelled = engine.OnOrderCancel(request.oid);
+    }
+    else if(request.type == GatewayRequestType::MassCancel)
+    {
+        response.result.cancelled = engine.OnMassCancel(request.owner, request.market);
+    }
+    else
+    {
+        response.result.modified = engine.OnOrderModify(request.oid, request.price, request.volume);
+    }
+
+    return response;
+}
@@ -0,0 +1,199 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <memory_resource>
+#include <new>
+#include <vector>
+
+#include "Types.h"
+
+// Maps order IDs straight to the object they refer to. IDs are issued densely
+// and in order from a first ID, so entries live in fixed size chunks addressed
+// directly by the offset from it rather than in a tree or hash. A chunk is
+// recycled once every order in it has gone and no later IDs can land in it,
+// keeping memory bounded by the span of live IDs rather than every ID issued.
+template<typename T>
+class OrderIndex
+{
+public:
+    explicit OrderIndex(size_t reservedIDs = 0, OrderID firstID = 0, std::pmr::memory_resource* pResource = std::pmr::get_default_resource())
+        : m_firstID(firstID)
+        , m_chunks(pResource)
+        , m_spareChunks(pResource)
+    {
+        Reserve(reservedIDs);
+    }
+
+    ~OrderIndex()
+    {
+        for(Chunk* chunk : m_chunks)
+        {
+            FreeChunk(chunk);
+        }
+
+        for(Chunk* chunk : m_spareChunks)
+        {
+            FreeChunk(chunk);
+        }
+    }
+
+    OrderIndex(const OrderIndex&) = delete;
+    OrderIndex& operator =(const OrderIndex&) = delete;
+
+    // Preallocates chunks for the given number of IDs
+    void Reserve(size_t ids)
+    {
+        const size_t chunks = (ids + ChunkSize - 1) / ChunkSize;
+
+        m_chunks.reserve(chunks);
+        m_spareChunks.reserve(chunks);
+
+        while(m_spareChunks.size() < chunks)
+        {
+            m_spareChunks.push_back(AllocateChunk());
+        }
+    }
+
+    T* Find(OrderID oid) const
+    {
+        if(oid < m_firstID)
+        {
+            return nullptr;
+        }
+
+        const size_t chunk = ChunkOf(oid);
+
+        if(chunk >= m_chunks.size() || !m_chunks[chunk])
+        {
+            return nullptr;
+        }
+
+        return m_chunks[chunk]->entries[SlotOf(oid)];
+    }
+
+    void Insert(OrderID oid, T* value)
+    {
+        const size_t chunk = ChunkOf(oid);
+
+        if(chunk >= m_chunks.size())
+        {
+            GrowTo(chunk);
+        }
+        else if(!m_chunks[chunk])
+        {
+            // Only when IDs arrive out of order, as when restoring a snapshot
+            m_chunks[chunk] = TakeSpareChunk();
+        }
+
+        Chunk& c = *m_chunks[chunk];
+        T*& entry = c.entries[SlotOf(oid)];
+
+        if(entry == nullptr)
+        {
+            ++c.live;
+        }
+
+        entry = value;
+    }
+
+    void Erase(OrderID oid)
+    {
+        if(oid < m_firstID)
+        {
+            return;
+        }
+
+        const size_t chunk = ChunkOf(oid);
+
+        if(chunk >= m_chunks.size() || !m_chunks[chunk])
+        {
+            return;
+        }
+
+        Chunk& c = *m_chunks[chunk];
+        T*& entry = c.entries[SlotOf(oid)];
+
+        if(entry == nullptr)
+        {
+            return;
+        }
+
+        entry = nullptr;
+
+        if(--c.live == 0 && chunk + 1 < m_chunks.size())
+        {
+            Recycle(chunk);
+        }
+    }
+
+private:
+    static constexpr size_t ChunkBits = 16;
+    static constexpr size_t ChunkSize = size_t{1} << ChunkBits;
+
+    struct Chunk
+    {
+        std::array<T*, ChunkSize> entries{};
+        size_t live{0};
+    };
+
+    size_t ChunkOf(OrderID oid) const
+    {
+        return static_cast<size_t>((oid - m_firstID) >> ChunkBits);
+    }
+
+    size_t SlotOf(OrderID oid) const
+    {
+        return static_cast<size_t>((oid - m_firstID) & (ChunkSize - 1));
+    }
+
+    void GrowTo(size_t chunk)
+    {
+        // The chunk that was being filled won't see any more IDs
+        if(!m_chunks.empty() && m_chunks.back() && m_chunks.back()->live == 0)
+        {
+            Recycle(m_chunks.size() - 1);
+        }
+
+        m_chunks.resize(chunk + 1);
+        m_chunks[chunk] = TakeSpareChunk();
+    }
+
+    Chunk* AllocateChunk()
+    {
+        void* storage = m_chunks.get_allocator().resource()->allocate(sizeof(Chunk), alignof(Chunk));
+        return new (storage) Chunk{};
+    }
+
+    void FreeChunk(Chunk* chunk)
+    {
+        if(chunk != nullptr)
+        {
+            m_chunks.get_allocator().resource()->deallocate(chunk, sizeof(Chunk), alignof(Chunk));
+        }
+    }
+
+    Chunk* TakeSpareChunk()
+    {
+        if(m_spareChunks.empty())
+        {
+            return AllocateChunk();
+        }
+
+        Chunk* chunk = m_spareChunks.back();
+        m_spareChunks.pop_back();
+        return chunk;
+    }
+
+    void Recycle(size_t chunk)
+    {
+        m_spareChunks.push_back(m_chunks[chunk]);
+        m_chunks[chunk] = nullptr;
+    }
+
+    const OrderID m_firstID;
+
+    // Indexed by offset / ChunkSize, null where chunks have been recycled
+    std::pmr::vector<Chunk*> m_chunks;
+    std::pmr::vector<Chunk*> m_spareChunks;
+};
@@ -0,0 +1,342 @@
+#include "pch.h"
+
+#include <algorithm>
+#include <functional>
+#include <queue>
+#include <thread>
+#include <tuple>
+
+#include "MatchingEngine.h"
+#include "ParallelReplay.h"
+
+namespace
+{
+    // Collects the fills of the market being replayed, tagged with the
+    // position of the input that caused them
+    struct ReplayFillSink : public NullEventSink
+    {
+        void OnOrderMatched(const MatchedOrder& mo)
+        {
+            pFills->push_back(ReplayFill{sequence, mo});
+            pFills->back().fill.market = market;
+        }
+
+        std::vector<ReplayFill>* pFills{nullptr};
+        uint64_t sequence{0};
+        MarketID market{InvalidMarketID};
+    };
+
+    using ReplayEngine = BasicMatchingEngine<ReplayFillSink>;
+}
+
+struct ParallelReplay::Partition
+{
+    Partition(MarketID id, size_t chunksInFlight)
+        : market(id)
+        , chunks(chunksInFlight)
+    {
+    }
+
+    const MarketID market;
+    uint64_t orders{0};
+
+    // Filled by the reading thread, an empty chunk marks the end
+    MPSCQueue<Chunk> chunks;
+    Chunk filling;
+
+    // Chunks waiting, so threads can pass over a partition with nothing
+    // to replay without having to claim it first
+    std::atomic<size_t> queued{0};
+
+    // Held by the thread replaying the partition, which makes it the
+    // consumer of its chunks and the only one to touch what follows
+    std::atomic<bool> claimed{false};
+
+    std::unique_ptr<ReplayEngine> pEngine;
+    bool finished{false};
+
+    std::vector<ReplayFill> fills;
+};
+
+ParallelReplay::ParallelReplay(const std::vector<MarketConfig>& markets, const ReplayConfig& config)
+    : m_marketConfigs(markets)
+    , m_config(config)
+    , m_threadCount(std::max<size_t>(std::min<size_t>(config.threadCount == 0 ? std::thread::hardware_concurrency() : config.threadCount, markets.size()), 1))
+    , m_spare(m_threadCount * config.chunksInFlight + 2)
+{
+}
+
+ParallelReplay::~ParallelReplay() = default;
+
+bool ParallelReplay::Run(const std::string& path)
+{
+    m_partitions.clear();
+    m_partitionsFinished.store(0, std::memory_order_relaxed);
+    m_chunksInFlight.store(0, std::memory_order_relaxed);
+    m_fills.clear();
+    m_recordsReplayed = 0;
+
+    for(MarketID market = 0; market < m_marketConfigs.size(); ++market)
+    {
+        m_partitions.push_back(std::make_unique<Partition>(market, m_config.chunksInFlight));
+    }
+
+    if(!CountOrders(path))
+    {
+        return false;
+    }
+
+    std::vector<std::thread> threads;
+    threads.reserve(m_threadCount);
+
+    for(size_t thread = 0; thread < m_threadCount; ++thread)
+    {
+        threads.emplace_back(&ParallelReplay::Work, this, thread * m_partitions.size() / m_threadCount);
+    }
+
+    // The calling thread reads the journal while the others replay it
+    const bool distributed = Distribute(path);
+
+    for(std::thread& thread : threads)
+    {
+        thread.join();
+    }
+
+    MergeFills();
+
+    return distributed;
+}
+
+bool ParallelReplay::CountOrders(const std::string& path)
+{
+    JournalReader journal;
+
+    if(!journal.Open(path))
+    {
+        return false;
+    }
+
+    JournalRecord record;
+
+    while(journal.Next(record))
+    {
+        if(record.type == JournalRecordType::Place && record.market < m_partitions.size())
+        {
+            ++m_partitions[record.market]->orders;
+        }
+    }
+
+    return true;
+}
+
+bool ParallelReplay::Distribute(const std::string& path)
+{
+    JournalReader journal;
+    const bool opened = journal.Open(path);
+
+    Input input;
+
+    while(opened && journal.Next(input.record))
+    {
+        input.sequence = m_recordsReplayed++;
+
+        const MarketID market = input.record.market;
+
+        if(market < m_partitions.size())
+        {
+            Append(*m_partitions[market], input);
+        }
+        else if(input.record.type == JournalRecordType::MassCancel)
+        {
+            for(const std::unique_ptr<Partition>& pPartition : m_partitions)
+            {
+                Append(*pPartition, input);
+            }
+        }
+    }
+
+    // Partitions are always told the journal has ended, even if it couldn't
+    // be opened a second time, so the threads never wait on it forever
+    for(const std::unique_ptr<Partition>& pPartition : m_partitions)
+    {
+        if(!pPartition->filling.empty())
+        {
+            Send(*pPartition, std::move(pPartition->filling));
+            pPartition->filling.clear();
+        }
+
+        Send(*pPartition, Chunk{});
+    }
+
+    return opened;
+}
+
+void ParallelReplay::Append(Partition& partition, const Input& input)
+{
+    // Chunks are reused once they have been replayed, new ones grow as they
+    // fill so markets with few inputs hold on to little
+    if(partition.filling.empty())
+    {
+        m_spare.TryPop(partition.filling);
+    }
+
+    partition.filling.push_back(input);
+
+    if(partition.filling.size() >= m_config.chunkRecords)
+    {
+        Send(partition, std::move(partition.filling));
+        partition.filling.clear();
+    }
+}
+
+void ParallelReplay::Send(Partition& partition, Chunk&& chunk)
+{
+    // The end marker is always let through, it holds no records
+    if(!chunk.empty())
+    {
+        while(m_chunksInFlight.load(std::memory_order_acquire) >= m_threadCount * m_config.chunksInFlight)
+        {
+            std::this_thread::yield();
+        }
+
+        m_chunksInFlight.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    while(!partition.chunks.TryPush(std::move(chunk)))
+    {
+        std::this_thread::yield();
+    }
+
+    partition.queued.fetch_add(1, std::memory_order_release);
+}
+
+void ParallelReplay::Work(size_t first)
+{
+    const size_t count = m_partitions.size();
+
+    while(m_partitionsFinished.load(std::memory_order_acquire) < count)
+    {
+        bool replayed{false};
+
+        for(size_t offset = 0; offset < count; ++offset)
+        {
+            Partition& partition = *m_partitions[(first + offset) % count];
+            bool claimed{false};
+
+            if(    partition.queued.load(std::memory_order_acquire) == 0
+                || !partition.claimed.compare_exchange_strong(claimed, true, std::memory_order_acquire))
+            {
+                continue;
+            }
+
+            replayed = Drain(partition) || replayed;
+            partition.claimed.store(false, std::memory_order_release);
+        }
+
+        if(!replayed)
+        {
+            std::this_thread::yield();
+        }
+    }
+}
+
+bool ParallelReplay::Drain(Partition& partition)
+{
+    bool replayed{false};
+    Chunk chunk;
+
+    while(!partition.finished && partition.chunks.TryPop(chunk))
+    {
+        partition.queued.fetch_sub(1, std::memory_order_relaxed);
+        replayed = true;
+
+        if(chunk.empty())
+        {
+            partition.finished = true;
+            m_partitionsFinished.fetch_add(1, std::memory_order_release);
+            break;
+        }
+
+        if(!partition.pEngine)
+        {
+            EngineConfig config{m_config.engine};
+            config.reservedOrders = std::min<size_t>(config.reservedOrders, partition.orders);
+
+            // The engine only holds this market, as its market 0
+            partition.pEngine = std::make_unique<ReplayEngine>(config);
+            partition.pEngine->InitialiseMarkets(std::vector<MarketConfig>{m_marketConfigs[partition.market]});
+
+            ReplayFillSink& sink = partition.pEngine->GetSink<ReplayFillSink>();
+            sink.pFills = &partition.fills;
+            sink.market = partition.market;
+        }
+
+        ReplayFillSink& sink = partition.pEngine->GetSink<ReplayFillSink>();
+
+        for(const Input& input : chunk)
+        {
+            JournalRecord record{input.record};
+
+            if(record.market == partition.market)
+            {
+                record.market = 0;
+            }
+
+            sink.sequence = input.sequence;
+            partition.pEngine->Apply(record);
+        }
+
+        // Dropped if the spares are full, which only happens while chunks
+        // are still being allocated
+        chunk.clear();
+        m_spare.TryPush(std::move(chunk));
+        m_chunksInFlight.fetch_sub(1, std::memory_order_release);
+    }
+
+    return replayed;
+}
+
+void ParallelReplay::MergeFills()
+{
+    // Every fill of one input is in the same market, so fills sharing a
+    // sequence are only ever found together in a single partition
+    using Head = std::tuple<uint64_t, size_t, size_t>;     // sequence, partition, fill
+    std::priority_queue<Head, std::vector<Head>, std::greater<Head>> heads;
+
+    size_t total{0};
+
+    for(size_t partition = 0; partition < m_partitions.size(); ++partition)
+    {
+        const std::vector<ReplayFill>& fills = m_partitions[partition]->fills;
+        total += fills.size();
+
+        if(!fills.empty())
+        {
+            heads.emplace(fills.front().sequence, partition, 0);
+        }
+    }
+
+    m_fills.reserve(total);
+
+    while(!heads.empty())
+    {
+        const auto [sequence, partition, fill] = heads.top();
+        heads.pop();
+
+        // Take the partition's whole run of fills for this input at once
+        const std::vector<ReplayFill>& fills = m_partitions[partition]->fills;
+        size_t next = fill;
+
+        while(next < fills.size() && fills[next].sequence == sequence)
+        {
+            m_fills.push_back(fills[next++]);
+        }
+
+        if(next < fills.size())
+        {
+            heads.emplace(fills[next].sequence, partition, next);
+        }
+    }
+
+    m_partitions.clear();
+}
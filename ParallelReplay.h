@@ -0,0 +1,107 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Journal.h"
+#include "MPSCQueue.h"
+#include "Types.h"
+
+// A fill produced by replay, with the position in the journal of the input
+// that caused it
+struct ReplayFill
+{
+    uint64_t sequence{0};
+    MatchedOrder fill;
+};
+
+// Offline replay of a journal across many threads for backtesting. Markets
+// never share orders, so each market is replayed through an engine of its own
+// that holds it alone, and its inputs are applied there in their original
+// order. The journal is streamed in to a bounded queue of chunks per market,
+// and the threads claim whichever market has chunks waiting, replay them and
+// let it go again, so a market that turns out to be expensive only ever ties
+// up one thread while the others carry on with the rest. The fills of every
+// market are finally merged back in journal order, which leaves them exactly
+// as a single engine would have produced them.
+//
+// Risk limits are not applied, every input in a journal was already accepted.
+class ParallelReplay
+{
+public:
+    // Markets have to be given as they were initialised in the engine that
+    // wrote the journal, which records them by ID
+    ParallelReplay(const std::vector<MarketConfig>& markets, const ReplayConfig& config);
+    ~ParallelReplay();
+
+    ParallelReplay(const ParallelReplay&) = delete;
+    ParallelReplay& operator =(const ParallelReplay&) = delete;
+
+    // Replays a whole journal, returning false if it can't be opened
+    bool Run(const std::string& path);
+
+    uint64_t GetRecordsReplayed() const
+    {
+        return m_recordsReplayed;
+    }
+
+    // Every fill of the last run, in the order they were matched
+    const std::vector<ReplayFill>& GetFills() const
+    {
+        return m_fills;
+    }
+
+private:
+    // A journal record and its position in the journal
+    struct Input
+    {
+        uint64_t sequence{0};
+        JournalRecord record;
+    };
+
+    using Chunk = std::vector<Input>;
+
+    // One market's inputs waiting to be replayed and the engine replaying them
+    struct Partition;
+
+    // Counts the placements of each market, so its engine only sets aside
+    // room for as many orders as it could ever hold
+    bool CountOrders(const std::string& path);
+
+    // Streams the journal to the partitions, copying each mass cancel across
+    // every market to every partition
+    bool Distribute(const std::string& path);
+
+    void Append(Partition& partition, const Input& input);
+    void Send(Partition& partition, Chunk&& chunk);
+
+    // Run by each replay thread until every partition has been replayed,
+    // starting its search for work from its own share of the markets
+    void Work(size_t first);
+
+    // Replays the chunks waiting for a partition the thread has claimed,
+    // returning false if there were none
+    bool Drain(Partition& partition);
+
+    // K-way merge of the fills of every partition by sequence
+    void MergeFills();
+
+    std::vector<MarketConfig> m_marketConfigs;
+    ReplayConfig m_config;
+    size_t m_threadCount{1};
+
+    std::vector<std::unique_ptr<Partition>> m_partitions;
+    std::atomic<size_t> m_partitionsFinished{0};
+
+    // Chunks sent but not yet replayed, the reading thread waits once there
+    // are chunksInFlight for each replay thread
+    std::atomic<size_t> m_chunksInFlight{0};
+
+    // Replayed chunks handed back to be filled again
+    MPSCQueue<Chunk> m_spare;
+
+    std::vector<ReplayFill> m_fills;
+    uint64_t m_recordsReplayed{0};
+};
@@ -0,0 +1,380 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory_resource>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "Types.h"
+
+// Price levels of one side of a book held in a contiguous window indexed by
+// the offset from a base tick. The window is recentred around the best
+// tick as the book moves; levels that fall outside of it are parked in an
+// overflow tree. The best level is always kept inside the window and tracked
+// with a cursor, so best level lookups and crossing checks are O(1).
+template<typename Level, OrderType Side>
+class PriceLadder
+{
+public:
+    PriceLadder(const MarketConfig& config, std::pmr::memory_resource* pResource)
+        : m_window(RoundUpToWord(config.ladderWindowTicks))
+        , m_levels(pResource)
+        , m_occupied(pResource)
+        , m_spareLevels(pResource)
+        , m_spareOccupied(pResource)
+        , m_overflow(pResource)
+    {
+    }
+
+    bool Empty() const
+    {
+        // The best level is always in the window, so an empty window
+        // means there is nothing parked in the overflow either
+        return m_levelCount == 0;
+    }
+
+    Tick BestTick() const
+    {
+        return m_base + m_best;
+    }
+
+    Level& Best()
+    {
+        return m_levels[m_best];
+    }
+
+    Level& FindOrInsert(Tick tick)
+    {
+        if(m_levels.empty())
+        {
+            // Defer allocating the window until the side is first used
+            m_levels.resize(m_window);
+            m_occupied.resize(m_window / BitsPerWord);
+            m_spareLevels.resize(m_window);
+            m_spareOccupied.resize(m_window / BitsPerWord);
+        }
+
+        if(Empty())
+        {
+            Recentre(tick);
+        }
+        else if(!InWindow(tick))
+        {
+            if(!IsBetter(tick, BestTick()))
+            {
+                // Passive levels outside of the window live in the overflow
+                return m_overflow[tick];
+            }
+
+            // A new best tick beyond the window
+            Recentre(tick);
+        }
+
+        const size_t index = static_cast<size_t>(tick - m_base);
+
+        if(!IsOccupied(index))
+        {
+            SetOccupied(index);
+            ++m_levelCount;
+
+            if(m_levelCount == 1 || IsBetterIndex(index, m_best))
+            {
+                m_best = index;
+            }
+        }
+
+        return m_levels[index];
+    }
+
+    Level* Find(Tick tick)
+    {
+        if(Empty())
+        {
+            return nullptr;
+        }
+
+        if(InWindow(tick))
+        {
+            const size_t index = static_cast<size_t>(tick - m_base);
+            return IsOccupied(index) ? &m_levels[index] : nullptr;
+        }
+
+        typename Overflow::iterator it = m_overflow.find(tick);
+        return it == m_overflow.end() ? nullptr : &it->second;
+    }
+
+    void Erase(Tick tick)
+    {
+        if(!InWindow(tick))
+        {
+            m_overflow.erase(tick);
+            return;
+        }
+
+        const size_t index = static_cast<size_t>(tick - m_base);
+        assert(IsOccupied(index));
+
+        m_levels[index] = Level{};
+        ClearOccupied(index);
+        --m_levelCount;
+
+        if(index != m_best)
+        {
+            return;
+        }
+
+        if(m_levelCount > 0)
+        {
+            m_best = FindNextBest(index);
+
+            if(!m_overflow.empty() && IsNearFarEdge(m_best))
+            {
+                // The touch has drifted towards the passive edge of the
+                // window, bring it back to the centre so deeper levels
+                // can be pulled in from the overflow
+                Recentre(BestTick());
+            }
+        }
+        else if(!m_overflow.empty())
+        {
+            Recentre(m_overflow.begin()->first);
+        }
+    }
+
+    void EraseBest()
+    {
+        Erase(BestTick());
+    }
+
+    // Visits levels from the touch outwards for as long as fn returns true, the window first
+    // and then the overflow beyond its passive edge
+    template<typename Fn>
+    void ForEachLevel(Fn&& fn) const
+    {
+        if(Empty())
+        {
+            return;
+        }
+
+        size_t index = m_best;
+
+        for(size_t visited = 0; visited < m_levelCount; ++visited)
+        {
+            if(visited > 0)
+            {
+                index = FindNextBest(index);
+            }
+
+            if(!fn(m_base + index, m_levels[index]))
+            {
+                return;
+            }
+        }
+
+        for(const auto& [tick, level] : m_overflow)
+        {
+            if(!fn(tick, level))
+            {
+                return;
+            }
+        }
+    }
+
+private:
+    using Word = uint64_t;
+    static constexpr size_t BitsPerWord = 64;
+
+    using Compare = std::conditional_t<
+        Side == OrderType::Bid, std::greater<Tick>, std::less<Tick>>;
+
+    // Ordered best first, same as the window
+    using Overflow = std::pmr::map<Tick, Level, Compare>;
+
+    static size_t RoundUpToWord(uint32_t ticks)
+    {
+        const size_t words = (static_cast<size_t>(ticks) + BitsPerWord - 1) / BitsPerWord;
+        return (words == 0 ? 1 : words) * BitsPerWord;
+    }
+
+    static bool IsBetter(uint64_t lhs, uint64_t rhs)
+    {
+        return Side == OrderType::Bid ? lhs > rhs : lhs < rhs;
+    }
+
+    static bool IsBetterIndex(size_t lhs, size_t rhs)
+    {
+        return IsBetter(lhs, rhs);
+    }
+
+    bool InWindow(uint64_t tick) const
+    {
+        return tick >= m_base && tick < m_base + m_window;
+    }
+
+    bool IsNearFarEdge(size_t index) const
+    {
+        return Side == OrderType::Bid
+            ? index < m_window / 4
+            : index >= m_window - m_window / 4;
+    }
+
+    bool IsOccupied(size_t index) const
+    {
+        return (m_occupied[index / BitsPerWord] >> (index % BitsPerWord)) & 1;
+    }
+
+    void SetOccupied(size_t index)
+    {
+        m_occupied[index / BitsPerWord] |= Word{1} << (index % BitsPerWord);
+    }
+
+    void ClearOccupied(size_t index)
+    {
+        m_occupied[index / BitsPerWord] &= ~(Word{1} << (index % BitsPerWord));
+    }
+
+    // Scans the occupancy bitmap from the given index towards the
+    // passive side of the book for the next populated level
+    size_t FindNextBest(size_t from) const
+    {
+        if(Side == OrderType::Bid)
+        {
+            size_t word = from / BitsPerWord;
+            const size_t bit = from % BitsPerWord;
+            Word bits = m_occupied[word] & ((Word{1} << bit) - 1);
+
+            while(bits == 0)
+            {
+                assert(word > 0);
+                bits = m_occupied[--word];
+            }
+
+            return word * BitsPerWord + (BitsPerWord - 1 - __builtin_clzll(bits));
+        }
+        else
+        {
+            size_t word = from / BitsPerWord;
+            const size_t bit = from % BitsPerWord;
+            Word bits = bit == BitsPerWord - 1 ? 0 : m_occupied[word] & ~((Word{2} << bit) - 1);
+
+            while(bits == 0)
+            {
+                assert(word + 1 < m_occupied.size());
+                bits = m_occupied[++word];
+            }
+
+            return word * BitsPerWord + __builtin_ctzll(bits);
+        }
+    }
+
+    // Moves the window so that it is centred on the given tick. Levels that
+    // no longer fit are parked in the overflow and any overflow levels that
+    // now fit are pulled back in. Only ever called with the best tick of the
+    // side, so everything outside of the new window is on the passive side.
+    void Recentre(Tick centre)
+    {
+        const uint64_t half = m_window / 2;
+        const uint64_t newBase = centre > half ? centre - half : 0;
+
+        if(m_levelCount == 0 && m_overflow.empty())
+        {
+            m_base = newBase;
+            return;
+        }
+
+        std::pmr::vector<Level>& levels = m_spareLevels;
+        std::pmr::vector<Word>& occupied = m_spareOccupied;
+        std::fill(occupied.begin(), occupied.end(), Word{0});
+
+        const auto InNewWindow = [newBase, this](uint64_t tick)
+        {
+            return tick >= newBase && tick < newBase + m_window;
+        };
+
+        const auto Place = [&](uint64_t tick, Level&& level)
+        {
+            const size_t index = static_cast<size_t>(tick - newBase);
+            levels[index] = std::move(level);
+            occupied[index / BitsPerWord] |= Word{1} << (index % BitsPerWord);
+        };
+
+        for(size_t word = 0; word < m_occupied.size(); ++word)
+        {
+            Word bits = m_occupied[word];
+
+            while(bits != 0)
+            {
+                const size_t index = word * BitsPerWord + __builtin_ctzll(bits);
+                const uint64_t tick = m_base + index;
+                bits &= bits - 1;
+
+                if(InNewWindow(tick))
+                {
+                    Place(tick, std::move(m_levels[index]));
+                }
+                else
+                {
+                    m_overflow.emplace(tick, std::move(m_levels[index]));
+                }
+
+                m_levels[index] = Level{};
+            }
+        }
+
+        // Overflow levels are all passive to the window, so walk them from the
+        // best one that could fit until the first that falls beyond the window
+        const uint64_t bestEdge = Side == OrderType::Bid ? newBase + m_window - 1 : newBase;
+        typename Overflow::iterator it = m_overflow.lower_bound(bestEdge);
+
+        while(it != m_overflow.end() && InNewWindow(it->first))
+        {
+            Place(it->first, std::move(it->second));
+            it = m_overflow.erase(it);
+        }
+
+        m_levels.swap(levels);
+        m_occupied.swap(occupied);
+        m_base = newBase;
+
+        m_levelCount = 0;
+        bool first{true};
+
+        for(size_t word = 0; word < m_occupied.size(); ++word)
+        {
+            Word bits = m_occupied[word];
+            m_levelCount += __builtin_popcountll(bits);
+
+            while(bits != 0)
+            {
+                const size_t index = word * BitsPerWord + __builtin_ctzll(bits);
+                bits &= bits - 1;
+
+                if(first || IsBetterIndex(index, m_best))
+                {
+                    m_best = index;
+                    first = false;
+                }
+            }
+        }
+    }
+
+    const size_t m_window;
+
+    uint64_t m_base{0};
+    size_t m_best{0};
+    size_t m_levelCount{0};
+
+    std::pmr::vector<Level> m_levels;
+    std::pmr::vector<Word> m_occupied;
+
+    // Second window the levels are moved in to when recentring
+    std::pmr::vector<Level> m_spareLevels;
+    std::pmr::vector<Word> m_spareOccupied;
+
+    Overflow m_overflow;
+};
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <functional>
+#include <map>
+#include <memory_resource>
+#include <type_traits>
+
+#include "Types.h"
+
+// Price levels of one side of a book held in an ordered tree keyed by tick.
+// Levels are ordered best first so the head of the tree is always the touch.
+template<typename Level, OrderType Side>
+class PriceMap
+{
+public:
+    PriceMap(const MarketConfig&, std::pmr::memory_resource* pResource)
+        : m_levels(pResource)
+    {
+    }
+
+    bool Empty() const
+    {
+        return m_levels.empty();
+    }
+
+    Tick BestTick() const
+    {
+        return m_levels.begin()->first;
+    }
+
+    Level& Best()
+    {
+        return m_levels.begin()->second;
+    }
+
+    Level& FindOrInsert(Tick tick)
+    {
+        return m_levels[tick];
+    }
+
+    Level* Find(Tick tick)
+    {
+        typename Levels::iterator it = m_levels.find(tick);
+        return it == m_levels.end() ? nullptr : &it->second;
+    }
+
+    void Erase(Tick tick)
+    {
+        m_levels.erase(tick);
+    }
+
+    void EraseBest()
+    {
+        m_levels.erase(m_levels.begin());
+    }
+
+    // Visits levels from the touch outwards for as long as fn returns true
+    template<typename Fn>
+    void ForEachLevel(Fn&& fn) const
+    {
+        for(const auto& [tick, level] : m_levels)
+        {
+            if(!fn(tick, level))
+            {
+                return;
+            }
+        }
+    }
+
+private:
+    using Compare = std::conditional_t<
+        Side == OrderType::Bid, std::greater<Tick>, std::less<Tick>>;
+
+    using Levels = std::pmr::map<Tick, Level, Compare>;
+
+    Levels m_levels;
+};
@@ -0,0 +1,351 @@
+#include "pch.h"
+
+#ifdef Linux
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "ShardedMatchingEngine.h"
+
+ShardedMatchingEngine::Shard::Shard(const EngineConfig& config, size_t queueCapacity)
+    : engine(config)
+    , requests(queueCapacity)
+{
+}
+
+ShardedMatchingEngine::ShardedMatchingEngine(const ShardedEngineConfig& config)
+    : m_config(config)
+{
+    const uint32_t shardCount = config.shardCount == 0 ? 1 : config.shardCount;
+
+    for(uint32_t shard = 0; shard < shardCount; ++shard)
+    {
+        EngineConfig engineConfig{config.engine};
+        engineConfig.shard = shard;
+
+        m_shards.push_back(std::make_unique<Shard>(engineConfig, config.queueCapacity));
+    }
+}
+
+ShardedMatchingEngine::~ShardedMatchingEngine()
+{
+    Stop();
+}
+
+std::vector<MarketID> ShardedMatchingEngine::InitialiseMarkets(std::initializer_list<std::string> markets)
+{
+    return InitialiseMarkets(std::vector<std::string>{markets});
+}
+
+std::vector<MarketID> ShardedMatchingEngine::InitialiseMarkets(const std::vector<std::string>& markets)
+{
+    std::vector<MarketConfig> configs;
+    configs.reserve(markets.size());
+
+    for(const auto& market : markets)
+    {
+        configs.push_back(MarketConfig{market});
+    }
+
+    return InitialiseMarkets(configs);
+}
+
+std::vector<MarketID> ShardedMatchingEngine::InitialiseMarkets(const std::vector<MarketConfig>& markets)
+{
+    // Every shard knows of every market so that market IDs agree between
+    // them. Only the shard a market is routed to ever sees any of its orders,
+    // the others are given a map without an arena, which costs next to nothing.
+    std::vector<MarketID> marketIDs;
+    marketIDs.reserve(markets.size());
+
+    for(const MarketConfig& config : markets)
+    {
+        MarketID marketID = GetMarketID(config.name);
+
+        if(marketID == InvalidMarketID)
+        {
+            marketID = m_marketCount++;
+        }
+
+        MarketConfig placeholder{config};
+        placeholder.layout = PriceLevelLayout::Map;
+        placeholder.arenaBytes = 0;
+
+        const uint32_t owner = GetShardForMarket(marketID);
+
+        for(uint32_t shard = 0; shard < m_shards.size(); ++shard)
+        {
+            m_shards[shard]->engine.InitialiseMarkets(std::vector<MarketConfig>{shard == owner ? config : placeholder});
+        }
+
+        marketIDs.push_back(marketID);
+    }
+
+    return marketIDs;
+}
+
+void ShardedMatchingEngine::RegisterEventObserver(IExchangeEvents* pObserver)
+{
+    for(auto& pShard : m_shards)
+    {
+        pShard->engine.RegisterEventObserver(pObserver);
+    }
+}
+
+void ShardedMatchingEngine::RegisterEventObserver(uint32_t shard, IExchangeEvents* pObserver)
+{
+    if(shard < m_shards.size())
+    {
+        m_shards[shard]->engine.RegisterEventObserver(pObserver);
+    }
+}
+
+void ShardedMatchingEngine::SetRiskLimits(OwnerID owner, const RiskLimits& limits)
+{
+    for(auto& pShard : m_shards)
+    {
+        pShard->engine.SetRiskLimits(owner, limits);
+    }
+}
+
+uint32_t ShardedMatchingEngine::GetShardCount() const
+{
+    return static_cast<uint32_t>(m_shards.size());
+}
+
+uint32_t ShardedMatchingEngine::GetShardForMarket(MarketID market) const
+{
+    return market % GetShardCount();
+}
+
+MarketID ShardedMatchingEngine::GetMarketID(const std::string& market) const
+{
+    // Markets are only registered while stopped, so this is safe from any thread
+    return m_shards.front()->engine.GetMarketID(market);
+}
+
+void ShardedMatchingEngine::Start()
+{
+    if(m_running.exchange(true))
+    {
+        return;
+    }
+
+    const uint32_t cores = std::thread::hardware_concurrency();
+
+    for(uint32_t shard = 0; shard < m_shards.size(); ++shard)
+    {
+        Shard& s = *m_shards[shard];
+        s.worker = std::thread([this, &s]() { Run(s); });
+
+        if(m_config.pinThreads && cores > 0)
+        {
+            PinToCore(s, shard % cores);
+        }
+    }
+}
+
+void ShardedMatchingEngine::Stop()
+{
+    if(!m_running.exchange(false))
+    {
+        return;
+    }
+
+    for(auto& pShard : m_shards)
+    {
+        pShard->worker.join();
+    }
+}
+
+OrderPlaceEventResult ShardedMatchingEngine::OnOrderPlace(Order&& o)
+{
+    if(o.market.empty())
+    {
+        return OrderPlaceEventResult::OrderCancelled;
+    }
+
+    return OnOrderPlace(GetMarketID(o.market), std::move(o));
+}
+
+OrderPlaceEventResult ShardedMatchingEngine::OnOrderPlace(MarketID market, Order&& o)
+{
+    // Reject what is obviously invalid up front so the submitter hears about it
+    if(    market == InvalidMarketID || o.volume == 0
+        || ((o.kind == OrderKind::Limit || o.kind == OrderKind::StopLimit) && o.price == 0)
+        || (IsStop(o.kind) && o.stopPrice == 0))
+    {
+        return OrderPlaceEventResult::OrderCancelled;
+    }
+
+    Request request;
+    request.type = Request::Type::Place;
+    request.market = market;
+    request.order = std::move(o);
+
+    if(!Submit(*m_shards[GetShardForMarket(market)], std::move(request)))
+    {
+        return OrderPlaceEventResult::OrderCancelled;
+    }
+
+    return OrderPlaceEventResult::OrderQueued;
+}
+
+OrderCancelEventResult ShardedMatchingEngine::OnOrderCancel(OrderID oid)
+{
+    const uint32_t shard = ShardOfOrderID(oid);
+
+    if(shard >= m_shards.size())
+    {
+        return OrderCancelEventResult::OrderNotFound;
+    }
+
+    Request request;
+    request.type = Request::Type::Cancel;
+    request.oid = oid;
+
+    if(!Submit(*m_shards[shard], std::move(request)))
+    {
+        return OrderCancelEventResult::OrderNotFound;
+    }
+
+    return OrderCancelEventResult::CancelQueued;
+}
+
+OrderModifyEventResult ShardedMatchingEngine::OnOrderModify(OrderID oid, Price price, Quantity volume)
+{
+    const uint32_t shard = ShardOfOrderID(oid);
+
+    if(shard >= m_shards.size())
+    {
+        return OrderModifyEventResult::OrderNotFound;
+    }
+
+    if(price == 0 || volume == 0)
+    {
+        return OrderModifyEventResult::OrderRejected;
+    }
+
+    Request request;
+    request.type = Request::Type::Modify;
+    request.oid = oid;
+    request.order.price = price;
+    request.order.volume = volume;
+
+    if(!Submit(*m_shards[shard], std::move(request)))
+    {
+        return OrderModifyEventResult::OrderRejected;
+    }
+
+    return OrderModifyEventResult::ModifyQueued;
+}
+
+OrderCancelEventResult ShardedMatchingEngine::OnMassCancel(OwnerID owner, MarketID market)
+{
+    if(owner == NoOwner && market == InvalidMarketID)
+    {
+        return OrderCancelEventResult::OrderNotFound;
+    }
+
+    Request request;
+    request.type = Request::Type::MassCancel;
+    request.market = market;
+    request.order.owner = owner;
+
+    bool queued{true};
+
+    if(market != InvalidMarketID)
+    {
+        queued = Submit(*m_shards[GetShardForMarket(market)], std::move(request));
+    }
+    else
+    {
+        for(auto& pShard : m_shards)
+        {
+            Request copy{request};
+            queued = Submit(*pShard, std::move(copy)) && queued;
+        }
+    }
+
+    return queued
+        ? OrderCancelEventResult::CancelQueued
+        : OrderCancelEventResult::OrderNotFound;
+}
+
+bool ShardedMatchingEngine::Submit(Shard& shard, Request&& request)
+{
+    // The request is only moved from once there is room for it, which
+    // only a running shard ever makes
+    while(!shard.requests.TryPush(std::move(request)))
+    {
+        if(!m_running.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+
+        std::this_thread::yield();
+    }
+
+    return true;
+}
+
+void ShardedMatchingEngine::Run(Shard& shard)
+{
+    Request request;
+
+    const auto Dispatch = [&shard](Request& request)
+    {
+        if(request.type == Request::Type::Place)
+        {
+            shard.engine.OnOrderPlace(request.market, std::move(request.order));
+        }
+        else if(request.type == Request::Type::Modify)
+        {
+            shard.engine.OnOrderModify(request.oid, request.order.price, request.order.volume);
+        }
+        else if(request.type == Request::Type::MassCancel)
+        {
+            shard.engine.OnMassCancel(request.order.owner, request.market);
+        }
+        else
+        {
+            shard.engine.OnOrderCancel(request.oid);
+        }
+    };
+
+    for(;;)
+    {
+        if(shard.requests.TryPop(request))
+        {
+            Dispatch(request);
+            continue;
+        }
+
+        if(!m_running.load(std::memory_order_acquire))
+        {
+            // Drain anything submitted before the engine was stopped
+            while(shard.requests.TryPop(request))
+            {
+                Dispatch(request);
+            }
+
+            break;
+        }
+
+        std::this_thread::yield();
+    }
+}
+
+void ShardedMatchingEngine::PinToCore(Shard& shard, uint32_t core)
+{
+#ifdef Linux
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(core, &cpus);
+
+    pthread_setaffinity_np(shard.worker.native_handle(), sizeof(cpus), &cpus);
+#else
+    (void)shard;
+    (void)core;
+#endif
+}
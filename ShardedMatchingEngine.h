@@ -0,0 +1,112 @@
+#pragma once
+
+#include <atomic>
+#include <initializer_list>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "MatchingEngine.h"
+#include "MPSCQueue.h"
+
+// Spreads markets across several MatchingEngines, each driven by a dedicated
+// matching thread fed through a lock-free queue. Markets are assigned to shards
+// by ID so every order on a market is matched by the same thread, in the order
+// it was submitted. Order IDs carry the shard that issued them, which is how a
+// cancel or modify finds its way back without any global lookup.
+//
+// Requests are matched asynchronously, so placing and cancelling only report
+// whether the request was queued. Outcomes are delivered to observers from the
+// thread of the shard that matched them.
+class ShardedMatchingEngine : public IEngineEvents
+{
+public:
+    explicit ShardedMatchingEngine(const ShardedEngineConfig& config);
+    virtual ~ShardedMatchingEngine();
+
+    ShardedMatchingEngine(const ShardedMatchingEngine&) = delete;
+    ShardedMatchingEngine(ShardedMatchingEngine&&) = delete;
+    ShardedMatchingEngine& operator =(const ShardedMatchingEngine&) = delete;
+
+    // Markets and observers must be set up while the engine is stopped
+    std::vector<MarketID> InitialiseMarkets(std::initializer_list<std::string> markets);
+    std::vector<MarketID> InitialiseMarkets(const std::vector<std::string>& markets);
+    std::vector<MarketID> InitialiseMarkets(const std::vector<MarketConfig>& markets);
+
+    // An observer registered with every shard is called from all of their threads at once
+    void RegisterEventObserver(IExchangeEvents* pObserver);
+    void RegisterEventObserver(uint32_t shard, IExchangeEvents* pObserver);
+
+    // Each shard enforces the limits against the orders it holds itself,
+    // so they are set up while stopped like markets and observers
+    void SetRiskLimits(OwnerID owner, const RiskLimits& limits);
+
+    uint32_t GetShardCount() const;
+    uint32_t GetShardForMarket(MarketID market) const;
+    MarketID GetMarketID(const std::string& market) const;
+
+    void Start();
+
+    // Matches everything already queued before stopping the threads,
+    // nothing may be submitted once this has been called
+    void Stop();
+
+    //
+    // IEngineEvents implementation
+    //
+    // Requests can be queued while stopped, to be matched once started. A
+    // request that finds its shard's queue full waits for room while the
+    // engine runs, but fails straight away while it is stopped, as cancelled,
+    // not found or rejected, since nothing would ever make room.
+    //
+
+    virtual OrderPlaceEventResult OnOrderPlace(Order&& o) override final;
+    virtual OrderPlaceEventResult OnOrderPlace(MarketID market, Order&& o) override final;
+    virtual OrderCancelEventResult OnOrderCancel(OrderID oid) override final;
+    virtual OrderModifyEventResult OnOrderModify(OrderID oid, Price price, Quantity volume) override final;
+
+    // An owner's orders may rest on any shard, so unless it is scoped to a
+    // market a mass cancel goes to every shard
+    virtual OrderCancelEventResult OnMassCancel(OwnerID owner, MarketID market = InvalidMarketID) override final;
+
+private:
+
+    struct Request
+    {
+        enum class Type
+        {
+            Place,
+            Cancel,
+            Modify,
+            MassCancel
+        };
+
+        Type type{Type::Place};
+        MarketID market{InvalidMarketID};
+        OrderID oid{0};
+        Order order;
+    };
+
+    struct Shard
+    {
+        Shard(const EngineConfig& config, size_t queueCapacity);
+
+        MatchingEngine engine;
+        MPSCQueue<Request> requests;
+        std::thread worker;
+    };
+
+    // Returns false if the request couldn't be queued
+    bool Submit(Shard& shard, Request&& request);
+    void Run(Shard& shard);
+    void PinToCore(Shard& shard, uint32_t core);
+
+    const ShardedEngineConfig m_config;
+
+    std::vector<std::unique_ptr<Shard>> m_shards;
+
+    // Markets registered so far, which gives the ID the next one will take
+    MarketID m_marketCount{0};
+
+    std::atomic<bool> m_running{false};
+};
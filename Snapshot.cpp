@@ -0,0 +1,160 @@
+#include "pch.h"
+
+#include <cstdio>
+
+#ifdef Linux
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "Snapshot.h"
+
+namespace
+{
+    template<typename T>
+    bool WriteSection(std::FILE* pFile, const std::vector<T>& section)
+    {
+        return section.empty()
+            || std::fwrite(section.data(), sizeof(T), section.size(), pFile) == section.size();
+    }
+}
+
+bool WriteSnapshotFile(const std::string& path, const SnapshotImage& image)
+{
+    const std::string partPath = path + ".part";
+    std::FILE* pFile = std::fopen(partPath.c_str(), "wb");
+
+    if(pFile == nullptr)
+    {
+        return false;
+    }
+
+    bool written = std::fwrite(&image.header, sizeof(image.header), 1, pFile) == 1
+        && WriteSection(pFile, image.markets)
+        && WriteSection(pFile, image.levels)
+        && WriteSection(pFile, image.orders)
+        && WriteSection(pFile, image.stops)
+        && std::fflush(pFile) == 0;
+
+#ifdef Linux
+    written = written && fsync(fileno(pFile)) == 0;
+#endif
+
+    written = std::fclose(pFile) == 0 && written;
+
+    if(!written || std::rename(partPath.c_str(), path.c_str()) != 0)
+    {
+        std::remove(partPath.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+SnapshotFile::~SnapshotFile()
+{
+    Close();
+}
+
+bool SnapshotFile::Open(const std::string& path)
+{
+    Close();
+
+#ifdef Linux
+    const int fd = open(path.c_str(), O_RDONLY);
+
+    if(fd < 0)
+    {
+        return false;
+    }
+
+    struct stat status;
+
+    if(fstat(fd, &status) != 0 || status.st_size < static_cast<off_t>(sizeof(SnapshotHeader)))
+    {
+        close(fd);
+        return false;
+    }
+
+    const size_t size = static_cast<size_t>(status.st_size);
+    void* pMapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    close(fd);
+
+    if(pMapping == MAP_FAILED)
+    {
+        return false;
+    }
+
+    m_pData = static_cast<const unsigned char*>(pMapping);
+    m_size = size;
+#else
+    std::FILE* pFile = std::fopen(path.c_str(), "rb");
+
+    if(pFile == nullptr)
+    {
+        return false;
+    }
+
+    std::fseek(pFile, 0, SEEK_END);
+    const long size = std::ftell(pFile);
+    std::fseek(pFile, 0, SEEK_SET);
+
+    if(size < static_cast<long>(sizeof(SnapshotHeader)))
+    {
+        std::fclose(pFile);
+        return false;
+    }
+
+    m_buffer.resize((static_cast<size_t>(size) + sizeof(uint64_t) - 1) / sizeof(uint64_t));
+    const bool read = std::fread(m_buffer.data(), static_cast<size_t>(size), 1, pFile) == 1;
+    std::fclose(pFile);
+
+    if(!read)
+    {
+        m_buffer.clear();
+        return false;
+    }
+
+    m_pData = reinterpret_cast<const unsigned char*>(m_buffer.data());
+    m_size = static_cast<size_t>(size);
+#endif
+
+    const SnapshotHeader& header = GetHeader();
+    const SnapshotHeader expected;
+
+    const uint64_t expectedSize = sizeof(SnapshotHeader)
+        + uint64_t{header.marketCount} * sizeof(SnapshotMarket)
+        + header.levelCount * sizeof(SnapshotLevel)
+        + header.orderCount * sizeof(SnapshotOrder)
+        + header.stopCount * sizeof(SnapshotStop);
+
+    // Counts are bounded by the file size first so the expected size can't overflow
+    if(    header.magic != expected.magic
+        || header.version != expected.version
+        || header.levelCount > m_size / sizeof(SnapshotLevel)
+        || header.orderCount > m_size / sizeof(SnapshotOrder)
+        || header.stopCount > m_size / sizeof(SnapshotStop)
+        || expectedSize != m_size)
+    {
+        Close();
+        return false;
+    }
+
+    return true;
+}
+
+void SnapshotFile::Close()
+{
+#ifdef Linux
+    if(m_pData != nullptr)
+    {
+        munmap(const_cast<unsigned char*>(m_pData), m_size);
+    }
+#endif
+
+    m_pData = nullptr;
+    m_size = 0;
+    m_buffer.clear();
+}
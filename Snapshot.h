@@ -0,0 +1,224 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#ifdef Linux
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "Types.h"
+
+// A snapshot is laid out as flat arrays so that it can be mapped straight in
+// to memory and read in place:
+//
+//   SnapshotHeader
+//   SnapshotMarket[marketCount]   levels of each market, in market ID order
+//   SnapshotLevel[levelCount]     bids then asks of each market, best first
+//   SnapshotOrder[orderCount]     orders of each level, in time priority
+//   SnapshotStop[stopCount]       stops of each market waiting for their trigger
+//
+// Markets are recorded by ID, so a snapshot must be loaded in to an engine
+// whose markets were initialised in the same order.
+struct SnapshotHeader
+{
+    uint32_t magic{0x50414E53};    // "SNAP"
+    uint32_t version{5};
+    uint32_t marketCount{0};
+    uint32_t reserved{0};
+    OrderID nextOrderID{0};
+    uint64_t levelCount{0};
+    uint64_t orderCount{0};
+    uint64_t stopCount{0};
+};
+
+struct SnapshotMarket
+{
+    uint32_t bidLevels{0};
+    uint32_t askLevels{0};
+
+    // Reference for stops and price bands, zero before the market has traded
+    Price lastTradePrice{0};
+};
+
+struct SnapshotLevel
+{
+    Price price{0};
+    uint32_t orderCount{0};
+    uint32_t reserved{0};
+};
+
+struct SnapshotOrder
+{
+    OrderID id{0};
+    Quantity volume{0};
+    OwnerID owner{NoOwner};
+    uint32_t reserved{0};
+};
+
+// Stops are held in the order they are set off, so restoring them in
+// turn keeps the time priority of stops sharing a stop price
+struct SnapshotStop
+{
+    OrderID id{0};
+    Price price{0};
+    Price stopPrice{0};
+    Quantity volume{0};
+    MarketID market{InvalidMarketID};
+    OwnerID owner{NoOwner};
+    OrderType side{OrderType::Bid};
+    TimeInForce timeInForce{TimeInForce::GoodTillCancel};
+    OrderKind kind{OrderKind::Stop};
+    uint8_t reserved[2]{};
+};
+
+static_assert(std::is_trivially_copyable<SnapshotHeader>::value, "snapshots are read in place");
+static_assert(std::is_trivially_copyable<SnapshotMarket>::value, "snapshots are read in place");
+static_assert(std::is_trivially_copyable<SnapshotLevel>::value, "snapshots are read in place");
+static_assert(std::is_trivially_copyable<SnapshotOrder>::value, "snapshots are read in place");
+static_assert(std::is_trivially_copyable<SnapshotStop>::value, "snapshots are read in place");
+
+// Engine state gathered up ready to be written out
+struct SnapshotImage
+{
+    SnapshotHeader header;
+    std::vector<SnapshotMarket> markets;
+    std::vector<SnapshotLevel> levels;
+    std::vector<SnapshotOrder> orders;
+    std::vector<SnapshotStop> stops;
+};
+
+// Writes to a temporary file renamed in to place once complete, so
+// an existing snapshot is never left half overwritten
+bool WriteSnapshotFile(const std::string& path, const SnapshotImage& image);
+
+// Read only view of a snapshot file, mapped in to memory where supported
+class SnapshotFile
+{
+public:
+    SnapshotFile() = default;
+    ~SnapshotFile();
+
+    SnapshotFile(const SnapshotFile&) = delete;
+    SnapshotFile& operator =(const SnapshotFile&) = delete;
+
+    // Returns false if the file can't be read or its sections
+    // don't add up to a snapshot of this version
+    bool Open(const std::string& path);
+    void Close();
+
+    const SnapshotHeader& GetHeader() const
+    {
+        return *reinterpret_cast<const SnapshotHeader*>(m_pData);
+    }
+
+    const SnapshotMarket* GetMarkets() const
+    {
+        return reinterpret_cast<const SnapshotMarket*>(m_pData + sizeof(SnapshotHeader));
+    }
+
+    const SnapshotLevel* GetLevels() const
+    {
+        return reinterpret_cast<const SnapshotLevel*>(GetMarkets() + GetHeader().marketCount);
+    }
+
+    const SnapshotOrder* GetOrders() const
+    {
+        return reinterpret_cast<const SnapshotOrder*>(GetLevels() + GetHeader().levelCount);
+    }
+
+    const SnapshotStop* GetStops() const
+    {
+        return reinterpret_cast<const SnapshotStop*>(GetOrders() + GetHeader().orderCount);
+    }
+
+private:
+    const unsigned char* m_pData{nullptr};
+    size_t m_size{0};
+
+    // Holds the contents where the file can't be mapped
+    std::vector<uint64_t> m_buffer;
+};
+
+// Takes a snapshot from a child process working on a copy-on-write image of
+// the parent's memory, so the engine is only paused for as long as it takes
+// to fork. Where processes can't be forked the snapshot is taken in place.
+//
+// Forking copies only the calling thread, so the engine must be quiescent
+// at the moment Start is called, as it is between two inputs on its own
+// matching thread.
+class SnapshotProcess
+{
+public:
+    SnapshotProcess() = default;
+
+    SnapshotProcess(const SnapshotProcess&) = delete;
+    SnapshotProcess& operator =(const SnapshotProcess&) = delete;
+
+    ~SnapshotProcess()
+    {
+        Wait();
+    }
+
+    // Runs write, returning whether the snapshot was started, or completed
+    // successfully when taken in place. Fails if one is already running.
+    template<typename WriteFn>
+    bool Start(WriteFn&& write)
+    {
+#ifdef Linux
+        if(m_child > 0)
+        {
+            return false;
+        }
+
+        const pid_t child = fork();
+
+        if(child == 0)
+        {
+            _exit(write() ? 0 : 1);
+        }
+
+        m_child = child;
+        return child > 0;
+#else
+        m_lastResult = write();
+        return m_lastResult;
+#endif
+    }
+
+    bool IsRunning() const
+    {
+#ifdef Linux
+        return m_child > 0;
+#else
+        return false;
+#endif
+    }
+
+    // Blocks until a running snapshot completes, returns whether the last
+    // snapshot taken was written successfully
+    bool Wait()
+    {
+#ifdef Linux
+        if(m_child > 0)
+        {
+            int status{0};
+            m_lastResult = waitpid(m_child, &status, 0) == m_child
+                && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+            m_child = -1;
+        }
+#endif
+        return m_lastResult;
+    }
+
+private:
+#ifdef Linux
+    pid_t m_child{-1};
+#endif
+    bool m_lastResult{false};
+};
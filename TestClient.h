@@ -1,6 +1,10 @@
 #pragma once
 
+#include <memory_resource>
+#include <vector>
+
 #include "EngineInterfaces.h"
+#include "EventSinks.h"
 
 class TestClient : public IExchangeEvents
 {
@@ -22,12 +26,79 @@ public:
         m_cancelEvents.push_back(oid);
     }
 
+    virtual void OnOrdersCancelled(const OrderID* oids, size_t count) override final
+    {
+        m_cancelEvents.insert(m_cancelEvents.end(), oids, oids + count);
+        m_massCancelEvents.emplace_back(oids, oids + count);
+    }
+
     virtual void OnOrderMatched(const MatchedOrder& mo) override final
     {
         m_matchingEvents.push_back(mo);
     }
 
+    virtual void OnModifiedOrder(const ModifiedOrder& mo) override final
+    {
+        m_modifyEvents.push_back(mo);
+    }
+
+    virtual void OnStopTriggered(OrderID oid, const Order& o) override final
+    {
+        m_stopTriggeredEvents.push_back(std::make_pair(oid, o));
+    }
+
+    virtual void OnDepthUpdate(const DepthUpdate* updates, size_t count) override final
+    {
+        m_depthEvents.emplace_back(updates, updates + count);
+    }
+
     std::vector<std::pair<OrderID, Order>> m_orderBookUpdateEvents;
     std::vector<MatchedOrder> m_matchingEvents;
     std::vector<OrderID> m_cancelEvents;
-};
\ No newline at end of file
+    std::vector<std::vector<OrderID>> m_massCancelEvents;
+    std::vector<ModifiedOrder> m_modifyEvents;
+    std::vector<std::pair<OrderID, Order>> m_stopTriggeredEvents;
+    std::vector<std::vector<DepthUpdate>> m_depthEvents;
+};
+
+// Compile time sink counting the events it receives, only
+// listens for fills and leaves the rest to NullEventSink
+struct MatchCountingSink : public NullEventSink
+{
+    void OnOrderMatched(const MatchedOrder& mo)
+    {
+        ++m_matches;
+        m_volume += mo.volume;
+    }
+
+    size_t m_matches{0};
+    Quantity m_volume{0};
+};
+
+// Memory resource counting what is drawn from the global heap through it
+class CountingResource : public std::pmr::memory_resource
+{
+public:
+    size_t m_allocations{0};
+    size_t m_deallocations{0};
+    size_t m_bytesAllocated{0};
+
+private:
+    void* do_allocate(size_t bytes, size_t alignment) override
+    {
+        ++m_allocations;
+        m_bytesAllocated += bytes;
+        return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+    }
+
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override
+    {
+        ++m_deallocations;
+        std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+    {
+        return this == &other;
+    }
+};
@@ -1,57 +1,398 @@
 #pragma once
 
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
 #include <map>
+#include <memory_resource>
+#include <string>
+#include <tuple>
 #include <unordered_map>
 
 enum class OrderPlaceEventResult
 {
-    OrderPlaced,
+    OrderPlaced,        // Resting on the book, or a stop waiting for its trigger
     OrderCancelled,
-    OrderMatched
+    OrderMatched,
+    OrderQueued,        // Accepted for matching on another thread
+    OrderExpired,       // Nothing matched and the order wasn't allowed to rest,
+                        // or self-trade prevention took it out before it could
+    RiskRejected        // Refused by its account's pre-trade risk limits
 };
 
 enum class OrderCancelEventResult
 {
     OrderCancelled,
-    OrderNotFound
+    OrderNotFound,
+    CancelQueued        // Accepted for matching on another thread
 };
 
-using NumericType = uint32_t;
+enum class OrderModifyEventResult
+{
+    OrderModified,
+    OrderMatched,       // Traded on being moved through the touch
+    OrderNotFound,
+    OrderRejected,      // New price off the tick, quantity off the lot or outside risk limits
+    ModifyQueued,       // Accepted for matching on another thread
+    OrderCancelled      // Taken out by self-trade prevention as it moved
+};
+
+// What happens when an order meets a resting order of its own owner
+enum class SelfTradePrevention : uint8_t
+{
+    None,           // They trade like any other pair of orders
+    CancelNewest,   // The rest of the incoming order is cancelled
+    CancelOldest,   // The resting order is cancelled and matching carries on
+    CancelBoth,
+    Decrement       // Both give up the smaller quantity without trading
+};
+
+// Prices are fixed point, scaled by the market's priceScale decimal places
+using Price = uint64_t;
+
+// Quantities are counted in the smallest unit a market trades
+using Quantity = uint64_t;
+
+// A price expressed as a whole number of its market's tick size, books are
+// indexed by tick so that consecutive prices occupy consecutive levels
+using Tick = uint64_t;
+
+constexpr Tick MaxTick{UINT64_MAX};
+
+// Converts a decimal price to fixed point, only meant for the edges of the
+// system where prices arrive as text or floating point
+inline Price ToFixedPoint(double value, uint32_t scale)
+{
+    return static_cast<Price>(std::llround(value * std::pow(10.0, scale)));
+}
+
+// value * numerator / denominator rounded down, without overflowing on the
+// way. The result itself has to fit, and denominator can't be zero.
+inline uint64_t MulDiv(uint64_t value, uint64_t numerator, uint64_t denominator)
+{
+#ifdef __SIZEOF_INT128__
+    return static_cast<uint64_t>(static_cast<unsigned __int128>(value) * numerator / denominator);
+#else
+    // Long multiplication a bit of numerator at a time, keeping only
+    // the quotient and the remainder of the product so far
+    const uint64_t whole = value / denominator * numerator;
+    const uint64_t addend = value % denominator;
+    uint64_t quotient = 0;
+    uint64_t remainder = 0;
+
+    for(int bit = 63; bit >= 0; --bit)
+    {
+        quotient <<= 1;
+
+        if(remainder >= denominator - remainder)
+        {
+            remainder -= denominator - remainder;
+            ++quotient;
+        }
+        else
+        {
+            remainder += remainder;
+        }
+
+        if((numerator >> bit) & 1)
+        {
+            if(remainder >= denominator - addend)
+            {
+                remainder -= denominator - addend;
+                ++quotient;
+            }
+            else
+            {
+                remainder += addend;
+            }
+        }
+    }
+
+    return whole + quotient;
+#endif
+}
 
 using OrderID = uint64_t;
 
+// The top bits of an order ID name the shard of the engine that issued it
+constexpr unsigned OrderIDShardShift{48};
+
+inline uint32_t ShardOfOrderID(OrderID oid)
+{
+    return static_cast<uint32_t>(oid >> OrderIDShardShift);
+}
+
+// Compact handle for a market, issued by MatchingEngine::InitialiseMarkets
+using MarketID = uint32_t;
+
+constexpr MarketID InvalidMarketID{UINT32_MAX};
+
+// Session or client an order was entered by, chosen by whoever enters it.
+// Orders without an owner can only be mass cancelled with their market.
+using OwnerID = uint32_t;
+
+constexpr OwnerID NoOwner{0};
+
 enum class OrderType
 {
     Bid,
     Ask
 };
 
+enum class OrderKind : uint8_t
+{
+    Limit,      // Matches up to its price, any remainder is subject to its time in force
+    Market,     // Matches at any price and never rests
+    Stop,       // Held until the market trades at its stop price, then a market order
+    StopLimit   // Held until the market trades at its stop price, then a limit order
+};
+
+inline bool IsStop(OrderKind kind)
+{
+    return kind >= OrderKind::Stop;
+}
+
+enum class TimeInForce : uint8_t
+{
+    GoodTillCancel,     // Rests until matched or cancelled
+    ImmediateOrCancel,  // Matches what it can on arrival, the rest is cancelled
+    FillOrKill          // Matches in full on arrival or not at all
+};
+
+enum class PriceLevelLayout
+{
+    Map,        // Levels held in an ordered tree keyed by price
+    Ladder      // Levels held in a contiguous window indexed by price tick
+};
+
+// How the volume an aggressor takes from a level is shared between the
+// orders resting there
+enum class MatchingPolicy : uint8_t
+{
+    Fifo,       // Strictly in time priority
+    ProRata,    // In proportion to each order's volume, odd lots in time priority
+    Hybrid      // A share of it in time priority, the rest pro-rata
+};
+
+struct MarketConfig
+{
+    std::string name;
+    PriceLevelLayout layout{PriceLevelLayout::Map};
+
+    // Number of price ticks held in the contiguous window of a ladder
+    uint32_t ladderWindowTicks{1024};
+
+    // Decimal places of the market's fixed point prices
+    uint32_t priceScale{0};
+
+    // Orders priced off the tick or sized off the lot are rejected
+    Price tickSize{1};
+    Quantity lotSize{1};
+
+    // Bytes set aside at startup for the market's price levels
+    size_t arenaBytes{0};
+
+    SelfTradePrevention selfTradePrevention{SelfTradePrevention::None};
+
+    MatchingPolicy matchingPolicy{MatchingPolicy::Fifo};
+
+    // Percentage of the volume taken from each level that a hybrid
+    // policy allocates in time priority before going pro-rata
+    uint8_t fifoPercent{0};
+};
+
+struct EngineConfig
+{
+    // Capacity set aside at startup for resting orders and their IDs
+    size_t reservedOrders{65536};
+
+    // Shard encoded in to every order ID the engine issues
+    uint32_t shard{0};
+
+    // Where the engine draws all of its memory from, the global heap when
+    // unset. Shared by every shard of a sharded engine, so it has to be
+    // safe to use from several threads at once in that case.
+    std::pmr::memory_resource* memoryResource{nullptr};
+};
+
+struct ShardedEngineConfig
+{
+    uint32_t shardCount{1};
+
+    // Requests each shard can have outstanding before submitters wait
+    size_t queueCapacity{65536};
+
+    // Pin each shard's matching thread to its own core
+    bool pinThreads{true};
+
+    // Applied to every shard, the shard itself is filled in per engine
+    EngineConfig engine;
+};
+
+enum class JournalSyncPolicy
+{
+    None,       // Leave writing back to the operating system
+    OnCommit    // Sync the journal to disk at every group commit
+};
+
+struct JournalConfig
+{
+    std::string path;
+    JournalSyncPolicy sync{JournalSyncPolicy::OnCommit};
+
+    // Records buffered before they are written out together as one commit
+    size_t groupCommitRecords{256};
+};
+
+struct ReplayConfig
+{
+    // Threads the markets are replayed across, one per core when zero
+    uint32_t threadCount{0};
+
+    // Journal records are queued for each market in chunks of this many, with
+    // at most chunksInFlight of them waiting for each thread, which bounds the
+    // memory replay takes whatever the length of the journal
+    size_t chunkRecords{4096};
+    size_t chunksInFlight{16};
+
+    // Applied to the engine of every market, which reserves no more orders
+    // than the market has placements in the journal
+    EngineConfig engine;
+};
+
+// Pre-trade limits on an owner's account, a limit of zero is not enforced.
+// Notional is measured as price times quantity in the market's own units.
+struct RiskLimits
+{
+    Quantity maxOrderVolume{0};
+
+    // Largest distance from the last trade, or the touch before the
+    // market has traded, a limit order may be priced at
+    uint32_t priceBandBasisPoints{0};
+
+    uint32_t maxOpenOrders{0};
+    uint64_t maxNotional{0};
+};
+
+struct GatewayConfig
+{
+    // Name of the shared memory segment clients attach to
+    std::string name;
+
+    // Client processes which can be attached at the same time
+    uint32_t maxClients{4};
+
+    // Requests and responses each client can have in flight
+    uint32_t ringCapacity{4096};
+};
+
+// Best prices of a market, zero where a side holds no orders
+struct TopOfBook
+{
+    Price bestBid{0};
+    Price bestAsk{0};
+};
+
 struct Order
 {
     std::string market;
-    NumericType price{0};
-    NumericType volume{0};
+    Price price{0};
+    Quantity volume{0};
     OrderType type{OrderType::Bid};
+    TimeInForce timeInForce{TimeInForce::GoodTillCancel};
+    OrderKind kind{OrderKind::Limit};
+    OwnerID owner{NoOwner};
+
+    // Price a stop order is triggered at, a buy stop once the market trades
+    // at or above it and a sell stop at or below it
+    Price stopPrice{0};
+
+    // Handle of the market, filled in by the engine when an order is accepted.
+    // Not part of the comparison as it only restates the market
+    MarketID marketID{InvalidMarketID};
 
     bool operator !=(const Order& rhs) const
     {
-        return std::tie(market, price, volume, type) 
-            != std::tie(rhs.market, rhs.price, rhs.volume, rhs.type);
+        return std::tie(market, price, volume, type, timeInForce, kind, owner, stopPrice) 
+            != std::tie(rhs.market, rhs.price, rhs.volume, rhs.type, rhs.timeInForce, rhs.kind, rhs.owner, rhs.stopPrice);
     }
 };
 
 struct MatchedOrder
 {
-    std::string market;
+    MarketID market;
     OrderID bidSideOrderID;
     OrderID askSideOrderID;
-    NumericType price{0};
-    NumericType volume{0};
+    Price price{0};
+    Quantity volume{0};
     OrderType type{OrderType::Bid};
 
+    // Volume the resting order has left after the fill, zero once it has been
+    // consumed entirely. Not part of the comparison as it follows from the
+    // fills that came before
+    Quantity restingVolumeRemaining{0};
+
     bool operator !=(const MatchedOrder& rhs) const
     {
         return std::tie(market, bidSideOrderID, askSideOrderID, price, volume, type) 
             != std::tie(rhs.market, rhs.bidSideOrderID, rhs.askSideOrderID, rhs.price, rhs.volume, rhs.type);
     }
+};
+
+// New price and remaining quantity of a resting order, which keeps its ID
+struct ModifiedOrder
+{
+    MarketID market{InvalidMarketID};
+    OrderID oid{0};
+    Price price{0};
+    Quantity volume{0};
+    OrderType type{OrderType::Bid};
+};
+
+// Aggregate of every order resting at one price
+struct DepthLevel
+{
+    Price price{0};
+    Quantity volume{0};
+    uint32_t orderCount{0};
+};
+
+// New state of a level changed by an input, a level that has been
+// removed from the book is reported with no volume and no orders
+struct DepthUpdate
+{
+    MarketID market{InvalidMarketID};
+    OrderType side{OrderType::Bid};
+    Price price{0};
+    Quantity volume{0};
+    uint32_t orderCount{0};
+};
+
+enum class OrderRequestType
+{
+    Place,
+    Cancel,
+    Modify,
+    MassCancel
+};
+
+// One entry of a batch submitted to MatchingEngine::OnOrderBatch
+struct OrderRequest
+{
+    OrderRequestType type{OrderRequestType::Place};
+
+    // Market to place on, when not set the market is looked up by the order's name
+    MarketID market{InvalidMarketID};
+    Order order;
+
+    // Order to cancel, or to modify to the price and volume of order.
+    // A mass cancel takes its scope from market and the order's owner.
+    OrderID oid{0};
+};
+
+struct OrderRequestResult
+{
+    OrderPlaceEventResult placed{OrderPlaceEventResult::OrderCancelled};
+    OrderCancelEventResult cancelled{OrderCancelEventResult::OrderNotFound};
+    OrderModifyEventResult modified{OrderModifyEventResult::OrderNotFound};
 };
\ No newline at end of file
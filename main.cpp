@@ -4,7 +4,13 @@
 #include <iostream>
 #include <cassert>
 
+#include "EventRing.h"
+#include "Journal.h"
+#include "LatencyHistogram.h"
 #include "MatchingEngine.h"
+#include "OrderGateway.h"
+#include "ParallelReplay.h"
+#include "ShardedMatchingEngine.h"
 #include "TestClient.h"
 
 #define START_TEST( test_name )                                                 \
@@ -44,321 +50,2211 @@ int main()
 
     uint32_t testsFailed{0};
 
+    // Every scenario must behave identically whichever layout the
+    // price levels of the market are held in
+    for(const PriceLevelLayout layout : {PriceLevelLayout::Map, PriceLevelLayout::Ladder})
     {
-        START_TEST( "Populate simple OB" )
+        {
+            START_TEST( "Populate simple OB" )
+            MatchingEngine me;
+            me.InitialiseMarkets({MarketConfig{market, layout}});
+
+            TestClient tc;
+            me.RegisterEventObserver(&tc);
+
+            std::vector<Order> orders{
+                {market, 10, 2, OrderType::Bid},
+                {market, 11, 2, OrderType::Bid},
+                {market, 20, 2, OrderType::Ask},
+                {market, 21, 2, OrderType::Ask}
+            };
+
+            auto results = PlaceOrdersFn(me, orders);
+
+            // Check no matches occurred
+            EXPECTED(tc.m_matchingEvents.empty(), true);
+
+            // Check we received the response codes we expect
+            EXPECTED(results.size(), 4);
+            EXPECTED(results[0], OrderPlaceEventResult::OrderPlaced);
+            EXPECTED(results[1], OrderPlaceEventResult::OrderPlaced);
+            EXPECTED(results[2], OrderPlaceEventResult::OrderPlaced);
+            EXPECTED(results[3], OrderPlaceEventResult::OrderPlaced);
+
+            // Check the correct events were emitted
+            EXPECTED(tc.m_orderBookUpdateEvents.size(), 4);
+            EXPECTED(tc.m_orderBookUpdateEvents[0].first, 0);
+            EXPECTED(tc.m_orderBookUpdateEvents[0].second, orders[0]);
+            EXPECTED(tc.m_orderBookUpdateEvents[1].first, 1);
+            EXPECTED(tc.m_orderBookUpdateEvents[1].second, orders[1]);
+            EXPECTED(tc.m_orderBookUpdateEvents[2].first, 2);
+            EXPECTED(tc.m_orderBookUpdateEvents[2].second, orders[2]);
+            EXPECTED(tc.m_orderBookUpdateEvents[3].first, 3);
+            EXPECTED(tc.m_orderBookUpdateEvents[3].second, orders[3]);
+
+            // Check nothing was cancelled
+            EXPECTED(tc.m_cancelEvents.empty(), true);
+        }
+
+        {
+            START_TEST( "Cancel position" )
+            MatchingEngine me;
+            me.InitialiseMarkets({MarketConfig{market, layout}});
+
+            TestClient tc;
+            me.RegisterEventObserver(&tc);
+
+            std::vector<Order> orders{
+                {market, 10, 2, OrderType::Bid},
+                {market, 11, 2, OrderType::Bid},
+                {market, 20, 2, OrderType::Ask},
+                {market, 21, 2, OrderType::Ask}
+            };
+
+            auto results = PlaceOrdersFn(me, orders);
+
+            // Check no matches occurred
+            EXPECTED(tc.m_matchingEvents.empty(), true);
+
+            // Check we received the response codes we expect
+            EXPECTED(results.size(), 4);
+            EXPECTED(results[0], OrderPlaceEventResult::OrderPlaced);
+            EXPECTED(results[1], OrderPlaceEventResult::OrderPlaced);
+            EXPECTED(results[2], OrderPlaceEventResult::OrderPlaced);
+            EXPECTED(results[3], OrderPlaceEventResult::OrderPlaced);
+
+            // Check the correct events were emitted
+            EXPECTED(tc.m_orderBookUpdateEvents.size(), 4);
+            EXPECTED(tc.m_orderBookUpdateEvents[0].first, 0);
+            EXPECTED(tc.m_orderBookUpdateEvents[0].second, orders[0]);
+            EXPECTED(tc.m_orderBookUpdateEvents[1].first, 1);
+            EXPECTED(tc.m_orderBookUpdateEvents[1].second, orders[1]);
+            EXPECTED(tc.m_orderBookUpdateEvents[2].first, 2);
+            EXPECTED(tc.m_orderBookUpdateEvents[2].second, orders[2]);
+            EXPECTED(tc.m_orderBookUpdateEvents[3].first, 3);
+            EXPECTED(tc.m_orderBookUpdateEvents[3].second, orders[3]);
+
+            // Cancel two positions
+            OrderCancelEventResult result1 = me.OnOrderCancel(1);
+            OrderCancelEventResult result2 = me.OnOrderCancel(3);
+
+            EXPECTED(result1, OrderCancelEventResult::OrderCancelled);
+            EXPECTED(result2, OrderCancelEventResult::OrderCancelled);
+
+            // Check the correct events were emitted
+            EXPECTED(tc.m_cancelEvents.size(), 2);
+            EXPECTED(tc.m_cancelEvents[0], 1);
+            EXPECTED(tc.m_cancelEvents[1], 3);
+
+            // Attempt to cancel an order that doesn't exist
+            OrderCancelEventResult result3 = me.OnOrderCancel(1000);
+
+            EXPECTED(result3, OrderCancelEventResult::OrderNotFound);
+
+            // Check the no new events were emitted
+            EXPECTED(tc.m_cancelEvents.size(), 2);
+        }
+
+        {
+            START_TEST( "Test rejecting invalid orders" )
+            MatchingEngine me;
+            me.InitialiseMarkets({MarketConfig{market, layout}});
+
+            TestClient tc;
+            me.RegisterEventObserver(&tc);
+
+            std::vector<Order> orders{
+                {market, 0, 2, OrderType::Bid},     // No price
+                {market, 11, 0, OrderType::Bid},    // no volume
+                {"BTC-NOTVALID", 11, 0, OrderType::Bid}     // another market
+            };
+
+            auto results = PlaceOrdersFn(me, orders);
+
+            // Check no matches occurred
+            EXPECTED(tc.m_matchingEvents.empty(), true);
+
+            // Check we received the response codes we expect
+            EXPECTED(results.size(), 3);
+            EXPECTED(results[0], OrderPlaceEventResult::OrderCancelled);
+            EXPECTED(results[1], OrderPlaceEventResult::OrderCancelled);
+            EXPECTED(results[2], OrderPlaceEventResult::OrderCancelled);
+
+            // Check no events were emitted
+            EXPECTED(tc.m_orderBookUpdateEvents.size(), 0);
+
+            // Check nothing was cancelled
+            EXPECTED(tc.m_cancelEvents.empty(), true);
+        }
+
+        {
+            START_TEST( "Simple matching tests initiated by BID" )
+            MatchingEngine me;
+            const MarketID marketID = me.InitialiseMarkets({MarketConfig{market, layout}}).front();
+
+            TestClient tc;
+            me.RegisterEventObserver(&tc);
+
+            std::vector<Order> orders1{
+                {market, 10, 2, OrderType::Bid},
+                {market, 11, 2, OrderType::Bid},
+                {market, 20, 1, OrderType::Ask},
+                {market, 20, 1, OrderType::Ask},
+                {market, 21, 2, OrderType::Ask}
+            };
+
+            auto results1 = PlaceOrdersFn(me, orders1);
+
+            // Check no matches occurred
+            EXPECTED(tc.m_matchingEvents.empty(), true);
+
+            // Check we received the response codes we expect
+            EXPECTED(results1.size(), 5);
+            EXPECTED(results1[0], OrderPlaceEventResult::OrderPlaced);
+            EXPECTED(results1[1], OrderPlaceEventResult::OrderPlaced);
+            EXPECTED(results1[2], OrderPlaceEventResult::OrderPlaced);
+            EXPECTED(results1[3], OrderPlaceEventResult::OrderPlaced);
+            EXPECTED(results1[4], OrderPlaceEventResult::OrderPlaced);
+
+            // Check the correct events were emitted
+            EXPECTED(tc.m_orderBookUpdateEvents.size(), 5);
+            EXPECTED(tc.m_orderBookUpdateEvents[0].first, 0);
+            EXPECTED(tc.m_orderBookUpdateEvents[0].second, orders1[0]);
+            EXPECTED(tc.m_orderBookUpdateEvents[1].first, 1);
+            EXPECTED(tc.m_orderBookUpdateEvents[1].second, orders1[1]);
+            EXPECTED(tc.m_orderBookUpdateEvents[2].first, 2);
+            EXPECTED(tc.m_orderBookUpdateEvents[2].second, orders1[2]);
+            EXPECTED(tc.m_orderBookUpdateEvents[3].first, 3);
+            EXPECTED(tc.m_orderBookUpdateEvents[3].second, orders1[3]);
+            EXPECTED(tc.m_orderBookUpdateEvents[4].first, 4);
+            EXPECTED(tc.m_orderBookUpdateEvents[4].second, orders1[4]);
+
+            // After initially populating a simple orderbook, now
+            // place an order that crosses an existing ASK positions
+
+            // This order should match the orders at price 20, then partially at 21
+            std::vector<Order> orders2{
+                {market, 21, 3, OrderType::Bid},
+            };
+
+            auto results2 = PlaceOrdersFn(me, orders2);
+
+            // Check we received the response codes we expect
+            EXPECTED(results2.size(), 1);
+            EXPECTED(results2[0], OrderPlaceEventResult::OrderMatched);
+
+            EXPECTED(tc.m_matchingEvents.size(), 3);
+
+            // For fairness we expect the earliest placed order at that position to be satisfied first
+            MatchedOrder expectedMatch1
+            {
+                marketID,
+                5,          // bid side orderID will be the one we've just placed (5th)
+                2,          // ask side will be the first matching ask side we placed (3rd)
+                20,         // execution price
+                1,          // size of position as entire position consumed
+                OrderType::Ask  // Sell
+            };
+
+            // Followed by the next at that position
+            MatchedOrder expectedMatch2
+            {
+                marketID,
+                5,          // bid side orderID will be the one we've just placed (5th)
+                3,          // ask side will be the first matching ask side we placed (3rd)
+                20,         // execution price
+                1,          // size of position as entire position consumed
+                OrderType::Ask  // Sell
+            };
+
+            // Since that consumes all the orders at the earlier price point, we now move to
+            // the next price position that still matches the BID placed
+            MatchedOrder expectedMatch3
+            {
+                marketID,
+                5,          // bid side orderID will be the one we've just placed (5th)
+                4,          // ask side will be the first matching ask side we placed (3rd)
+                21,         // execution price
+                1,          // only a portion of the position has been consumed
+                OrderType::Ask  // Sell
+            };
+        
+            EXPECTED(tc.m_matchingEvents[0], expectedMatch1);
+            EXPECTED(tc.m_matchingEvents[1], expectedMatch2);
+            EXPECTED(tc.m_matchingEvents[2], expectedMatch3);
+
+            // Check nothing was cancelled
+            EXPECTED(tc.m_cancelEvents.empty(), true);
+        }
+
+        {
+            START_TEST( "Simple matching tests initiated by ASK" )
+            MatchingEngine me;
+            const MarketID marketID = me.InitialiseMarkets({MarketConfig{market, layout}}).front();
+
+            TestClient tc;
+            me.RegisterEventObserver(&tc);
+
+            std::vector<Order> orders1{
+                {market, 10, 2, OrderType::Bid},
+                {market, 11, 1, OrderType::Bid},
+                {market, 20, 1, OrderType::Ask},
+                {market, 21, 1, OrderType::Ask}
+            };
+
+            auto results1 = PlaceOrdersFn(me, orders1);
+
+            // Check no matches occurred
+            EXPECTED(tc.m_matchingEvents.empty(), true);
+
+            // Check we received the response codes we expect
+            EXPECTED(results1.size(), 4);
+            EXPECTED(results1[0], OrderPlaceEventResult::OrderPlaced);
+            EXPECTED(results1[1], OrderPlaceEventResult::OrderPlaced);
+            EXPECTED(results1[2], OrderPlaceEventResult::OrderPlaced);
+            EXPECTED(results1[3], OrderPlaceEventResult::OrderPlaced);
+
+            // Check the correct events were emitted
+            EXPECTED(tc.m_orderBookUpdateEvents.size(), 4);
+            EXPECTED(tc.m_orderBookUpdateEvents[0].first, 0);
+            EXPECTED(tc.m_orderBookUpdateEvents[0].second, orders1[0]);
+            EXPECTED(tc.m_orderBookUpdateEvents[1].first, 1);
+            EXPECTED(tc.m_orderBookUpdateEvents[1].second, orders1[1]);
+            EXPECTED(tc.m_orderBookUpdateEvents[2].first, 2);
+            EXPECTED(tc.m_orderBookUpdateEvents[2].second, orders1[2]);
+            EXPECTED(tc.m_orderBookUpdateEvents[3].first, 3);
+            EXPECTED(tc.m_orderBookUpdateEvents[3].second, orders1[3]);
+
+            // After initially populating a simple orderbook, now
+            // place an order that crosses an existing BID positions
+
+            // This order should match the orders at price 11, then at 10
+            std::vector<Order> orders2{
+                {market, 10, 2, OrderType::Ask},
+            };
+
+            auto results2 = PlaceOrdersFn(me, orders2);
+
+            // Check we received the response codes we expect
+            EXPECTED(results2.size(), 1);
+            EXPECTED(results2[0], OrderPlaceEventResult::OrderMatched);
+
+            EXPECTED(tc.m_matchingEvents.size(), 2);
+
+            // We expect to walk backwards through the bids until we reach the price the ask was placed at
+            MatchedOrder expectedMatch1
+            {
+                marketID,
+                1,          // first matched bid side orderID will be the second added
+                4,          // ask side will be the first matching ask side we placed (3rd)
+                11,         // execution price
+                1,          // size of position as entire position consumed
+                OrderType::Bid  // Buy
+            };
+
+            // Followed by the next at the previous position
+            MatchedOrder expectedMatch2
+            {
+                marketID,
+                0,          // followed by the first orderID which was at an earlier position
+                4,          // ask side will be the first matching ask side we placed (3rd)
+                10,         // execution price
+                1,          // size of position as entire position consumed
+                OrderType::Bid  // Buy
+            };
+
+            EXPECTED(tc.m_matchingEvents[0], expectedMatch1);
+            EXPECTED(tc.m_matchingEvents[1], expectedMatch2);
+
+            // Check nothing was cancelled
+            EXPECTED(tc.m_cancelEvents.empty(), true);
+        }
+
+        {
+            START_TEST( "Top of book follows the touch" )
+            MatchingEngine me;
+            const MarketID marketID = me.InitialiseMarkets({MarketConfig{market, layout}}).front();
+
+            EXPECTED(me.GetTopOfBook(marketID).bestBid, 0);
+            EXPECTED(me.GetTopOfBook(marketID).bestAsk, 0);
+
+            std::vector<Order> orders{
+                {market, 10, 1, OrderType::Bid},
+                {market, 11, 1, OrderType::Bid},
+                {market, 20, 1, OrderType::Ask},
+                {market, 21, 1, OrderType::Ask}
+            };
+
+            PlaceOrdersFn(me, orders);
+
+            EXPECTED(me.GetTopOfBook(marketID).bestBid, 11);
+            EXPECTED(me.GetTopOfBook(marketID).bestAsk, 20);
+
+            // Consuming the best ask moves the touch onwards
+            EXPECTED(me.OnOrderPlace(Order{market, 20, 1, OrderType::Bid}), OrderPlaceEventResult::OrderMatched);
+            EXPECTED(me.GetTopOfBook(marketID).bestAsk, 21);
+
+            // As does cancelling the best bid
+            EXPECTED(me.OnOrderCancel(1), OrderCancelEventResult::OrderCancelled);
+            EXPECTED(me.GetTopOfBook(marketID).bestBid, 10);
+        }
+
+        {
+            START_TEST( "Cancel within a position keeps time priority" )
+            MatchingEngine me;
+            const MarketID marketID = me.InitialiseMarkets({MarketConfig{market, layout}}).front();
+
+            TestClient tc;
+            me.RegisterEventObserver(&tc);
+
+            std::vector<Order> orders1{
+                {market, 20, 1, OrderType::Ask},
+                {market, 20, 1, OrderType::Ask},
+                {market, 20, 1, OrderType::Ask}
+            };
+
+            auto results1 = PlaceOrdersFn(me, orders1);
+
+            EXPECTED(results1.size(), 3);
+
+            // Remove the order from the middle of the queue
+            EXPECTED(me.OnOrderCancel(1), OrderCancelEventResult::OrderCancelled);
+
+            std::vector<Order> orders2{
+                {market, 20, 2, OrderType::Bid}
+            };
+
+            auto results2 = PlaceOrdersFn(me, orders2);
+
+            EXPECTED(results2[0], OrderPlaceEventResult::OrderMatched);
+            EXPECTED(tc.m_matchingEvents.size(), 2);
+            EXPECTED(tc.m_matchingEvents[0], (MatchedOrder{marketID, 3, 0, 20, 1, OrderType::Ask}));
+            EXPECTED(tc.m_matchingEvents[1], (MatchedOrder{marketID, 3, 2, 20, 1, OrderType::Ask}));
+
+            // Orders that have been filled can no longer be cancelled
+            EXPECTED(me.OnOrderCancel(0), OrderCancelEventResult::OrderNotFound);
+            EXPECTED(me.OnOrderCancel(3), OrderCancelEventResult::OrderNotFound);
+            EXPECTED(tc.m_cancelEvents.size(), 1);
+        }
+
+        {
+            START_TEST( "Aggregated depth and its updates" )
+            MatchingEngine me;
+            const MarketID marketID = me.InitialiseMarkets({MarketConfig{market, layout}}).front();
+
+            TestClient tc;
+            me.RegisterEventObserver(&tc);
+
+            std::vector<Order> orders{
+                {market, 20, 1, OrderType::Ask},
+                {market, 20, 2, OrderType::Ask},
+                {market, 21, 4, OrderType::Ask},
+                {market, 23, 8, OrderType::Ask},
+                {market, 10, 3, OrderType::Bid}
+            };
+
+            PlaceOrdersFn(me, orders);
+
+            DepthLevel asks[4];
+            EXPECTED(me.GetDepth(marketID, OrderType::Ask, asks, 4), 3);
+            EXPECTED(asks[0].price, 20);
+            EXPECTED(asks[0].volume, 3);
+            EXPECTED(asks[0].orderCount, 2);
+            EXPECTED(asks[1].price, 21);
+            EXPECTED(asks[2].price, 23);
+            EXPECTED(asks[2].volume, 8);
+
+            // Only as many levels as asked for
+            EXPECTED(me.GetDepth(marketID, OrderType::Ask, asks, 2), 2);
+            EXPECTED(me.GetDepth(marketID, OrderType::Bid, asks, 4), 1);
+            EXPECTED(asks[0].price, 10);
+
+            // Each placement so far changed a single level
+            EXPECTED(tc.m_depthEvents.size(), 5);
+            EXPECTED(tc.m_depthEvents[1].size(), 1);
+            EXPECTED(tc.m_depthEvents[1][0].volume, 3);
+            EXPECTED(tc.m_depthEvents[1][0].orderCount, 2);
+
+            // A sweep reports each level it touched once, with its final state
+            EXPECTED(me.OnOrderPlace(Order{market, 22, 9, OrderType::Bid}), OrderPlaceEventResult::OrderMatched);
+
+            EXPECTED(tc.m_depthEvents.size(), 6);
+            EXPECTED(tc.m_depthEvents[5].size(), 3);
+            EXPECTED(tc.m_depthEvents[5][0].side, OrderType::Ask);
+            EXPECTED(tc.m_depthEvents[5][0].price, 20);
+            EXPECTED(tc.m_depthEvents[5][0].volume, 0);
+            EXPECTED(tc.m_depthEvents[5][0].orderCount, 0);
+            EXPECTED(tc.m_depthEvents[5][1].price, 21);
+            EXPECTED(tc.m_depthEvents[5][1].volume, 0);
+            EXPECTED(tc.m_depthEvents[5][2].side, OrderType::Bid);
+            EXPECTED(tc.m_depthEvents[5][2].price, 22);
+            EXPECTED(tc.m_depthEvents[5][2].volume, 2);
+            EXPECTED(tc.m_depthEvents[5][2].market, marketID);
+
+            // Fills say when they consumed the resting order
+            EXPECTED(tc.m_matchingEvents.size(), 3);
+            EXPECTED(tc.m_matchingEvents[0].restingVolumeRemaining, 0);
+            EXPECTED(tc.m_matchingEvents[2].restingVolumeRemaining, 0);
+
+            // Cancelling part of a level leaves the rest of its aggregate
+            EXPECTED(me.OnOrderPlace(Order{market, 10, 5, OrderType::Bid}), OrderPlaceEventResult::OrderPlaced);
+            EXPECTED(me.OnOrderCancel(4), OrderCancelEventResult::OrderCancelled);
+
+            EXPECTED(tc.m_depthEvents.back().size(), 1);
+            EXPECTED(tc.m_depthEvents.back()[0].volume, 5);
+            EXPECTED(tc.m_depthEvents.back()[0].orderCount, 1);
+
+            // Nothing changes the book, nothing is published
+            EXPECTED(me.OnOrderCancel(4), OrderCancelEventResult::OrderNotFound);
+            EXPECTED(tc.m_depthEvents.size(), 8);
+        }
+
+        {
+            START_TEST( "Immediate and market orders never rest" )
+            MatchingEngine me;
+            const MarketID marketID = me.InitialiseMarkets({MarketConfig{market, layout}}).front();
+
+            TestClient tc;
+            me.RegisterEventObserver(&tc);
+
+            std::vector<Order> orders{
+                {market, 20, 2, OrderType::Ask},
+                {market, 21, 3, OrderType::Ask},
+                {market, 10, 1, OrderType::Bid}
+            };
+
+            PlaceOrdersFn(me, orders);
+
+            // Takes what it can, the remainder is cancelled rather than resting
+            EXPECTED(me.OnOrderPlace(Order{market, 20, 5, OrderType::Bid, TimeInForce::ImmediateOrCancel}), OrderPlaceEventResult::OrderMatched);
+            EXPECTED(tc.m_matchingEvents.size(), 1);
+            EXPECTED(tc.m_matchingEvents[0], (MatchedOrder{marketID, 3, 0, 20, 2, OrderType::Ask}));
+            EXPECTED(tc.m_cancelEvents.size(), 1);
+            EXPECTED(tc.m_cancelEvents[0], 3);
+            EXPECTED(me.GetTopOfBook(marketID).bestBid, 10);
+            EXPECTED(me.GetTopOfBook(marketID).bestAsk, 21);
+
+            // Nothing crosses, so nothing happens beyond the order expiring
+            EXPECTED(me.OnOrderPlace(Order{market, 15, 1, OrderType::Bid, TimeInForce::ImmediateOrCancel}), OrderPlaceEventResult::OrderExpired);
+            EXPECTED(tc.m_cancelEvents.size(), 2);
+            EXPECTED(tc.m_cancelEvents[1], 4);
+            EXPECTED(me.GetTopOfBook(marketID).bestBid, 10);
+
+            // Not enough volume up to its price, killed without being given an ID
+            EXPECTED(me.OnOrderPlace(Order{market, 21, 4, OrderType::Bid, TimeInForce::FillOrKill}), OrderPlaceEventResult::OrderExpired);
+            EXPECTED(tc.m_orderBookUpdateEvents.size(), 5);
+            EXPECTED(tc.m_matchingEvents.size(), 1);
+            EXPECTED(tc.m_cancelEvents.size(), 2);
+
+            EXPECTED(me.OnOrderPlace(Order{market, 22, 3, OrderType::Bid, TimeInForce::FillOrKill}), OrderPlaceEventResult::OrderMatched);
+            EXPECTED(tc.m_matchingEvents.size(), 2);
+            EXPECTED(tc.m_matchingEvents[1], (MatchedOrder{marketID, 5, 1, 21, 3, OrderType::Ask}));
+            EXPECTED(tc.m_cancelEvents.size(), 2);
+            EXPECTED(me.GetTopOfBook(marketID).bestAsk, 0);
+
+            // Market orders need no price and match at any
+            const Order marketAsk{market, 0, 2, OrderType::Ask, TimeInForce::GoodTillCancel, OrderKind::Market};
+            EXPECTED(me.OnOrderPlace(Order{marketAsk}), OrderPlaceEventResult::OrderMatched);
+            EXPECTED(tc.m_matchingEvents.size(), 3);
+            EXPECTED(tc.m_matchingEvents[2], (MatchedOrder{marketID, 2, 6, 10, 1, OrderType::Bid}));
+            EXPECTED(tc.m_cancelEvents.size(), 3);
+            EXPECTED(tc.m_cancelEvents[2], 6);
+
+            const Order marketBid{market, 0, 1, OrderType::Bid, TimeInForce::GoodTillCancel, OrderKind::Market};
+            EXPECTED(me.OnOrderPlace(Order{marketBid}), OrderPlaceEventResult::OrderExpired);
+            EXPECTED(me.GetTopOfBook(marketID).bestBid, 0);
+            EXPECTED(me.GetTopOfBook(marketID).bestAsk, 0);
+
+            // A limit order still needs a price
+            EXPECTED(me.OnOrderPlace(Order{market, 0, 1, OrderType::Bid, TimeInForce::ImmediateOrCancel}), OrderPlaceEventResult::OrderCancelled);
+        }
+
+        {
+            START_TEST( "Modify keeps priority only when giving up quantity" )
+            MatchingEngine me;
+            const MarketID marketID = me.InitialiseMarkets({MarketConfig{market, layout}}).front();
+
+            TestClient tc;
+            me.RegisterEventObserver(&tc);
+
+            std::vector<Order> orders{
+                {market, 10, 5, OrderType::Bid},
+                {market, 10, 3, OrderType::Bid},
+                {market, 9, 1, OrderType::Bid},
+                {market, 12, 2, OrderType::Ask},
+                {market, 13, 4, OrderType::Ask}
+            };
+
+            PlaceOrdersFn(me, orders);
+
+            DepthLevel levels[4];
+
+            EXPECTED(me.OnOrderModify(0, 10, 2), OrderModifyEventResult::OrderModified);
+            EXPECTED(tc.m_modifyEvents.size(), 1);
+            EXPECTED(tc.m_modifyEvents[0].oid, 0);
+            EXPECTED(tc.m_modifyEvents[0].volume, 2);
+            EXPECTED(me.GetDepth(marketID, OrderType::Bid, levels, 4), 2);
+            EXPECTED(levels[0].volume, 5);
+            EXPECTED(levels[0].orderCount, 2);
+
+            // Adding quantity sends the order to the back of the queue
+            EXPECTED(me.OnOrderModify(0, 10, 4), OrderModifyEventResult::OrderModified);
+            EXPECTED(me.OnOrderPlace(Order{market, 10, 1, OrderType::Ask}), OrderPlaceEventResult::OrderMatched);
+            EXPECTED(tc.m_matchingEvents.size(), 1);
+            EXPECTED(tc.m_matchingEvents[0], (MatchedOrder{marketID, 1, 5, 10, 1, OrderType::Bid}));
+
+            // A new price short of the touch just moves the order
+            EXPECTED(me.OnOrderModify(2, 11, 1), OrderModifyEventResult::OrderModified);
+            EXPECTED(me.GetTopOfBook(marketID).bestBid, 11);
+            EXPECTED(tc.m_matchingEvents.size(), 1);
+
+            // Through the touch it trades under its own ID, the rest rests
+            EXPECTED(me.OnOrderModify(2, 12, 3), OrderModifyEventResult::OrderMatched);
+            EXPECTED(tc.m_matchingEvents.size(), 2);
+            EXPECTED(tc.m_matchingEvents[1], (MatchedOrder{marketID, 2, 3, 12, 2, OrderType::Ask}));
+            EXPECTED(me.GetTopOfBook(marketID).bestBid, 12);
+
+            // Observers hear of the modify after its fills, with what rests
+            EXPECTED(tc.m_modifyEvents.size(), 4);
+            EXPECTED(tc.m_modifyEvents[3].oid, 2);
+            EXPECTED(tc.m_modifyEvents[3].price, 12);
+            EXPECTED(tc.m_modifyEvents[3].volume, 1);
+            EXPECTED(me.GetTopOfBook(marketID).bestAsk, 13);
+
+            EXPECTED(me.OnOrderModify(4, 12, 4), OrderModifyEventResult::OrderMatched);
+            EXPECTED(tc.m_matchingEvents.size(), 3);
+            EXPECTED(tc.m_matchingEvents[2], (MatchedOrder{marketID, 2, 4, 12, 1, OrderType::Bid}));
+            EXPECTED(me.GetTopOfBook(marketID).bestBid, 10);
+            EXPECTED(me.GetTopOfBook(marketID).bestAsk, 12);
+
+            // Filled completely on the way, nothing is left to rest
+            EXPECTED(me.OnOrderModify(4, 10, 3), OrderModifyEventResult::OrderMatched);
+            EXPECTED(tc.m_matchingEvents.size(), 5);
+            EXPECTED(tc.m_matchingEvents[3], (MatchedOrder{marketID, 1, 4, 10, 2, OrderType::Bid}));
+            EXPECTED(tc.m_matchingEvents[4], (MatchedOrder{marketID, 0, 4, 10, 1, OrderType::Bid}));
+            EXPECTED(me.GetTopOfBook(marketID).bestAsk, 0);
+            EXPECTED(me.OnOrderCancel(4), OrderCancelEventResult::OrderNotFound);
+            EXPECTED(tc.m_modifyEvents.size(), 5);
+
+            EXPECTED(me.GetDepth(marketID, OrderType::Bid, levels, 4), 1);
+            EXPECTED(levels[0].volume, 3);
+
+            EXPECTED(me.OnOrderModify(42, 10, 1), OrderModifyEventResult::OrderNotFound);
+            EXPECTED(me.OnOrderModify(0, 0, 1), OrderModifyEventResult::OrderRejected);
+            EXPECTED(me.OnOrderModify(0, 10, 0), OrderModifyEventResult::OrderRejected);
+            EXPECTED(tc.m_modifyEvents.size(), 5);
+        }
+
+        {
+            START_TEST( "Mass cancel by owner, owner and market, or market" )
+            MatchingEngine me;
+            const auto marketIDs = me.InitialiseMarkets({MarketConfig{market, layout}, MarketConfig{"ETH-USD", layout}});
+
+            TestClient tc;
+            me.RegisterEventObserver(&tc);
+
+            const auto Owned = [](const std::string& m, Price price, Quantity volume, OrderType side, OwnerID owner)
+            {
+                return Order{m, price, volume, side, TimeInForce::GoodTillCancel, OrderKind::Limit, owner};
+            };
+
+            std::vector<Order> orders{
+                Owned(market, 10, 2, OrderType::Bid, 1),
+                Owned(market, 10, 3, OrderType::Bid, 2),
+                Owned(market, 12, 1, OrderType::Ask, 1),
+                Owned("ETH-USD", 7, 1, OrderType::Ask, 1),
+                Owned("ETH-USD", 5, 1, OrderType::Bid, 2),
+                {market, 9, 1, OrderType::Bid},
+                Owned(market, 10, 1, OrderType::Ask, 2)     // partly fills order 0
+            };
+
+            PlaceOrdersFn(me, orders);
+
+            // Only the owner's orders in the one market
+            EXPECTED(me.OnMassCancel(1, marketIDs[0]), OrderCancelEventResult::OrderCancelled);
+            EXPECTED(tc.m_massCancelEvents.size(), 1);
+            EXPECTED(tc.m_massCancelEvents[0], (std::vector<OrderID>{0, 2}));
+            EXPECTED(me.GetTopOfBook(marketIDs[0]).bestAsk, 0);
+            EXPECTED(me.GetTopOfBook(marketIDs[1]).bestAsk, 7);
+
+            DepthLevel levels[4];
+            EXPECTED(me.GetDepth(marketIDs[0], OrderType::Bid, levels, 4), 2);
+            EXPECTED(levels[0].volume, 3);
+            EXPECTED(levels[0].orderCount, 1);
+
+            EXPECTED(me.OnMassCancel(1), OrderCancelEventResult::OrderCancelled);
+            EXPECTED(tc.m_massCancelEvents[1], (std::vector<OrderID>{3}));
+            EXPECTED(me.OnMassCancel(1), OrderCancelEventResult::OrderNotFound);
+            EXPECTED(me.OnMassCancel(42), OrderCancelEventResult::OrderNotFound);
+            EXPECTED(tc.m_massCancelEvents.size(), 2);
+
+            // A whole market goes whoever owns its orders, a level at a time
+            const size_t depthEvents = tc.m_depthEvents.size();
+            EXPECTED(me.OnMassCancel(NoOwner, marketIDs[0]), OrderCancelEventResult::OrderCancelled);
+            EXPECTED(tc.m_massCancelEvents[2], (std::vector<OrderID>{1, 5}));
+            EXPECTED(tc.m_depthEvents.size(), depthEvents + 1);
+            EXPECTED(tc.m_depthEvents.back().size(), 2);
+            EXPECTED(tc.m_depthEvents.back()[0].orderCount, 0);
+            EXPECTED(me.GetTopOfBook(marketIDs[0]).bestBid, 0);
+            EXPECTED(me.OnMassCancel(NoOwner, marketIDs[0]), OrderCancelEventResult::OrderNotFound);
+            EXPECTED(me.OnMassCancel(NoOwner), OrderCancelEventResult::OrderNotFound);
+
+            // Orders leave their owner's list however they leave the book
+            EXPECTED(me.OnOrderCancel(4), OrderCancelEventResult::OrderCancelled);
+            EXPECTED(me.OnMassCancel(2), OrderCancelEventResult::OrderNotFound);
+
+            EXPECTED(tc.m_cancelEvents, (std::vector<OrderID>{0, 2, 3, 1, 5, 4}));
+
+            // The book is still sound once emptied
+            EXPECTED(me.OnOrderPlace(Owned(market, 10, 1, OrderType::Bid, 1)), OrderPlaceEventResult::OrderPlaced);
+            EXPECTED(me.OnOrderPlace(Order{market, 10, 1, OrderType::Ask}), OrderPlaceEventResult::OrderMatched);
+            EXPECTED(me.OnMassCancel(1), OrderCancelEventResult::OrderNotFound);
+        }
+
+        {
+            START_TEST( "Self-trade prevention in each mode" )
+
+            const auto Owned = [](const std::string& m, Price price, Quantity volume, OrderType side, OwnerID owner)
+            {
+                return Order{m, price, volume, side, TimeInForce::GoodTillCancel, OrderKind::Limit, owner};
+            };
+
+            // Owner 1 bids through two of its own asks with one of owner 2's between them
+            const auto Cross = [&](MatchingEngine& me, TestClient& tc, SelfTradePrevention mode)
+            {
+                MarketConfig config{market, layout};
+                config.selfTradePrevention = mode;
+                me.InitialiseMarkets({config});
+                me.RegisterEventObserver(&tc);
+
+                std::vector<Order> orders{
+                    Owned(market, 10, 2, OrderType::Ask, 1),
+                    Owned(market, 10, 1, OrderType::Ask, 2),
+                    Owned(market, 11, 3, OrderType::Ask, 1)
+                };
+
+                PlaceOrdersFn(me, orders);
+
+                return me.OnOrderPlace(Owned(market, 11, 4, OrderType::Bid, 1));
+            };
+
+            DepthLevel levels[4];
+
+            {
+                MatchingEngine me;
+                TestClient tc;
+                EXPECTED(Cross(me, tc, SelfTradePrevention::None), OrderPlaceEventResult::OrderMatched);
+                EXPECTED(tc.m_matchingEvents.size(), 3);
+                EXPECTED(tc.m_cancelEvents.empty(), true);
+            }
+
+            {
+                MatchingEngine me;
+                TestClient tc;
+                EXPECTED(Cross(me, tc, SelfTradePrevention::CancelNewest), OrderPlaceEventResult::OrderExpired);
+                EXPECTED(tc.m_matchingEvents.empty(), true);
+                EXPECTED(tc.m_cancelEvents, (std::vector<OrderID>{3}));
+                EXPECTED(me.GetDepth(0, OrderType::Ask, levels, 4), 2);
+                EXPECTED(levels[0].volume, 3);
+                EXPECTED(me.GetTopOfBook(0).bestBid, 0);
+
+                // Moving a resting order in to its owner's own is prevented too
+                EXPECTED(me.OnOrderPlace(Owned(market, 9, 1, OrderType::Bid, 1)), OrderPlaceEventResult::OrderPlaced);
+                EXPECTED(me.OnOrderModify(4, 10, 1), OrderModifyEventResult::OrderCancelled);
+                EXPECTED(tc.m_cancelEvents, (std::vector<OrderID>{3, 4}));
+                EXPECTED(me.OnOrderCancel(4), OrderCancelEventResult::OrderNotFound);
+                EXPECTED(tc.m_matchingEvents.empty(), true);
+
+                // Orders without an owner always trade
+                EXPECTED(me.OnOrderPlace(Order{market, 10, 3, OrderType::Bid}), OrderPlaceEventResult::OrderMatched);
+                EXPECTED(tc.m_matchingEvents.size(), 2);
+            }
+
+            {
+                MatchingEngine me;
+                TestClient tc;
+                EXPECTED(Cross(me, tc, SelfTradePrevention::CancelOldest), OrderPlaceEventResult::OrderMatched);
+                EXPECTED(tc.m_matchingEvents.size(), 1);
+                EXPECTED(tc.m_matchingEvents[0], (MatchedOrder{0, 3, 1, 10, 1, OrderType::Ask}));
+                EXPECTED(tc.m_cancelEvents, (std::vector<OrderID>{0, 2}));
+                EXPECTED(me.GetTopOfBook(0).bestAsk, 0);
+                EXPECTED(me.GetDepth(0, OrderType::Bid, levels, 4), 1);
+                EXPECTED(levels[0].price, 11);
+                EXPECTED(levels[0].volume, 3);
+                EXPECTED(me.GetRiskExposure(1)->GetOpenOrders(), 1);
+                EXPECTED(me.GetRiskExposure(1)->GetNotional(), 33);
+            }
+
+            {
+                MatchingEngine me;
+                TestClient tc;
+                EXPECTED(Cross(me, tc, SelfTradePrevention::CancelBoth), OrderPlaceEventResult::OrderExpired);
+                EXPECTED(tc.m_matchingEvents.empty(), true);
+                EXPECTED(tc.m_cancelEvents, (std::vector<OrderID>{0, 3}));
+                EXPECTED(me.GetDepth(0, OrderType::Ask, levels, 4), 2);
+                EXPECTED(levels[0].volume, 1);
+                EXPECTED(levels[0].orderCount, 1);
+                EXPECTED(me.GetRiskExposure(1)->GetOpenOrders(), 1);
+            }
+
+            {
+                MatchingEngine me;
+                TestClient tc;
+                EXPECTED(Cross(me, tc, SelfTradePrevention::Decrement), OrderPlaceEventResult::OrderMatched);
+                EXPECTED(tc.m_matchingEvents.size(), 1);
+                EXPECTED(tc.m_cancelEvents, (std::vector<OrderID>{0, 3}));
+
+                // A resting order is restated as it gives up volume, unless it is
+                // used up, the aggressor never reached the book
+                EXPECTED(tc.m_modifyEvents.size(), 1);
+                EXPECTED(tc.m_modifyEvents[0].oid, 2);
+                EXPECTED(tc.m_modifyEvents[0].volume, 2);
+                EXPECTED(me.GetDepth(0, OrderType::Ask, levels, 4), 1);
+                EXPECTED(levels[0].price, 11);
+                EXPECTED(levels[0].volume, 2);
+                EXPECTED(me.GetTopOfBook(0).bestBid, 0);
+                EXPECTED(me.GetRiskExposure(1)->GetNotional(), 22);
+
+                // An aggressor that comes to rest is restated once it is on the book
+                EXPECTED(me.OnOrderPlace(Owned(market, 11, 5, OrderType::Bid, 1)), OrderPlaceEventResult::OrderPlaced);
+                EXPECTED(tc.m_cancelEvents, (std::vector<OrderID>{0, 3, 2}));
+                EXPECTED(tc.m_modifyEvents.size(), 2);
+                EXPECTED(tc.m_modifyEvents[1].oid, 4);
+                EXPECTED(tc.m_modifyEvents[1].price, 11);
+                EXPECTED(tc.m_modifyEvents[1].volume, 3);
+                EXPECTED(me.GetTopOfBook(0).bestBid, 11);
+                EXPECTED(me.GetRiskExposure(1)->GetNotional(), 33);
+
+                // One used up partly without trading is reported cancelled after its fills
+                EXPECTED(me.OnOrderPlace(Owned(market, 10, 1, OrderType::Bid, 2)), OrderPlaceEventResult::OrderPlaced);
+                EXPECTED(me.OnOrderPlace(Owned(market, 10, 4, OrderType::Ask, 1)), OrderPlaceEventResult::OrderMatched);
+                EXPECTED(tc.m_matchingEvents.size(), 2);
+                EXPECTED(tc.m_matchingEvents[1], (MatchedOrder{0, 5, 6, 10, 1, OrderType::Bid}));
+                EXPECTED(tc.m_cancelEvents, (std::vector<OrderID>{0, 3, 2, 4, 6}));
+                EXPECTED(tc.m_modifyEvents.size(), 2);
+                EXPECTED(me.GetTopOfBook(0).bestBid, 0);
+                EXPECTED(me.GetTopOfBook(0).bestAsk, 0);
+            }
+        }
+
+        {
+            START_TEST( "Pro-rata and hybrid allocation within a level" )
+
+            // Asks of 10, 30 and 60 at one price, and a bid for a quarter of them
+            const auto Allocate = [&](MatchingPolicy policy, Quantity lotSize)
+            {
+                MatchingEngine me;
+                MarketConfig config{market, layout};
+                config.matchingPolicy = policy;
+                config.fifoPercent = 40;
+                config.lotSize = lotSize;
+                me.InitialiseMarkets({config});
+
+                TestClient tc;
+                me.RegisterEventObserver(&tc);
+
+                std::vector<Order> orders{
+                    {market, 10, 10, OrderType::Ask},
+                    {market, 10, 30, OrderType::Ask},
+                    {market, 10, 60, OrderType::Ask},
+                    {market, 10, 25, OrderType::Bid}
+                };
+
+                PlaceOrdersFn(me, orders);
+
+                DepthLevel levels[1];
+                EXPECTED(me.GetDepth(0, OrderType::Ask, levels, 1), 1);
+                EXPECTED(levels[0].volume, 75);
+
+                // Taking all that is left of the level goes in time priority
+                EXPECTED(me.OnOrderPlace(Order{market, 11, 80, OrderType::Bid}), OrderPlaceEventResult::OrderMatched);
+                EXPECTED(me.GetTopOfBook(0).bestAsk, 0);
+                EXPECTED(me.GetTopOfBook(0).bestBid, 11);
+
+                return tc.m_matchingEvents;
+            };
+
+            // The odd lot left over by rounding goes to the earliest order
+            std::vector<MatchedOrder> fills = Allocate(MatchingPolicy::ProRata, 1);
+            EXPECTED(fills.size(), 6);
+            EXPECTED(fills[0], (MatchedOrder{0, 3, 0, 10, 3, OrderType::Ask}));
+            EXPECTED(fills[1], (MatchedOrder{0, 3, 1, 10, 7, OrderType::Ask}));
+            EXPECTED(fills[2], (MatchedOrder{0, 3, 2, 10, 15, OrderType::Ask}));
+            EXPECTED(fills[3], (MatchedOrder{0, 4, 0, 10, 7, OrderType::Ask}));
+
+            // Allocations are made in whole lots
+            fills = Allocate(MatchingPolicy::ProRata, 5);
+            EXPECTED(fills.size(), 6);
+            EXPECTED(fills[0], (MatchedOrder{0, 3, 0, 10, 5, OrderType::Ask}));
+            EXPECTED(fills[1], (MatchedOrder{0, 3, 1, 10, 5, OrderType::Ask}));
+            EXPECTED(fills[2], (MatchedOrder{0, 3, 2, 10, 15, OrderType::Ask}));
+
+            // 40% of the bid in time priority, the rest pro-rata over what is left
+            fills = Allocate(MatchingPolicy::Hybrid, 1);
+            EXPECTED(fills.size(), 5);
+            EXPECTED(fills[0], (MatchedOrder{0, 3, 0, 10, 10, OrderType::Ask}));
+            EXPECTED(fills[1], (MatchedOrder{0, 3, 1, 10, 5, OrderType::Ask}));
+            EXPECTED(fills[2], (MatchedOrder{0, 3, 2, 10, 10, OrderType::Ask}));
+
+            fills = Allocate(MatchingPolicy::Fifo, 1);
+            EXPECTED(fills.size(), 4);
+            EXPECTED(fills[0], (MatchedOrder{0, 3, 0, 10, 10, OrderType::Ask}));
+            EXPECTED(fills[1], (MatchedOrder{0, 3, 1, 10, 15, OrderType::Ask}));
+
+            // Volumes whose products run past 64 bits are still shared exactly
+            {
+                MatchingEngine me;
+                MarketConfig config{market, layout};
+                config.matchingPolicy = MatchingPolicy::ProRata;
+                me.InitialiseMarkets({config});
+
+                TestClient tc;
+                me.RegisterEventObserver(&tc);
+
+                const Quantity large = Quantity{1} << 40;
+
+                std::vector<Order> orders{
+                    {market, 10, large, OrderType::Ask},
+                    {market, 10, 3 * large, OrderType::Ask},
+                    {market, 10, 2 * large, OrderType::Bid}
+                };
+
+                PlaceOrdersFn(me, orders);
+
+                EXPECTED(tc.m_matchingEvents.size(), 2);
+                EXPECTED(tc.m_matchingEvents[0], (MatchedOrder{0, 2, 0, 10, large / 2, OrderType::Ask}));
+                EXPECTED(tc.m_matchingEvents[1], (MatchedOrder{0, 2, 1, 10, 3 * large / 2, OrderType::Ask}));
+            }
+        }
+
+        {
+            START_TEST( "Stop orders wait for the market to trade through them" )
+            MatchingEngine me;
+            const MarketID marketID = me.InitialiseMarkets({MarketConfig{market, layout}}).front();
+
+            TestClient tc;
+            me.RegisterEventObserver(&tc);
+
+            const auto Stop = [](const std::string& m, Price price, Price stopPrice, Quantity volume, OrderType side, OwnerID owner = NoOwner)
+            {
+                return Order{m, price, volume, side, TimeInForce::GoodTillCancel,
+                    price == 0 ? OrderKind::Stop : OrderKind::StopLimit, owner, stopPrice};
+            };
+
+            std::vector<Order> orders{
+                {market, 10, 1, OrderType::Ask},
+                {market, 11, 1, OrderType::Ask},
+                {market, 12, 2, OrderType::Ask}
+            };
+
+            PlaceOrdersFn(me, orders);
+
+            // Stops are held away from the book
+            EXPECTED(me.OnOrderPlace(Stop(market, 0, 11, 1, OrderType::Bid)), OrderPlaceEventResult::OrderPlaced);
+            EXPECTED(me.OnOrderPlace(Stop(market, 12, 12, 1, OrderType::Bid)), OrderPlaceEventResult::OrderPlaced);
+            EXPECTED(me.OnOrderPlace(Stop(market, 0, 5, 1, OrderType::Ask)), OrderPlaceEventResult::OrderPlaced);
+            EXPECTED(tc.m_orderBookUpdateEvents.size(), 6);
+            EXPECTED(tc.m_orderBookUpdateEvents[3].second.kind, OrderKind::Stop);
+            EXPECTED(me.GetTopOfBook(marketID).bestBid, 0);
+
+            EXPECTED(me.OnOrderPlace(Stop(market, 0, 0, 1, OrderType::Bid)), OrderPlaceEventResult::OrderCancelled);
+            EXPECTED(me.OnOrderPlace(Stop(market, 12, 0, 1, OrderType::Bid)), OrderPlaceEventResult::OrderCancelled);
+            EXPECTED(me.OnOrderModify(5, 6, 1), OrderModifyEventResult::OrderNotFound);
+            EXPECTED(me.OnOrderCancel(5), OrderCancelEventResult::OrderCancelled);
+            EXPECTED(me.OnOrderCancel(5), OrderCancelEventResult::OrderNotFound);
+
+            // A trade short of every stop sets none of them off
+            EXPECTED(me.OnOrderPlace(Order{market, 10, 1, OrderType::Bid}), OrderPlaceEventResult::OrderMatched);
+            EXPECTED(tc.m_stopTriggeredEvents.empty(), true);
+
+            // Reaching the first stop cascades through the second
+            EXPECTED(me.OnOrderPlace(Order{market, 11, 1, OrderType::Bid}), OrderPlaceEventResult::OrderMatched);
+            EXPECTED(tc.m_stopTriggeredEvents.size(), 2);
+            EXPECTED(tc.m_stopTriggeredEvents[0].first, 3);
+            EXPECTED(tc.m_stopTriggeredEvents[0].second.kind, OrderKind::Market);
+            EXPECTED(tc.m_stopTriggeredEvents[1].first, 4);
+            EXPECTED(tc.m_stopTriggeredEvents[1].second.kind, OrderKind::Limit);
+            EXPECTED(tc.m_matchingEvents.size(), 4);
+            EXPECTED(tc.m_matchingEvents[1], (MatchedOrder{marketID, 7, 1, 11, 1, OrderType::Ask}));
+            EXPECTED(tc.m_matchingEvents[2], (MatchedOrder{marketID, 3, 2, 12, 1, OrderType::Ask}));
+            EXPECTED(tc.m_matchingEvents[3], (MatchedOrder{marketID, 4, 2, 12, 1, OrderType::Ask}));
+            EXPECTED(me.GetTopOfBook(marketID).bestAsk, 0);
+
+            // A stop the market has already traded through goes straight away
+            EXPECTED(me.OnOrderPlace(Order{market, 9, 1, OrderType::Bid}), OrderPlaceEventResult::OrderPlaced);
+            EXPECTED(me.OnOrderPlace(Stop(market, 0, 12, 1, OrderType::Ask)), OrderPlaceEventResult::OrderPlaced);
+            EXPECTED(tc.m_matchingEvents.size(), 5);
+            EXPECTED(tc.m_matchingEvents[4], (MatchedOrder{marketID, 8, 9, 9, 1, OrderType::Bid}));
+
+            // Stops sharing a stop price go in the order they arrived, the
+            // second finds nothing left to take and is cancelled
+            EXPECTED(me.OnOrderPlace(Stop(market, 0, 8, 1, OrderType::Ask)), OrderPlaceEventResult::OrderPlaced);
+            EXPECTED(me.OnOrderPlace(Stop(market, 0, 8, 1, OrderType::Ask)), OrderPlaceEventResult::OrderPlaced);
+            EXPECTED(me.OnOrderPlace(Order{market, 8, 2, OrderType::Bid}), OrderPlaceEventResult::OrderPlaced);
+            EXPECTED(me.OnOrderPlace(Order{market, 8, 1, OrderType::Ask}), OrderPlaceEventResult::OrderMatched);
+            EXPECTED(tc.m_stopTriggeredEvents.size(), 5);
+            EXPECTED(tc.m_stopTriggeredEvents[3].first, 10);
+            EXPECTED(tc.m_stopTriggeredEvents[4].first, 11);
+            EXPECTED(tc.m_matchingEvents.size(), 7);
+            EXPECTED(tc.m_matchingEvents[6], (MatchedOrder{marketID, 12, 10, 8, 1, OrderType::Bid}));
+            EXPECTED(tc.m_cancelEvents.back(), 11);
+
+            // A mass cancel takes an owner's stops with its resting orders
+            EXPECTED(me.OnOrderPlace(Stop(market, 0, 20, 1, OrderType::Bid, 3)), OrderPlaceEventResult::OrderPlaced);
+            EXPECTED(me.OnOrderPlace(Stop(market, 0, 20, 1, OrderType::Bid, 4)), OrderPlaceEventResult::OrderPlaced);
+            EXPECTED(me.OnMassCancel(3), OrderCancelEventResult::OrderCancelled);
+            EXPECTED(tc.m_massCancelEvents.back(), (std::vector<OrderID>{14}));
+            EXPECTED(me.OnMassCancel(NoOwner, marketID), OrderCancelEventResult::OrderCancelled);
+            EXPECTED(tc.m_massCancelEvents.back(), (std::vector<OrderID>{15}));
+            EXPECTED(me.OnOrderCancel(15), OrderCancelEventResult::OrderNotFound);
+        }
+    }
+
+    {
+        START_TEST( "Ladder levels outside of the window" )
         MatchingEngine me;
-        me.InitialiseMarkets({"BTC-USD"});
+
+        // Narrow window so that most of these prices land in the overflow
+        const MarketID marketID = me.InitialiseMarkets({MarketConfig{market, PriceLevelLayout::Ladder, 64}}).front();
 
         TestClient tc;
         me.RegisterEventObserver(&tc);
 
-        std::vector<Order> orders{
-            {market, 10, 2, OrderType::Bid},
-            {market, 11, 2, OrderType::Bid},
-            {market, 20, 2, OrderType::Ask},
-            {market, 21, 2, OrderType::Ask}
+        std::vector<Order> orders1{
+            {market, 100, 1, OrderType::Bid},
+            {market, 50, 1, OrderType::Bid},
+            {market, 10, 1, OrderType::Bid},
+            {market, 200, 1, OrderType::Ask},
+            {market, 400, 1, OrderType::Ask},
+            {market, 120, 1, OrderType::Ask}     // improves on the ask window
         };
 
-        auto results = PlaceOrdersFn(me, orders);
+        auto results1 = PlaceOrdersFn(me, orders1);
 
-        // Check no matches occurred
+        EXPECTED(results1.size(), 6);
         EXPECTED(tc.m_matchingEvents.empty(), true);
 
-        // Check we received the response codes we expect
-        EXPECTED(results.size(), 4);
-        EXPECTED(results[0], OrderPlaceEventResult::OrderPlaced);
-        EXPECTED(results[1], OrderPlaceEventResult::OrderPlaced);
-        EXPECTED(results[2], OrderPlaceEventResult::OrderPlaced);
-        EXPECTED(results[3], OrderPlaceEventResult::OrderPlaced);
+        // Cancel a level held in the overflow
+        EXPECTED(me.OnOrderCancel(1), OrderCancelEventResult::OrderCancelled);
 
-        // Check the correct events were emitted
-        EXPECTED(tc.m_orderBookUpdateEvents.size(), 4);
-        EXPECTED(tc.m_orderBookUpdateEvents[0].first, 0);
-        EXPECTED(tc.m_orderBookUpdateEvents[0].second, orders[0]);
-        EXPECTED(tc.m_orderBookUpdateEvents[1].first, 1);
-        EXPECTED(tc.m_orderBookUpdateEvents[1].second, orders[1]);
-        EXPECTED(tc.m_orderBookUpdateEvents[2].first, 2);
-        EXPECTED(tc.m_orderBookUpdateEvents[2].second, orders[2]);
-        EXPECTED(tc.m_orderBookUpdateEvents[3].first, 3);
-        EXPECTED(tc.m_orderBookUpdateEvents[3].second, orders[3]);
-
-        // Check nothing was cancelled
-        EXPECTED(tc.m_cancelEvents.empty(), true);
+        // Sweep every remaining bid, the window has to pull the
+        // deepest level back in from the overflow to reach it
+        std::vector<Order> orders2{
+            {market, 5, 3, OrderType::Ask}
+        };
+
+        auto results2 = PlaceOrdersFn(me, orders2);
+
+        EXPECTED(results2[0], OrderPlaceEventResult::OrderMatched);
+        EXPECTED(tc.m_matchingEvents.size(), 2);
+        EXPECTED(tc.m_matchingEvents[0], (MatchedOrder{marketID, 0, 6, 100, 1, OrderType::Bid}));
+        EXPECTED(tc.m_matchingEvents[1], (MatchedOrder{marketID, 2, 6, 10, 1, OrderType::Bid}));
+
+        // Remaining ask volume rests at 5 and is now the best ask,
+        // which a bid sweeps through along with every other ask
+        std::vector<Order> orders3{
+            {market, 400, 4, OrderType::Bid}
+        };
+
+        auto results3 = PlaceOrdersFn(me, orders3);
+
+        EXPECTED(results3[0], OrderPlaceEventResult::OrderMatched);
+        EXPECTED(tc.m_matchingEvents.size(), 6);
+        EXPECTED(tc.m_matchingEvents[2], (MatchedOrder{marketID, 7, 6, 5, 1, OrderType::Ask}));
+        EXPECTED(tc.m_matchingEvents[3], (MatchedOrder{marketID, 7, 5, 120, 1, OrderType::Ask}));
+        EXPECTED(tc.m_matchingEvents[4], (MatchedOrder{marketID, 7, 3, 200, 1, OrderType::Ask}));
+        EXPECTED(tc.m_matchingEvents[5], (MatchedOrder{marketID, 7, 4, 400, 1, OrderType::Ask}));
     }
 
     {
-        START_TEST( "Cancel position" )
+        START_TEST( "Prices on the tick and sizes in whole lots" )
         MatchingEngine me;
-        me.InitialiseMarkets({"BTC-USD"});
+
+        // Prices to two decimal places in steps of 0.05, sizes in lots of
+        // 100. A 64 tick window then spans 3.20 either side of its centre.
+        const MarketID marketID = me.InitialiseMarkets({MarketConfig{market, PriceLevelLayout::Ladder, 64, 2, 5, 100}}).front();
 
         TestClient tc;
         me.RegisterEventObserver(&tc);
 
-        std::vector<Order> orders{
-            {market, 10, 2, OrderType::Bid},
-            {market, 11, 2, OrderType::Bid},
-            {market, 20, 2, OrderType::Ask},
-            {market, 21, 2, OrderType::Ask}
+        EXPECTED(ToFixedPoint(100.05, 2), 10005);
+        EXPECTED(ToFixedPoint(0.1, 2), 10);
+
+        const Quantity large{uint64_t{100} << 32};
+
+        EXPECTED(me.OnOrderPlace(marketID, Order{{}, 10005, 200, OrderType::Bid}), OrderPlaceEventResult::OrderPlaced);
+        EXPECTED(me.OnOrderPlace(marketID, Order{{}, 10000, large, OrderType::Bid}), OrderPlaceEventResult::OrderPlaced);
+        EXPECTED(me.OnOrderPlace(marketID, Order{{}, 9000, 100, OrderType::Bid}), OrderPlaceEventResult::OrderPlaced);
+
+        // Off the tick, off the lot and empty orders are all turned away
+        EXPECTED(me.OnOrderPlace(marketID, Order{{}, 10003, 100, OrderType::Ask}), OrderPlaceEventResult::OrderCancelled);
+        EXPECTED(me.OnOrderPlace(marketID, Order{{}, 10010, 150, OrderType::Ask}), OrderPlaceEventResult::OrderCancelled);
+        EXPECTED(me.OnOrderPlace(marketID, Order{{}, 10010, 0, OrderType::Ask}), OrderPlaceEventResult::OrderCancelled);
+        EXPECTED(tc.m_orderBookUpdateEvents.size(), 3);
+
+        EXPECTED(me.GetTopOfBook(marketID).bestBid, 10005);
+
+        DepthLevel levels[4];
+        EXPECTED(me.GetDepth(marketID, OrderType::Bid, levels, 4), 3);
+        EXPECTED(levels[1].price, 10000);
+        EXPECTED(levels[1].volume, large);
+        EXPECTED(levels[2].price, 9000);
+
+        // Sweep both near levels with a single order larger than 32 bits
+        // can hold, trading at the resting prices
+        EXPECTED(me.OnOrderPlace(marketID, Order{{}, 10000, large + 300, OrderType::Ask}), OrderPlaceEventResult::OrderMatched);
+        EXPECTED(tc.m_matchingEvents.size(), 2);
+        EXPECTED(tc.m_matchingEvents[0], (MatchedOrder{marketID, 0, 3, 10005, 200, OrderType::Bid}));
+        EXPECTED(tc.m_matchingEvents[1], (MatchedOrder{marketID, 1, 3, 10000, large, OrderType::Bid}));
+
+        EXPECTED(me.GetTopOfBook(marketID).bestBid, 9000);
+        EXPECTED(me.GetTopOfBook(marketID).bestAsk, 10000);
+        EXPECTED(me.GetDepth(marketID, OrderType::Ask, levels, 4), 1);
+        EXPECTED(levels[0].volume, 100);
+    }
+
+    {
+        START_TEST( "Pre-trade risk limits per account" )
+
+        MatchingEngine me;
+        me.InitialiseMarkets({market});
+
+        const auto Owned = [&market](Price price, Quantity volume, OrderType side)
+        {
+            return Order{market, price, volume, side, TimeInForce::GoodTillCancel, OrderKind::Limit, 1};
         };
 
-        auto results = PlaceOrdersFn(me, orders);
+        RiskLimits limits;
+        limits.maxOrderVolume = 10;
+        limits.priceBandBasisPoints = 1000;
+        limits.maxOpenOrders = 3;
+        limits.maxNotional = 1000;
+
+        const RiskExposure& exposure = me.SetRiskLimits(1, limits);
+        EXPECTED(me.GetRiskExposure(1), &exposure);
+        EXPECTED(me.GetRiskExposure(2), nullptr);
+
+        // Refused before being given an ID
+        EXPECTED(me.OnOrderPlace(Owned(100, 11, OrderType::Bid)), OrderPlaceEventResult::RiskRejected);
+        EXPECTED(me.OnOrderPlace(Owned(100, 4, OrderType::Bid)), OrderPlaceEventResult::OrderPlaced);
+        EXPECTED(exposure.GetOpenOrders(), 1);
+        EXPECTED(exposure.GetNotional(), 400);
+
+        // Until the market trades the band is centred on the touch
+        EXPECTED(me.OnOrderPlace(Owned(89, 1, OrderType::Bid)), OrderPlaceEventResult::RiskRejected);
+        EXPECTED(me.OnOrderPlace(Owned(95, 2, OrderType::Bid)), OrderPlaceEventResult::OrderPlaced);
+        EXPECTED(me.OnOrderPlace(Owned(95, 5, OrderType::Bid)), OrderPlaceEventResult::RiskRejected);
+
+        // Orders without an owner are never checked
+        EXPECTED(me.OnOrderPlace(Order{market, 105, 20, OrderType::Ask}), OrderPlaceEventResult::OrderPlaced);
+        EXPECTED(me.OnOrderPlace(Owned(100, 1, OrderType::Bid)), OrderPlaceEventResult::OrderPlaced);
+        EXPECTED(me.OnOrderPlace(Owned(100, 1, OrderType::Bid)), OrderPlaceEventResult::RiskRejected);
+        EXPECTED(exposure.GetOpenOrders(), 3);
+        EXPECTED(exposure.GetNotional(), 690);
+
+        // Fills and cancels hand exposure back as they happen
+        EXPECTED(me.OnOrderPlace(Order{market, 100, 3, OrderType::Ask}), OrderPlaceEventResult::OrderMatched);
+        EXPECTED(exposure.GetOpenOrders(), 3);
+        EXPECTED(exposure.GetNotional(), 390);
+        EXPECTED(me.OnOrderCancel(1), OrderCancelEventResult::OrderCancelled);
+        EXPECTED(exposure.GetOpenOrders(), 2);
+        EXPECTED(exposure.GetNotional(), 200);
+
+        // Once traded the band follows the last trade
+        EXPECTED(me.OnOrderPlace(Owned(111, 1, OrderType::Ask)), OrderPlaceEventResult::RiskRejected);
+        EXPECTED(me.OnOrderPlace(Owned(110, 1, OrderType::Ask)), OrderPlaceEventResult::OrderPlaced);
+        EXPECTED(exposure.GetNotional(), 310);
+
+        // Amendments are checked in place of the order they replace
+        EXPECTED(me.OnOrderModify(3, 100, 11), OrderModifyEventResult::OrderRejected);
+        EXPECTED(me.OnOrderModify(3, 100, 8), OrderModifyEventResult::OrderRejected);
+        EXPECTED(me.OnOrderModify(3, 100, 7), OrderModifyEventResult::OrderModified);
+        EXPECTED(exposure.GetOpenOrders(), 3);
+        EXPECTED(exposure.GetNotional(), 910);
+        EXPECTED(me.OnOrderModify(3, 100, 2), OrderModifyEventResult::OrderModified);
+        EXPECTED(exposure.GetNotional(), 410);
+
+        EXPECTED(me.OnMassCancel(1), OrderCancelEventResult::OrderCancelled);
+        EXPECTED(exposure.GetOpenOrders(), 0);
+        EXPECTED(exposure.GetNotional(), 0);
+    }
+
+    {
+        START_TEST( "Place orders by market handle" )
+        MatchingEngine me;
+        const std::vector<MarketID> marketIDs = me.InitialiseMarkets({"BTC-USD", "ETH-USD"});
 
-        // Check no matches occurred
+        TestClient tc;
+        me.RegisterEventObserver(&tc);
+
+        EXPECTED(marketIDs.size(), 2);
+        EXPECTED(me.GetMarketID("ETH-USD"), marketIDs[1]);
+        EXPECTED(me.GetMarketName(marketIDs[0]), market);
+
+        // Registering a market again hands back the existing handle
+        EXPECTED(me.InitialiseMarkets({"ETH-USD"}).front(), marketIDs[1]);
+
+        const MarketID btcUsd = marketIDs[0];
+        const MarketID ethUsd = marketIDs[1];
+
+        EXPECTED(me.OnOrderPlace(btcUsd, Order{{}, 10, 1, OrderType::Bid}), OrderPlaceEventResult::OrderPlaced);
+        EXPECTED(me.OnOrderPlace(ethUsd, Order{{}, 9, 1, OrderType::Ask}), OrderPlaceEventResult::OrderPlaced);
+        EXPECTED(me.OnOrderPlace(InvalidMarketID, Order{{}, 9, 1, OrderType::Ask}), OrderPlaceEventResult::OrderCancelled);
+
+        // Orders on different markets never match
         EXPECTED(tc.m_matchingEvents.empty(), true);
+        EXPECTED(tc.m_orderBookUpdateEvents.size(), 2);
+        EXPECTED(tc.m_orderBookUpdateEvents[1].second.marketID, ethUsd);
 
-        // Check we received the response codes we expect
-        EXPECTED(results.size(), 4);
-        EXPECTED(results[0], OrderPlaceEventResult::OrderPlaced);
-        EXPECTED(results[1], OrderPlaceEventResult::OrderPlaced);
-        EXPECTED(results[2], OrderPlaceEventResult::OrderPlaced);
-        EXPECTED(results[3], OrderPlaceEventResult::OrderPlaced);
+        // Handles and names can be mixed freely
+        EXPECTED(me.OnOrderPlace(Order{"ETH-USD", 9, 1, OrderType::Bid}), OrderPlaceEventResult::OrderMatched);
+        EXPECTED(tc.m_matchingEvents.size(), 1);
+        EXPECTED(tc.m_matchingEvents[0], (MatchedOrder{ethUsd, 2, 1, 9, 1, OrderType::Ask}));
+    }
 
-        // Check the correct events were emitted
-        EXPECTED(tc.m_orderBookUpdateEvents.size(), 4);
-        EXPECTED(tc.m_orderBookUpdateEvents[0].first, 0);
-        EXPECTED(tc.m_orderBookUpdateEvents[0].second, orders[0]);
-        EXPECTED(tc.m_orderBookUpdateEvents[1].first, 1);
-        EXPECTED(tc.m_orderBookUpdateEvents[1].second, orders[1]);
-        EXPECTED(tc.m_orderBookUpdateEvents[2].first, 2);
-        EXPECTED(tc.m_orderBookUpdateEvents[2].second, orders[2]);
-        EXPECTED(tc.m_orderBookUpdateEvents[3].first, 3);
-        EXPECTED(tc.m_orderBookUpdateEvents[3].second, orders[3]);
-
-        // Cancel two positions
-        OrderCancelEventResult result1 = me.OnOrderCancel(1);
-        OrderCancelEventResult result2 = me.OnOrderCancel(3);
-
-        EXPECTED(result1, OrderCancelEventResult::OrderCancelled);
-        EXPECTED(result2, OrderCancelEventResult::OrderCancelled);
-
-        // Check the correct events were emitted
-        EXPECTED(tc.m_cancelEvents.size(), 2);
-        EXPECTED(tc.m_cancelEvents[0], 1);
-        EXPECTED(tc.m_cancelEvents[1], 3);
-
-        // Attempt to cancel an order that doesn't exist
-        OrderCancelEventResult result3 = me.OnOrderCancel(1000);
-
-        EXPECTED(result3, OrderCancelEventResult::OrderNotFound);
-
-        // Check the no new events were emitted
-        EXPECTED(tc.m_cancelEvents.size(), 2);
+    {
+        START_TEST( "Steady state matching allocates nothing" )
+        CountingResource resource;
+
+        {
+            EngineConfig config;
+            config.reservedOrders = 1024;
+            config.memoryResource = &resource;
+
+            MatchingEngine me{config};
+
+            MarketConfig mapMarket{market, PriceLevelLayout::Map};
+            MarketConfig ladderMarket{"ETH-USD", PriceLevelLayout::Ladder, 64};
+            mapMarket.arenaBytes = 1 << 16;
+            ladderMarket.arenaBytes = 1 << 16;
+
+            const std::vector<MarketID> marketIDs = me.InitialiseMarkets({mapMarket, ladderMarket});
+
+            // Fills both sides, with a level out beyond a ladder's window on
+            // each, then sweeps them both away and cancels a lone order
+            OrderID nextID{0};
+
+            const auto Cycle = [&me, &nextID](MarketID marketID)
+            {
+                for(Price price = 100; price < 120; ++price)
+                {
+                    me.OnOrderPlace(marketID, Order{{}, price, 1, OrderType::Bid});
+                    me.OnOrderPlace(marketID, Order{{}, price + 30, 1, OrderType::Ask});
+                }
+
+                me.OnOrderPlace(marketID, Order{{}, 10, 1, OrderType::Bid});
+                me.OnOrderPlace(marketID, Order{{}, 1000, 1, OrderType::Ask});
+
+                me.OnOrderPlace(marketID, Order{{}, 10, 21, OrderType::Ask});
+                me.OnOrderPlace(marketID, Order{{}, 1000, 21, OrderType::Bid});
+
+                // 44 orders placed so far this cycle
+                const OrderPlaceEventResult placed = me.OnOrderPlace(marketID, Order{{}, 50, 1, OrderType::Bid});
+                nextID += 45;
+
+                return placed == OrderPlaceEventResult::OrderPlaced
+                    && me.OnOrderCancel(nextID - 1) == OrderCancelEventResult::OrderCancelled;
+            };
+
+            for(MarketID marketID : marketIDs)
+            {
+                EXPECTED(Cycle(marketID), true);
+            }
+
+            const size_t warmedUp = resource.m_allocations;
+            EXPECTED((warmedUp > 0), true);
+
+            for(int i = 0; i < 10; ++i)
+            {
+                for(MarketID marketID : marketIDs)
+                {
+                    EXPECTED(Cycle(marketID), true);
+                }
+            }
+
+            EXPECTED(resource.m_allocations, warmedUp);
+        }
+
+        // Everything drawn from the resource is handed back
+        EXPECTED(resource.m_deallocations, resource.m_allocations);
     }
 
     {
-        START_TEST( "Test rejecting invalid orders" )
-        MatchingEngine me;
+        START_TEST( "Compile time event sinks" )
+
+        // Runtime observers can sit alongside sinks bound at compile time
+        BasicMatchingEngine<MatchCountingSink, ExchangeEventObservers> me;
         me.InitialiseMarkets({"BTC-USD"});
 
         TestClient tc;
-        me.RegisterEventObserver(&tc);
+        me.GetSink<ExchangeEventObservers>().Register(&tc);
 
         std::vector<Order> orders{
-            {market, 0, 2, OrderType::Bid},     // No price
-            {market, 11, 0, OrderType::Bid},    // no volume
-            {"BTC-NOTVALID", 11, 0, OrderType::Bid}     // another market
+            {market, 10, 1, OrderType::Bid},
+            {market, 10, 1, OrderType::Bid},
+            {market, 10, 3, OrderType::Ask}
         };
 
-        auto results = PlaceOrdersFn(me, orders);
+        for(const auto& order : orders)
+        {
+            me.OnOrderPlace(Order{order});
+        }
 
-        // Check no matches occurred
-        EXPECTED(tc.m_matchingEvents.empty(), true);
+        EXPECTED(me.GetSink<MatchCountingSink>().m_matches, 2);
+        EXPECTED(me.GetSink<MatchCountingSink>().m_volume, 2);
+        EXPECTED(tc.m_matchingEvents.size(), 2);
+        EXPECTED(tc.m_orderBookUpdateEvents.size(), 3);
+
+        // An engine with no sinks at all still matches
+        BasicMatchingEngine<> silent;
+        silent.InitialiseMarkets({"BTC-USD"});
+        EXPECTED(silent.OnOrderPlace(Order{market, 10, 1, OrderType::Bid}), OrderPlaceEventResult::OrderPlaced);
+        EXPECTED(silent.OnOrderPlace(Order{market, 10, 1, OrderType::Ask}), OrderPlaceEventResult::OrderMatched);
+    }
+
+    {
+        START_TEST( "Batched placements and cancels" )
+        MatchingEngine me;
+        const std::vector<MarketID> marketIDs = me.InitialiseMarkets({"BTC-USD", "ETH-USD"});
+
+        TestClient tc;
+        me.RegisterEventObserver(&tc);
+
+        std::vector<OrderRequest> requests{
+            {OrderRequestType::Place, marketIDs[0], {{}, 10, 2, OrderType::Bid}},
+            {OrderRequestType::Place, marketIDs[0], {{}, 11, 1, OrderType::Bid}},
+            {OrderRequestType::Place, InvalidMarketID, {"ETH-USD", 20, 1, OrderType::Ask}},
+            {OrderRequestType::Place, InvalidMarketID, {"ETH-USD", 0, 1, OrderType::Ask}},
+            {OrderRequestType::Cancel, InvalidMarketID, {}, 1},
+            {OrderRequestType::Place, marketIDs[0], {{}, 9, 3, OrderType::Ask}},
+            {OrderRequestType::Place, InvalidMarketID, {"BTC-NOTVALID", 9, 3, OrderType::Ask}},
+            {OrderRequestType::Cancel, InvalidMarketID, {}, 1}
+        };
 
-        // Check we received the response codes we expect
-        EXPECTED(results.size(), 3);
-        EXPECTED(results[0], OrderPlaceEventResult::OrderCancelled);
-        EXPECTED(results[1], OrderPlaceEventResult::OrderCancelled);
-        EXPECTED(results[2], OrderPlaceEventResult::OrderCancelled);
+        std::vector<OrderRequestResult> results(requests.size());
 
-        // Check no events were emitted
-        EXPECTED(tc.m_orderBookUpdateEvents.size(), 0);
+        me.OnOrderBatch(requests.data(), requests.size(), results.data());
 
-        // Check nothing was cancelled
-        EXPECTED(tc.m_cancelEvents.empty(), true);
+        EXPECTED(results[0].placed, OrderPlaceEventResult::OrderPlaced);
+        EXPECTED(results[1].placed, OrderPlaceEventResult::OrderPlaced);
+        EXPECTED(results[2].placed, OrderPlaceEventResult::OrderPlaced);
+        EXPECTED(results[3].placed, OrderPlaceEventResult::OrderCancelled);
+        EXPECTED(results[4].cancelled, OrderCancelEventResult::OrderCancelled);
+        EXPECTED(results[5].placed, OrderPlaceEventResult::OrderMatched);
+        EXPECTED(results[6].placed, OrderPlaceEventResult::OrderCancelled);
+        EXPECTED(results[7].cancelled, OrderCancelEventResult::OrderNotFound);
+
+        // Requests are handled in the sequence they were given
+        EXPECTED(tc.m_orderBookUpdateEvents.size(), 4);
+        EXPECTED(tc.m_orderBookUpdateEvents[2].second.marketID, marketIDs[1]);
+        EXPECTED(tc.m_cancelEvents.size(), 1);
+        EXPECTED(tc.m_matchingEvents.size(), 1);
+        EXPECTED(tc.m_matchingEvents[0], (MatchedOrder{marketIDs[0], 0, 3, 10, 2, OrderType::Bid}));
     }
 
     {
-        START_TEST( "Simple matching tests initiated by BID" )
-        MatchingEngine me;
+        START_TEST( "Order IDs spanning several index chunks" )
+        MatchingEngine me{EngineConfig{1024}};
         me.InitialiseMarkets({"BTC-USD"});
 
         TestClient tc;
         me.RegisterEventObserver(&tc);
 
-        std::vector<Order> orders1{
-            {market, 10, 2, OrderType::Bid},
-            {market, 11, 2, OrderType::Bid},
-            {market, 20, 1, OrderType::Ask},
-            {market, 20, 1, OrderType::Ask},
-            {market, 21, 2, OrderType::Ask}
-        };
+        // Enough orders that the index has to grow past its first chunks
+        // and recycle them once every order in them has been filled
+        const OrderID orderCount{200000};
 
-        auto results1 = PlaceOrdersFn(me, orders1);
+        for(OrderID i = 0; i < orderCount; ++i)
+        {
+            me.OnOrderPlace(Order{market, 10, 1, i % 2 == 0 ? OrderType::Bid : OrderType::Ask});
+        }
 
-        // Check no matches occurred
-        EXPECTED(tc.m_matchingEvents.empty(), true);
+        EXPECTED(tc.m_matchingEvents.size(), orderCount / 2);
 
-        // Check we received the response codes we expect
-        EXPECTED(results1.size(), 5);
-        EXPECTED(results1[0], OrderPlaceEventResult::OrderPlaced);
-        EXPECTED(results1[1], OrderPlaceEventResult::OrderPlaced);
-        EXPECTED(results1[2], OrderPlaceEventResult::OrderPlaced);
-        EXPECTED(results1[3], OrderPlaceEventResult::OrderPlaced);
-        EXPECTED(results1[4], OrderPlaceEventResult::OrderPlaced);
-
-        // Check the correct events were emitted
-        EXPECTED(tc.m_orderBookUpdateEvents.size(), 5);
-        EXPECTED(tc.m_orderBookUpdateEvents[0].first, 0);
-        EXPECTED(tc.m_orderBookUpdateEvents[0].second, orders1[0]);
-        EXPECTED(tc.m_orderBookUpdateEvents[1].first, 1);
-        EXPECTED(tc.m_orderBookUpdateEvents[1].second, orders1[1]);
-        EXPECTED(tc.m_orderBookUpdateEvents[2].first, 2);
-        EXPECTED(tc.m_orderBookUpdateEvents[2].second, orders1[2]);
-        EXPECTED(tc.m_orderBookUpdateEvents[3].first, 3);
-        EXPECTED(tc.m_orderBookUpdateEvents[3].second, orders1[3]);
-        EXPECTED(tc.m_orderBookUpdateEvents[4].first, 4);
-        EXPECTED(tc.m_orderBookUpdateEvents[4].second, orders1[4]);
-
-        // After initially populating a simple orderbook, now
-        // place an order that crosses an existing ASK positions
-
-        // This order should match the orders at price 20, then partially at 21
-        std::vector<Order> orders2{
-            {market, 21, 3, OrderType::Bid},
-        };
+        // Leave one order resting and check it can still be found
+        me.OnOrderPlace(Order{market, 10, 1, OrderType::Bid});
 
-        auto results2 = PlaceOrdersFn(me, orders2);
+        EXPECTED(me.OnOrderCancel(0), OrderCancelEventResult::OrderNotFound);
+        EXPECTED(me.OnOrderCancel(orderCount - 1), OrderCancelEventResult::OrderNotFound);
+        EXPECTED(me.OnOrderCancel(orderCount), OrderCancelEventResult::OrderCancelled);
+        EXPECTED(me.OnOrderCancel(orderCount), OrderCancelEventResult::OrderNotFound);
+    }
 
-        // Check we received the response codes we expect
-        EXPECTED(results2.size(), 1);
-        EXPECTED(results2[0], OrderPlaceEventResult::OrderMatched);
+    {
+        START_TEST( "Sharded engine matches each market on its own shard" )
+        ShardedEngineConfig config;
+        config.shardCount = 2;
+        config.pinThreads = false;
+
+        ShardedMatchingEngine sme{config};
+        const std::vector<MarketID> marketIDs = sme.InitialiseMarkets({"BTC-USD", "ETH-USD"});
+
+        // Each shard reports on its own thread, so give each its own client
+        TestClient tc0;
+        TestClient tc1;
+        sme.RegisterEventObserver(0, &tc0);
+        sme.RegisterEventObserver(1, &tc1);
+
+        EXPECTED(sme.GetShardForMarket(marketIDs[0]), 0);
+        EXPECTED(sme.GetShardForMarket(marketIDs[1]), 1);
+
+        sme.Start();
+
+        EXPECTED(sme.OnOrderPlace(Order{market, 10, 2, OrderType::Bid}), OrderPlaceEventResult::OrderQueued);
+        EXPECTED(sme.OnOrderPlace(Order{market, 10, 1, OrderType::Ask}), OrderPlaceEventResult::OrderQueued);
+        EXPECTED(sme.OnOrderPlace(marketIDs[1], Order{{}, 20, 1, OrderType::Ask}), OrderPlaceEventResult::OrderQueued);
+        EXPECTED(sme.OnOrderPlace(marketIDs[1], Order{{}, 21, 1, OrderType::Ask}), OrderPlaceEventResult::OrderQueued);
+        EXPECTED(sme.OnOrderPlace(Order{"BTC-NOTVALID", 10, 1, OrderType::Ask}), OrderPlaceEventResult::OrderCancelled);
+
+        sme.Stop();
 
-        EXPECTED(tc.m_matchingEvents.size(), 3);
+        const OrderID firstShard1OrderID = OrderID{1} << OrderIDShardShift;
+
+        EXPECTED(tc0.m_orderBookUpdateEvents.size(), 2);
+        EXPECTED(tc0.m_matchingEvents.size(), 1);
+        EXPECTED(tc0.m_matchingEvents[0], (MatchedOrder{marketIDs[0], 0, 1, 10, 1, OrderType::Bid}));
+
+        EXPECTED(tc1.m_orderBookUpdateEvents.size(), 2);
+        EXPECTED(tc1.m_orderBookUpdateEvents[0].first, firstShard1OrderID);
+        EXPECTED(tc1.m_orderBookUpdateEvents[1].first, firstShard1OrderID + 1);
+        EXPECTED(tc1.m_matchingEvents.empty(), true);
+
+        // Cancels are routed by the shard held in the order ID
+        sme.Start();
+
+        EXPECTED(sme.OnOrderCancel(firstShard1OrderID + 1), OrderCancelEventResult::CancelQueued);
+        EXPECTED(sme.OnOrderCancel(OrderID{7} << OrderIDShardShift), OrderCancelEventResult::OrderNotFound);
+
+        sme.Stop();
+
+        EXPECTED(tc0.m_cancelEvents.empty(), true);
+        EXPECTED(tc1.m_cancelEvents.size(), 1);
+        EXPECTED(tc1.m_cancelEvents[0], firstShard1OrderID + 1);
+    }
+
+    {
+        START_TEST( "Sharded engine only sets aside a market's arena on its own shard" )
+        CountingResource resource;
+
+        ShardedEngineConfig config;
+        config.shardCount = 2;
+        config.pinThreads = false;
+        config.engine.reservedOrders = 16;
+        config.engine.memoryResource = &resource;
+
+        ShardedMatchingEngine sme{config};
+
+        MarketConfig btcUsd{"BTC-USD", PriceLevelLayout::Ladder, 64};
+        MarketConfig ethUsd{"ETH-USD"};
+        btcUsd.arenaBytes = 1 << 20;
+        ethUsd.arenaBytes = 1 << 20;
+
+        const size_t before = resource.m_bytesAllocated;
+        EXPECTED(sme.InitialiseMarkets(std::vector<MarketConfig>{btcUsd, ethUsd}), (std::vector<MarketID>{0, 1}));
+        EXPECTED((resource.m_bytesAllocated - before >= (2 << 20)), true);
+        EXPECTED((resource.m_bytesAllocated - before < (3 << 20)), true);
+
+        // IDs still agree between shards as markets are added, or repeated
+        EXPECTED(sme.InitialiseMarkets({"ETH-USD", "SOL-USD"}), (std::vector<MarketID>{1, 2}));
+        EXPECTED(sme.GetMarketID("SOL-USD"), 2);
+    }
 
-        // For fairness we expect the earliest placed order at that position to be satisfied first
-        MatchedOrder expectedMatch1
+    {
+        START_TEST( "Sharded engine fails submits it can't queue while stopped" )
+        ShardedEngineConfig config;
+        config.shardCount = 1;
+        config.queueCapacity = 2;
+        config.pinThreads = false;
+
+        ShardedMatchingEngine sme{config};
+        sme.InitialiseMarkets({"BTC-USD"});
+
+        TestClient tc;
+        sme.RegisterEventObserver(&tc);
+
+        // Queued until started, then refused rather than waiting on a full queue
+        EXPECTED(sme.OnOrderPlace(Order{market, 10, 1, OrderType::Bid}), OrderPlaceEventResult::OrderQueued);
+        EXPECTED(sme.OnOrderPlace(Order{market, 11, 1, OrderType::Bid}), OrderPlaceEventResult::OrderQueued);
+        EXPECTED(sme.OnOrderPlace(Order{market, 12, 1, OrderType::Bid}), OrderPlaceEventResult::OrderCancelled);
+        EXPECTED(sme.OnOrderCancel(0), OrderCancelEventResult::OrderNotFound);
+        EXPECTED(sme.OnOrderModify(0, 10, 2), OrderModifyEventResult::OrderRejected);
+        EXPECTED(sme.OnMassCancel(1), OrderCancelEventResult::OrderNotFound);
+
+        sme.Start();
+        EXPECTED(sme.OnOrderCancel(0), OrderCancelEventResult::CancelQueued);
+        sme.Stop();
+
+        EXPECTED(tc.m_orderBookUpdateEvents.size(), 2);
+        EXPECTED(tc.m_cancelEvents, (std::vector<OrderID>{0}));
+    }
+
+    {
+        START_TEST( "Events written to a ring for readers on other threads" )
+
+        EventRing ring(8);
+
+        BasicMatchingEngine<EventRingSink> me;
+        const MarketID marketID = me.InitialiseMarkets({"BTC-USD"}).front();
+        me.GetSink<EventRingSink>().Attach(&ring);
+
+        EventRingReader reader = ring.Subscribe();
+        EXPECTED(reader.IsAttached(), true);
+
+        me.OnOrderPlace(Order{market, 10, 2, OrderType::Bid});
+        me.OnOrderPlace(Order{market, 10, 1, OrderType::Ask});
+        me.OnOrderCancel(0);
+
+        // Every input is followed by the depth of each level it changed
+        EXPECTED(ring.GetPublished(), 7);
+        EXPECTED(reader.GetLag(), 7);
+
+        EventRecord record;
+        EXPECTED(reader.TryRead(record), true);
+        EXPECTED(record.sequence, 0);
+        EXPECTED(record.type, EventRecordType::NewOrder);
+        EXPECTED(record.market, marketID);
+        EXPECTED(record.bidSideOrderID, 0);
+        EXPECTED(record.volume, 2);
+
+        EXPECTED(reader.TryRead(record), true);
+        EXPECTED(record.type, EventRecordType::Depth);
+        EXPECTED(record.side, OrderType::Bid);
+        EXPECTED(record.price, 10);
+        EXPECTED(record.volume, 2);
+        EXPECTED(record.orderCount, 1);
+
+        EXPECTED(reader.TryRead(record), true);
+        EXPECTED(record.type, EventRecordType::NewOrder);
+        EXPECTED(record.askSideOrderID, 1);
+
+        EXPECTED(reader.TryRead(record), true);
+        EXPECTED(record.type, EventRecordType::Fill);
+        EXPECTED(record.side, OrderType::Bid);
+        EXPECTED(record.bidSideOrderID, 0);
+        EXPECTED(record.askSideOrderID, 1);
+        EXPECTED(record.price, 10);
+        EXPECTED(record.volume, 1);
+
+        EXPECTED(reader.TryRead(record), true);
+        EXPECTED(record.type, EventRecordType::Depth);
+        EXPECTED(record.volume, 1);
+
+        EXPECTED(reader.TryRead(record), true);
+        EXPECTED(record.type, EventRecordType::Cancel);
+        EXPECTED(record.bidSideOrderID, 0);
+
+        EXPECTED(reader.TryRead(record), true);
+        EXPECTED(record.type, EventRecordType::Depth);
+        EXPECTED(record.volume, 0);
+        EXPECTED(record.orderCount, 0);
+
+        EXPECTED(reader.TryRead(record), false);
+        EXPECTED(reader.GetOverruns(), 0);
+        EXPECTED(ring.GetOverwritten(), 0);
+
+        // A reader left behind loses the oldest records rather than holding up matching
+        for(Price i = 0; i < 12; ++i)
+        {
+            me.OnOrderPlace(Order{market, 5, 1, OrderType::Bid});
+        }
+
+        EXPECTED(ring.GetOverwritten(), 16);
+
+        uint64_t read{0};
+        uint64_t lastSequence{0};
+
+        while(reader.TryRead(record))
+        {
+            ++read;
+            lastSequence = record.sequence;
+        }
+
+        EXPECTED(read + reader.GetOverruns(), 24);
+        EXPECTED((reader.GetOverruns() > 0), true);
+        EXPECTED(lastSequence, 30);
+
+        // A slot is handed out again once its reader has gone
+        {
+            std::vector<EventRingReader> readers;
+
+            for(size_t i = 1; i < EventRing::MaxReaders; ++i)
+            {
+                readers.push_back(ring.Subscribe());
+                EXPECTED(readers.back().IsAttached(), true);
+            }
+
+            EXPECTED(ring.Subscribe().IsAttached(), false);
+        }
+
+        for(size_t i = 0; i < 2 * EventRing::MaxReaders; ++i)
+        {
+            EXPECTED(ring.Subscribe().IsAttached(), true);
+        }
+
+        // Readers on their own threads see every record in order when keeping up
+        EventRing wideRing(1 << 16);
+        me.GetSink<EventRingSink>().Attach(&wideRing);
+
+        EventRingReader threadedReader = wideRing.Subscribe();
+        constexpr uint64_t placed{1000};
+        constexpr uint64_t published{placed * 2};
+
+        std::thread consumer([&threadedReader, &read, &lastSequence]()
+        {
+            EventRecord record;
+            read = 0;
+
+            while(read < published)
+            {
+                if(threadedReader.TryRead(record))
+                {
+                    lastSequence = record.sequence;
+                    ++read;
+                }
+            }
+        });
+
+        for(uint64_t i = 0; i < placed; ++i)
+        {
+            me.OnOrderPlace(Order{market, 20, 1, OrderType::Ask});
+        }
+
+        consumer.join();
+
+        EXPECTED(read, published);
+        EXPECTED(lastSequence, published - 1);
+        EXPECTED(threadedReader.GetOverruns(), 0);
+    }
+
+    {
+        START_TEST( "Journal replay rebuilds the books" )
+
+        const std::string journalPath{"MatchingEngineTest.journal"};
+        std::remove(journalPath.c_str());
+
+        JournalConfig config;
+        config.path = journalPath;
+        config.sync = JournalSyncPolicy::None;
+        config.groupCommitRecords = 4;
+
+        TestClient original;
+
+        {
+            JournalWriter journal;
+            EXPECTED(journal.Open(config), true);
+
+            MatchingEngine me;
+            me.InitialiseMarkets({"BTC-USD", "ETH-USD"});
+            me.RegisterEventObserver(&original);
+            me.AttachJournal(&journal);
+
+            me.OnOrderPlace(Order{market, 10, 5, OrderType::Bid});
+            me.OnOrderPlace(Order{market, 9, 2, OrderType::Bid});
+            me.OnOrderPlace(Order{"ETH-USD", 7, 1, OrderType::Ask});
+            me.OnOrderPlace(Order{market, 10, 8, OrderType::Ask});
+            me.OnOrderCancel(1);
+
+            // Rejected inputs never reach the journal
+            me.OnOrderPlace(Order{market, 0, 3, OrderType::Ask});
+            me.OnOrderCancel(42);
+
+            // The group of four was handed to the flusher as it filled, the cancel only now
+            EXPECTED(journal.GetRecordsAppended(), 5);
+            EXPECTED((journal.GetRecordsCommitted() <= 4), true);
+            EXPECTED(journal.Commit(), true);
+            EXPECTED(journal.GetRecordsCommitted(), 5);
+        }
+
+        TestClient recovered;
+
+        MatchingEngine me;
+        const auto marketIDs = me.InitialiseMarkets({"BTC-USD", "ETH-USD"});
+        me.RegisterEventObserver(&recovered);
+
+        JournalReader reader;
+        EXPECTED(reader.Open(journalPath), true);
+        EXPECTED(me.Replay(reader), 5);
+
+        // Observers heard nothing of the replay
+        EXPECTED(recovered.m_orderBookUpdateEvents.empty(), true);
+        EXPECTED(recovered.m_matchingEvents.empty(), true);
+        EXPECTED(recovered.m_cancelEvents.empty(), true);
+
+        EXPECTED(me.GetTopOfBook(marketIDs[0]).bestBid, 0);
+        EXPECTED(me.GetTopOfBook(marketIDs[0]).bestAsk, 10);
+        EXPECTED(me.GetTopOfBook(marketIDs[1]).bestAsk, 7);
+
+        // Carries on exactly where the original engine left off
+        EXPECTED(me.OnOrderPlace(Order{market, 10, 1, OrderType::Bid}), OrderPlaceEventResult::OrderMatched);
+        EXPECTED(recovered.m_orderBookUpdateEvents.size(), 1);
+        EXPECTED(recovered.m_orderBookUpdateEvents[0].first, 4);
+        EXPECTED(recovered.m_matchingEvents.size(), 1);
+        EXPECTED(recovered.m_matchingEvents[0], (MatchedOrder{marketIDs[0], 4, 3, 10, 1, OrderType::Ask}));
+
+        // The journal is extended rather than replaced
         {
-            market,
-            5,          // bid side orderID will be the one we've just placed (5th)
-            2,          // ask side will be the first matching ask side we placed (3rd)
-            20,         // execution price
-            1,          // size of position as entire position consumed
-            OrderType::Ask  // Sell
+            JournalWriter journal;
+            EXPECTED(journal.Open(config), true);
+            me.AttachJournal(&journal);
+            me.OnOrderCancel(3);
+        }
+
+        JournalReader extended;
+        EXPECTED(extended.Open(journalPath), true);
+
+        JournalRecord record;
+        uint64_t records{0};
+
+        while(extended.Next(record))
+        {
+            ++records;
+        }
+
+        EXPECTED(records, 6);
+        EXPECTED(record.type, JournalRecordType::Cancel);
+        EXPECTED(record.oid, 3);
+
+        extended.Close();
+        std::remove(journalPath.c_str());
+    }
+
+    {
+        START_TEST( "Parallel replay matches the original fills in order" )
+
+        const std::string journalPath{"MatchingEngineTest.journal"};
+        std::remove(journalPath.c_str());
+
+        JournalConfig config;
+        config.path = journalPath;
+        config.sync = JournalSyncPolicy::None;
+
+        std::vector<MarketConfig> markets{
+            MarketConfig{"BTC-USD"},
+            MarketConfig{"ETH-USD", PriceLevelLayout::Ladder, 64},
+            MarketConfig{"SOL-USD"},
+            MarketConfig{"XRP-USD"},
+            MarketConfig{"ADA-USD"}
         };
 
-        // Followed by the next at that position
-        MatchedOrder expectedMatch2
+        markets[2].matchingPolicy = MatchingPolicy::ProRata;
+        markets[3].selfTradePrevention = SelfTradePrevention::Decrement;
+
+        TestClient original;
+
+        {
+            JournalWriter journal;
+            EXPECTED(journal.Open(config), true);
+
+            MatchingEngine me;
+            me.InitialiseMarkets(markets);
+            me.RegisterEventObserver(&original);
+            me.AttachJournal(&journal);
+
+            // Fixed pseudo random flow around a price of 100 in the first
+            // four markets, the last is left without any orders at all
+            uint32_t state{12345};
+            const auto Next = [&state](uint32_t range)
+            {
+                state = state * 1103515245 + 12345;
+                return (state >> 8) % range;
+            };
+
+            for(int input = 0; input < 4000; ++input)
+            {
+                const uint32_t action = Next(10);
+                const OrderID oid = Next(static_cast<uint32_t>(me.GetNextOrderID()) + 1);
+
+                if(action < 2)
+                {
+                    me.OnOrderCancel(oid);
+                }
+                else if(action < 4)
+                {
+                    me.OnOrderModify(oid, 95 + Next(10), 1 + Next(5));
+                }
+                else if(action == 4 && Next(10) == 0)
+                {
+                    me.OnMassCancel(1 + Next(3), Next(2) == 0 ? InvalidMarketID : Next(4));
+                }
+                else
+                {
+                    me.OnOrderPlace(Next(4), Order{"", 95 + Next(10), 1 + Next(5), Next(2) == 0 ? OrderType::Bid : OrderType::Ask,
+                        TimeInForce::GoodTillCancel, OrderKind::Limit, Next(4)});
+                }
+            }
+
+            EXPECTED(journal.Commit(), true);
+        }
+
+        EXPECTED((original.m_matchingEvents.size() > 100), true);
+
+        // Small chunks, so the journal is streamed through many of them
+        ReplayConfig replayConfig;
+        replayConfig.threadCount = 3;
+        replayConfig.chunkRecords = 16;
+        replayConfig.chunksInFlight = 2;
+
+        ParallelReplay replay{markets, replayConfig};
+        EXPECTED(replay.Run(journalPath), true);
+
+        const std::vector<ReplayFill>& fills = replay.GetFills();
+        EXPECTED(fills.size(), original.m_matchingEvents.size());
+
+        for(size_t fill = 0; fill < fills.size() && fill < original.m_matchingEvents.size(); ++fill)
         {
-            market,
-            5,          // bid side orderID will be the one we've just placed (5th)
-            3,          // ask side will be the first matching ask side we placed (3rd)
-            20,         // execution price
-            1,          // size of position as entire position consumed
-            OrderType::Ask  // Sell
+            EXPECTED(fills[fill].fill, original.m_matchingEvents[fill]);
+            EXPECTED(fills[fill].fill.restingVolumeRemaining, original.m_matchingEvents[fill].restingVolumeRemaining);
+            EXPECTED((fill == 0 || fills[fill - 1].sequence <= fills[fill].sequence), true);
+        }
+
+        // The same journal on a single thread
+        replayConfig.threadCount = 1;
+        ParallelReplay serial{markets, replayConfig};
+        EXPECTED(serial.Run(journalPath), true);
+        EXPECTED(serial.GetRecordsReplayed(), replay.GetRecordsReplayed());
+        EXPECTED(serial.GetFills().size(), fills.size());
+
+        std::remove(journalPath.c_str());
+        EXPECTED(replay.Run(journalPath), false);
+    }
+
+    {
+        START_TEST( "Snapshot restores every resting order" )
+
+        const std::string snapshotPath{"MatchingEngineTest.snapshot"};
+
+        // A narrow ladder window puts some of the levels in its overflow
+        const std::vector<MarketConfig> markets{
+            MarketConfig{market, PriceLevelLayout::Map},
+            MarketConfig{"ETH-USD", PriceLevelLayout::Ladder, 64}
         };
 
-        // Since that consumes all the orders at the earlier price point, we now move to
-        // the next price position that still matches the BID placed
-        MatchedOrder expectedMatch3
+        const std::vector<Order> resting{
+            {market, 100, 4, OrderType::Bid},
+            {market, 100, 2, OrderType::Bid},
+            {market, 90, 1, OrderType::Bid},
+            {market, 110, 3, OrderType::Ask},
+            {"ETH-USD", 500, 2, OrderType::Ask},
+            {"ETH-USD", 900, 1, OrderType::Ask},
+            {"ETH-USD", 400, 5, OrderType::Bid},
+            {"ETH-USD", 200, 1, OrderType::Bid},
+            {"ETH-USD", 400, 1, OrderType::Bid, TimeInForce::GoodTillCancel, OrderKind::Limit, 7},
+            {market, 100, 1, OrderType::Ask}         // partly fills the first bid
+        };
+
+        MatchingEngine original;
+        const auto marketIDs = original.InitialiseMarkets(markets);
+        PlaceOrdersFn(original, resting);
+        original.OnOrderCancel(2);
+
+        // Stops are carried over waiting for their trigger
+        original.OnOrderPlace(Order{"ETH-USD", 0, 1, OrderType::Ask, TimeInForce::GoodTillCancel, OrderKind::Stop, NoOwner, 300});
+
+        // Taken from a forked copy of the engine while it carries on
+        SnapshotProcess snapshotProcess;
+        EXPECTED(snapshotProcess.Start([&]() { return original.WriteSnapshot(snapshotPath); }), true);
+        EXPECTED(snapshotProcess.Wait(), true);
+
+        MatchingEngine restored;
+        restored.InitialiseMarkets(markets);
+        EXPECTED(restored.LoadSnapshot(snapshotPath), true);
+
+        // Only ever loaded in to an empty engine
+        EXPECTED(restored.LoadSnapshot(snapshotPath), false);
+
+        for(const MarketID marketID : marketIDs)
         {
-            market,
-            5,          // bid side orderID will be the one we've just placed (5th)
-            4,          // ask side will be the first matching ask side we placed (3rd)
-            21,         // execution price
-            1,          // only a portion of the position has been consumed
-            OrderType::Ask  // Sell
+            EXPECTED(restored.GetTopOfBook(marketID).bestBid, original.GetTopOfBook(marketID).bestBid);
+            EXPECTED(restored.GetTopOfBook(marketID).bestAsk, original.GetTopOfBook(marketID).bestAsk);
+        }
+
+        // Cancels find restored orders, including those in the ladder's overflow
+        EXPECTED(restored.OnOrderCancel(2), OrderCancelEventResult::OrderNotFound);
+        EXPECTED(restored.OnOrderCancel(5), OrderCancelEventResult::OrderCancelled);
+        original.OnOrderCancel(5);
+
+        // Owners come back with their orders
+        EXPECTED(restored.OnMassCancel(7), OrderCancelEventResult::OrderCancelled);
+        EXPECTED(restored.OnOrderCancel(8), OrderCancelEventResult::OrderNotFound);
+        original.OnMassCancel(7);
+
+        // Both engines trade identically from here, through every level
+        TestClient tcOriginal;
+        TestClient tcRestored;
+        original.RegisterEventObserver(&tcOriginal);
+        restored.RegisterEventObserver(&tcRestored);
+
+        const std::vector<Order> sweep{
+            {market, 1, 10, OrderType::Ask},
+            {market, 1000, 10, OrderType::Bid},
+            {"ETH-USD", 1, 10, OrderType::Ask},
+            {"ETH-USD", 1000, 10, OrderType::Bid}
         };
-        
-        EXPECTED(tc.m_matchingEvents[0], expectedMatch1);
-        EXPECTED(tc.m_matchingEvents[1], expectedMatch2);
-        EXPECTED(tc.m_matchingEvents[2], expectedMatch3);
 
-        // Check nothing was cancelled
-        EXPECTED(tc.m_cancelEvents.empty(), true);
+        PlaceOrdersFn(original, sweep);
+        PlaceOrdersFn(restored, sweep);
+
+        EXPECTED(tcRestored.m_matchingEvents.size(), 8);
+        EXPECTED(tcRestored.m_matchingEvents.size(), tcOriginal.m_matchingEvents.size());
+
+        for(size_t i = 0; i < tcOriginal.m_matchingEvents.size() && i < tcRestored.m_matchingEvents.size(); ++i)
+        {
+            EXPECTED(tcRestored.m_matchingEvents[i], tcOriginal.m_matchingEvents[i]);
+        }
+
+        EXPECTED(tcRestored.m_orderBookUpdateEvents.size(), 4);
+        EXPECTED(tcRestored.m_orderBookUpdateEvents[0].first, 11);
+
+        EXPECTED(tcRestored.m_stopTriggeredEvents.size(), 1);
+        EXPECTED(tcRestored.m_stopTriggeredEvents[0].first, 10);
+        EXPECTED(tcOriginal.m_stopTriggeredEvents.size(), 1);
+
+        std::remove(snapshotPath.c_str());
     }
 
     {
-        START_TEST( "Simple matching tests initiated by ASK" )
-        MatchingEngine me;
-        me.InitialiseMarkets({"BTC-USD"});
+        START_TEST( "Corrupted snapshots are refused" )
+
+        const std::string snapshotPath{"MatchingEngineTest.snapshot"};
+
+        // Bids at 100 and 90 and an ask at 110
+        SnapshotImage valid;
+        valid.header.marketCount = 1;
+        valid.header.nextOrderID = 3;
+        valid.header.levelCount = 3;
+        valid.header.orderCount = 3;
+        valid.markets = {SnapshotMarket{2, 1}};
+        valid.levels = {SnapshotLevel{100, 1}, SnapshotLevel{90, 1}, SnapshotLevel{110, 1}};
+        valid.orders = {SnapshotOrder{0, 1}, SnapshotOrder{1, 2}, SnapshotOrder{2, 3}};
+
+        // Loaded in to a fresh engine, which is left untouched when refused
+        const auto Load = [&](const SnapshotImage& image, Quantity lotSize = 1)
+        {
+            MarketConfig config{market};
+            config.lotSize = lotSize;
 
-        TestClient tc;
-        me.RegisterEventObserver(&tc);
+            MatchingEngine me;
+            me.InitialiseMarkets(std::vector<MarketConfig>{config});
 
-        std::vector<Order> orders1{
-            {market, 10, 2, OrderType::Bid},
-            {market, 11, 1, OrderType::Bid},
-            {market, 20, 1, OrderType::Ask},
-            {market, 21, 1, OrderType::Ask}
+            const bool loaded = WriteSnapshotFile(snapshotPath, image) && me.LoadSnapshot(snapshotPath);
+            return loaded || me.GetTopOfBook(0).bestBid != 0 || me.GetTopOfBook(0).bestAsk != 0;
         };
 
-        auto results1 = PlaceOrdersFn(me, orders1);
+        EXPECTED(Load(valid), true);
 
-        // Check no matches occurred
-        EXPECTED(tc.m_matchingEvents.empty(), true);
+        // A level without any orders
+        SnapshotImage image{valid};
+        image.markets[0].askLevels = 2;
+        image.levels.push_back(SnapshotLevel{120, 0});
+        image.header.levelCount = 4;
+        EXPECTED(Load(image), false);
 
-        // Check we received the response codes we expect
-        EXPECTED(results1.size(), 4);
-        EXPECTED(results1[0], OrderPlaceEventResult::OrderPlaced);
-        EXPECTED(results1[1], OrderPlaceEventResult::OrderPlaced);
-        EXPECTED(results1[2], OrderPlaceEventResult::OrderPlaced);
-        EXPECTED(results1[3], OrderPlaceEventResult::OrderPlaced);
+        // The same ID twice, among resting orders or alongside a stop
+        image = valid;
+        image.orders[1].id = 0;
+        EXPECTED(Load(image), false);
 
-        // Check the correct events were emitted
-        EXPECTED(tc.m_orderBookUpdateEvents.size(), 4);
-        EXPECTED(tc.m_orderBookUpdateEvents[0].first, 0);
-        EXPECTED(tc.m_orderBookUpdateEvents[0].second, orders1[0]);
-        EXPECTED(tc.m_orderBookUpdateEvents[1].first, 1);
-        EXPECTED(tc.m_orderBookUpdateEvents[1].second, orders1[1]);
-        EXPECTED(tc.m_orderBookUpdateEvents[2].first, 2);
-        EXPECTED(tc.m_orderBookUpdateEvents[2].second, orders1[2]);
-        EXPECTED(tc.m_orderBookUpdateEvents[3].first, 3);
-        EXPECTED(tc.m_orderBookUpdateEvents[3].second, orders1[3]);
-
-        // After initially populating a simple orderbook, now
-        // place an order that crosses an existing BID positions
-
-        // This order should match the orders at price 11, then at 10
-        std::vector<Order> orders2{
-            {market, 10, 2, OrderType::Ask},
+        image = valid;
+        image.stops = {SnapshotStop{2, 0, 120, 1, 0}};
+        image.header.stopCount = 1;
+        EXPECTED(Load(image), false);
+
+        image.stops[0].id = 3;
+        image.header.nextOrderID = 4;
+        EXPECTED(Load(image), true);
+
+        // Levels out of order or repeated on a side
+        image = valid;
+        image.levels[0].price = 80;
+        EXPECTED(Load(image), false);
+
+        image.levels[0].price = 90;
+        EXPECTED(Load(image), false);
+
+        // A crossed or locked book
+        image = valid;
+        image.levels[2].price = 100;
+        EXPECTED(Load(image), false);
+
+        image.levels[2].price = 95;
+        EXPECTED(Load(image), false);
+
+        // Resting orders without any volume or off the lot
+        image = valid;
+        image.orders[2].volume = 0;
+        EXPECTED(Load(image), false);
+
+        image = valid;
+        image.orders[0].volume = 2;
+        image.orders[1].volume = 3;
+        image.orders[2].volume = 4;
+        EXPECTED(Load(image, 2), false);
+
+        image.orders[1].volume = 2;
+        EXPECTED(Load(image, 2), true);
+
+        std::remove(snapshotPath.c_str());
+    }
+
+    {
+        START_TEST( "Snapshot carries the last trade price" )
+
+        const std::string snapshotPath{"MatchingEngineTest.snapshot"};
+
+        MatchingEngine original;
+        const MarketID marketID = original.InitialiseMarkets({market}).front();
+
+        const std::vector<Order> orders{
+            {market, 100, 1, OrderType::Bid},
+            {market, 100, 1, OrderType::Ask},       // trades at 100
+            {market, 95, 2, OrderType::Bid}
         };
 
-        auto results2 = PlaceOrdersFn(me, orders2);
+        PlaceOrdersFn(original, orders);
+        EXPECTED(original.WriteSnapshot(snapshotPath), true);
 
-        // Check we received the response codes we expect
-        EXPECTED(results2.size(), 1);
-        EXPECTED(results2[0], OrderPlaceEventResult::OrderMatched);
+        MatchingEngine restored;
+        restored.InitialiseMarkets({market});
+        EXPECTED(restored.LoadSnapshot(snapshotPath), true);
 
-        EXPECTED(tc.m_matchingEvents.size(), 2);
+        TestClient tcOriginal;
+        TestClient tcRestored;
+        original.RegisterEventObserver(&tcOriginal);
+        restored.RegisterEventObserver(&tcRestored);
+
+        // Already covered by the last trade, so set off as it arrives
+        const Order stop{market, 0, 1, OrderType::Ask, TimeInForce::GoodTillCancel, OrderKind::Stop, NoOwner, 105};
+        EXPECTED(original.OnOrderPlace(Order{stop}), OrderPlaceEventResult::OrderPlaced);
+        EXPECTED(restored.OnOrderPlace(Order{stop}), OrderPlaceEventResult::OrderPlaced);
 
-        // We expect to walk backwards through the bids until we reach the price the ask was placed at
-        MatchedOrder expectedMatch1
+        EXPECTED(tcRestored.m_stopTriggeredEvents.size(), 1);
+        EXPECTED(tcRestored.m_stopTriggeredEvents.size(), tcOriginal.m_stopTriggeredEvents.size());
+        EXPECTED(tcRestored.m_matchingEvents.size(), 1);
+        EXPECTED(tcRestored.m_matchingEvents.size(), tcOriginal.m_matchingEvents.size());
+
+        for(size_t i = 0; i < tcOriginal.m_matchingEvents.size() && i < tcRestored.m_matchingEvents.size(); ++i)
         {
-            market,
-            1,          // first matched bid side orderID will be the second added
-            4,          // ask side will be the first matching ask side we placed (3rd)
-            11,         // execution price
-            1,          // size of position as entire position consumed
-            OrderType::Bid  // Buy
-        };
+            EXPECTED(tcRestored.m_matchingEvents[i], tcOriginal.m_matchingEvents[i]);
+        }
+
+        EXPECTED(restored.GetTopOfBook(marketID).bestBid, 95);
+        EXPECTED(restored.GetTopOfBook(marketID).bestBid, original.GetTopOfBook(marketID).bestBid);
+
+        std::remove(snapshotPath.c_str());
+    }
+
+    {
+        START_TEST( "Latency histogram percentiles" )
+
+        LatencyHistogram histogram;
+
+        for(uint64_t value = 1; value <= 1000; ++value)
+        {
+            histogram.Record(value);
+        }
+
+        histogram.Record(1000000);
+
+        EXPECTED(histogram.GetCount(), 1001);
+        EXPECTED(histogram.GetMin(), 1);
+        EXPECTED(histogram.GetMax(), 1000000);
+
+        // Small values are exact, larger ones within 1%
+        EXPECTED(histogram.GetPercentile(5.0), 51);
+        EXPECTED((histogram.GetPercentile(50.0) >= 501 && histogram.GetPercentile(50.0) <= 506), true);
+        EXPECTED((histogram.GetPercentile(99.0) >= 991 && histogram.GetPercentile(99.0) <= 1000), true);
+        EXPECTED(histogram.GetPercentile(100.0), 1000000);
+
+        LatencyHistogram other;
+        other.Record(5);
+        histogram.Merge(other);
+
+        EXPECTED(histogram.GetCount(), 1002);
+        EXPECTED(histogram.GetPercentile(0.0), 1);
+    }
+
+#ifdef Linux
+    {
+        START_TEST( "Orders entered through the shared memory gateway" )
+
+        MatchingEngine me;
+        const MarketID btc = me.InitialiseMarkets({"BTC-USD"}).front();
+
+        GatewayConfig config;
+        config.name = "matching-engine-gateway-test";
+        config.maxClients = 2;
+        config.ringCapacity = 8;
+
+        OrderGateway gateway;
+        EXPECTED(gateway.Open(config), true);
+
+        GatewayClient client;
+        GatewayClient other;
+        GatewayClient refused;
+        EXPECTED(client.Attach(config.name), true);
+        EXPECTED(other.Attach(config.name), true);
+        EXPECTED(refused.Attach(config.name), false);
+        other.Detach();
+
+        const OrderID first = me.GetNextOrderID();
+
+        GatewayRequest ask;
+        ask.correlationID = 1;
+        ask.market = btc;
+        ask.side = OrderType::Ask;
+        ask.price = 10;
+        ask.volume = 5;
+
+        GatewayRequest fok{ask};
+        fok.correlationID = 2;
+        fok.side = OrderType::Bid;
+        fok.volume = 10;
+        fok.timeInForce = TimeInForce::FillOrKill;
+
+        GatewayRequest modify;
+        modify.correlationID = 3;
+        modify.type = GatewayRequestType::Modify;
+        modify.oid = first;
+        modify.price = 10;
+        modify.volume = 2;
+
+        GatewayRequest cancel;
+        cancel.correlationID = 4;
+        cancel.type = GatewayRequestType::Cancel;
+        cancel.oid = first;
+
+        GatewayRequest cancelAgain{cancel};
+        cancelAgain.correlationID = 5;
+
+        EXPECTED(client.TrySend(ask), true);
+        EXPECTED(client.TrySend(fok), true);
+        EXPECTED(client.TrySend(modify), true);
+        EXPECTED(client.TrySend(cancel), true);
+        EXPECTED(client.TrySend(cancelAgain), true);
+
+        GatewayResponse response;
+        EXPECTED(client.TryReceive(response), false);
+        EXPECTED(gateway.Poll(me), 5);
+
+        std::vector<GatewayResponse> responses;
+
+        while(client.TryReceive(response))
+        {
+            responses.push_back(response);
+        }
+
+        EXPECTED(responses.size(), 5);
+        EXPECTED(responses[0].correlationID, 1);
+        EXPECTED(responses[0].oid, first);
+        EXPECTED(responses[0].result.placed, OrderPlaceEventResult::OrderPlaced);
+        // Killed without ever being accepted, so it was given no ID
+        EXPECTED(responses[1].oid, NoOrderID);
+        EXPECTED(responses[1].result.placed, OrderPlaceEventResult::OrderExpired);
+        EXPECTED(responses[2].type, GatewayRequestType::Modify);
+        EXPECTED(responses[2].result.modified, OrderModifyEventResult::OrderModified);
+        EXPECTED(responses[3].result.cancelled, OrderCancelEventResult::OrderCancelled);
+        EXPECTED(responses[4].correlationID, 5);
+        EXPECTED(responses[4].result.cancelled, OrderCancelEventResult::OrderNotFound);
+
+        // A full ring pushes back on the client, and polls can be bounded
+        for(uint64_t i = 0; i < 8; ++i)
+        {
+            cancel.correlationID = 10 + i;
+            EXPECTED(client.TrySend(cancel), true);
+        }
+
+        EXPECTED(client.TrySend(cancel), false);
+        EXPECTED(gateway.Poll(me, 3), 3);
+        EXPECTED(gateway.Poll(me), 5);
+        EXPECTED(gateway.Poll(me), 0);
 
-        // Followed by the next at the previous position
-        MatchedOrder expectedMatch2
+        // A client taking over the slot never sees answers meant for the one
+        // before, whether they were left unread or their requests still queued
+        cancel.correlationID = 20;
+        EXPECTED(client.TrySend(cancel), true);
+        client.Detach();
+
+        EXPECTED(other.Attach(config.name), true);
+        EXPECTED(other.TryReceive(response), false);
+        EXPECTED(gateway.Poll(me), 1);
+        EXPECTED(other.TryReceive(response), false);
+
+        cancel.correlationID = 30;
+        EXPECTED(other.TrySend(cancel), true);
+        EXPECTED(gateway.Poll(me), 1);
+        EXPECTED(other.TryReceive(response), true);
+        EXPECTED(response.correlationID, 30);
+
+        other.Detach();
+        EXPECTED(client.Attach(config.name), true);
+
+        // A client that dies without detaching gives up its slot
+        const pid_t child = fork();
+
+        if(child == 0)
         {
-            market,
-            0,          // followed by the first orderID which was at an earlier position
-            4,          // ask side will be the first matching ask side we placed (3rd)
-            10,         // execution price
-            1,          // size of position as entire position consumed
-            OrderType::Bid  // Buy
+            GatewayClient crashed;
+            _exit(crashed.Attach(config.name) ? 0 : 1);
+        }
+
+        int status{0};
+        EXPECTED(waitpid(child, &status, 0), child);
+        EXPECTED((WIFEXITED(status) && WEXITSTATUS(status) == 0), true);
+        EXPECTED(other.Attach(config.name), true);
+        EXPECTED(refused.Attach(config.name), false);
+        other.Detach();
+
+        EXPECTED(gateway.IsStopRequested(), false);
+        client.RequestStop();
+        EXPECTED(gateway.IsStopRequested(), true);
+
+        client.Detach();
+        gateway.Close();
+        EXPECTED(client.Attach(config.name), false);
+    }
+#endif
+
+#ifdef MATCHING_ENGINE_INSTRUMENTATION
+    {
+        START_TEST( "Instrumentation counts every stage" )
+
+        MatchingEngine me;
+        me.InitialiseMarkets({"BTC-USD"});
+
+        std::vector<Order> orders{
+            {market, 10, 1, OrderType::Ask},
+            {market, 11, 1, OrderType::Ask},
+            {market, 12, 1, OrderType::Ask},
+            {market, 12, 3, OrderType::Bid},    // walks three levels for three fills
+            {market, 5, 1, OrderType::Bid}
         };
 
-        EXPECTED(tc.m_matchingEvents[0], expectedMatch1);
-        EXPECTED(tc.m_matchingEvents[1], expectedMatch2);
+        PlaceOrdersFn(me, orders);
+
+        me.OnOrderCancel(4);
+        me.OnOrderCancel(4);
+
+        const EngineInstrumentation& instrumentation = me.GetInstrumentation();
+
+        EXPECTED(instrumentation.counters.ordersPlaced, 5);
+        EXPECTED(instrumentation.counters.aggressors, 1);
+        EXPECTED(instrumentation.counters.fills, 3);
+        EXPECTED(instrumentation.counters.levelsWalked, 3);
+        EXPECTED(instrumentation.GetFillsPerAggressor(), 3.0);
+        EXPECTED(instrumentation.GetCancelHitRatio(), 0.5);
+
+        EXPECTED(instrumentation.GetStage(EngineStage::MarketLookup).GetCount(), 5);
+        EXPECTED(instrumentation.GetStage(EngineStage::Match).GetCount(), 5);
+        EXPECTED(instrumentation.GetStage(EngineStage::Rest).GetCount(), 4);
+        // Nine events and a batch of depth updates for all but the failed cancel
+        EXPECTED(instrumentation.GetStage(EngineStage::Notify).GetCount(), 15);
+        EXPECTED(instrumentation.GetStage(EngineStage::Cancel).GetCount(), 2);
+        EXPECTED(instrumentation.GetStage(EngineStage::Journal).GetCount(), 0);
 
-        // Check nothing was cancelled
-        EXPECTED(tc.m_cancelEvents.empty(), true);
+        me.ResetInstrumentation();
+        EXPECTED(me.GetInstrumentation().counters.ordersPlaced, 0);
     }
+#endif
 
     if(testsFailed == 0)
     {